@@ -1,2 +1,9 @@
+#include "StagingMemory.h"
+
+// decoded images are short-lived staging data, recycle them through the staging pool
+#define STBI_MALLOC(sz) StagingMemory::allocate(sz)
+#define STBI_REALLOC(p, newsz) StagingMemory::reallocate(p, newsz)
+#define STBI_FREE(p) StagingMemory::release(p)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -0,0 +1,36 @@
+// Per cluster point light lists built by LightClusters, shared by clustered forward shading and the deferred light
+// pass. The view frustum is split into CLUSTER_X * CLUSTER_Y screen tiles and CLUSTER_Z exponential depth slices.
+#include "lights.glsl"
+
+uniform mat4 view;
+
+uniform samplerBuffer pointLightData; // a PointLight is 4 RGBA32F texels, the std140 layout of lights.glsl
+uniform usamplerBuffer clusterGrid; // per cluster: offset into clusterLights, light count
+uniform usamplerBuffer clusterLights; // light indices, grouped by cluster
+uniform vec2 clusterTileScale; // clusters per pixel in x and y
+uniform vec2 clusterDepthScale; // slice = log(depth) * x + y
+
+PointLight FetchPointLight(int index)
+{
+    vec4 t0 = texelFetch(pointLightData, index * 4);
+    vec4 t1 = texelFetch(pointLightData, index * 4 + 1);
+    vec4 t2 = texelFetch(pointLightData, index * 4 + 2);
+    vec4 t3 = texelFetch(pointLightData, index * 4 + 3);
+    return PointLight(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz);
+}
+
+// offset into clusterLights and light count of the cluster the current fragment, at world position fragPos, is in
+uvec2 ClusterRange(vec3 fragPos)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int slice = int(log(depth) * clusterDepthScale.x + clusterDepthScale.y);
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * clusterTileScale), slice);
+    cluster = clamp(cluster, ivec3(0), ivec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+    return texelFetch(clusterGrid, cluster.x + CLUSTER_X * (cluster.y + CLUSTER_Y * cluster.z)).xy;
+}
+
+// the i-th light of a cluster range
+PointLight ClusterLight(uvec2 range, uint i)
+{
+    return FetchPointLight(int(texelFetch(clusterLights, int(range.x + i)).x));
+}
\ No newline at end of file
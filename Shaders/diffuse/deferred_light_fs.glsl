@@ -0,0 +1,51 @@
+#version 330 core
+out vec4 FragColor;
+
+// Light pass of the deferred pipeline, a fullscreen triangle. The surface comes from the G-buffer and the world
+// position is rebuilt from depth; point lights come from the same cluster lists as clustered forward shading, so a
+// pixel only visits the lights that reach it, and each pixel is lit once however many triangles covered it.
+
+#include "lighting.glsl"
+#include "clusters.glsl"
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gDepth;
+
+uniform vec3 viewPos;
+uniform mat4 inverseViewProjection;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // the geometry pass drew nothing here
+    if (depth == 1.0)
+    discard;
+
+    vec2 ndc = gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0;
+    vec4 position = inverseViewProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    vec3 FragPos = position.xyz / position.w;
+
+    // properties
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec4 normalShininess = texelFetch(gNormalShininess, pixel, 0);
+    vec3 norm = normalShininess.xyz;
+    vec3 viewDir = normalize(viewPos - FragPos);
+    Surface surface = Surface(albedoSpecular.rgb, vec3(albedoSpecular.a), normalShininess.w);
+
+    // phase 1: directional lighting
+    vec3 result = CalcDirLight(dirLight, norm, viewDir, surface);
+
+    // phase 2: the point lights of this cluster
+    uvec2 range = ClusterRange(FragPos);
+    for (uint i = 0u; i < range.y; i++)
+    result += CalcPointLight(ClusterLight(range, i), norm, FragPos, viewDir, surface);
+
+    // phase 3: spot light
+#if SPOT_LIGHT
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir, surface);
+#endif
+
+    FragColor = vec4(result, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 330 core
+#include "vertex.glsl"
+
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 aModel; // per instance, occupies locations 3-6
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    gl_Position = projection * view * aModel * vec4(decodePosition(aPos), 1.0);
+}
\ No newline at end of file
@@ -1,4 +1,6 @@
 #version 330 core
+#include "vertex.glsl"
+
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
@@ -7,5 +9,5 @@ uniform mat4 projection;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * model * vec4(decodePosition(aPos), 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,39 @@
+#version 330 core
+out vec4 FragColor;
+
+// Clustered forward shading. LightClusters bins the point lights on the CPU every frame, so a fragment only visits
+// the lights that can reach its cluster. The "Lights" block still carries the directional and spot light;
+// NR_POINT_LIGHTS is 0 here because point lights come from texture buffers instead.
+
+#include "lighting.glsl"
+#include "material.glsl"
+#include "clusters.glsl"
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+uniform vec3 viewPos;
+
+void main()
+{
+    // properties
+    vec3 norm = normalize(Normal);
+    vec3 viewDir = normalize(viewPos - FragPos);
+    Surface surface = SampleMaterial(TexCoords);
+
+    // phase 1: directional lighting
+    vec3 result = CalcDirLight(dirLight, norm, viewDir, surface);
+
+    // phase 2: the point lights of this cluster
+    uvec2 range = ClusterRange(FragPos);
+    for (uint i = 0u; i < range.y; i++)
+    result += CalcPointLight(ClusterLight(range, i), norm, FragPos, viewDir, surface);
+
+    // phase 3: spot light
+#if SPOT_LIGHT
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir, surface);
+#endif
+
+    FragColor = vec4(result, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#version 330 core
+#include "vertex.glsl"
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in ENCODED_NORMAL aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in mat4 aModel; // per instance, occupies locations 3-6
+layout (location = 7) in mat3 aNormalMatrix; // per instance, occupies locations 7-9, computed on the CPU
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    FragPos = vec3(aModel * vec4(decodePosition(aPos), 1.0));
+    Normal = aNormalMatrix * decodeNormal(aNormal);
+    TexCoords = aTexCoords;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
\ No newline at end of file
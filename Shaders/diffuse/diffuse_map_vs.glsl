@@ -1,6 +1,8 @@
 #version 330 core
+#include "vertex.glsl"
+
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in ENCODED_NORMAL aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
 out vec3 FragPos;
@@ -8,13 +10,14 @@ out vec3 Normal;
 out vec2 TexCoords;
 
 uniform mat4 model;
+uniform mat3 normalMatrix; // transpose(inverse(mat3(model))), computed once per object on the CPU
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    FragPos = vec3(model * vec4(decodePosition(aPos), 1.0));
+    Normal = normalMatrix * decodeNormal(aNormal);
     TexCoords = aTexCoords;
 
     gl_Position = projection * view * vec4(FragPos, 1.0);
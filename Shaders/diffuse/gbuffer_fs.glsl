@@ -0,0 +1,18 @@
+#version 330 core
+// Geometry pass of the deferred pipeline: stores the surface instead of lighting it, the light pass reads it back.
+layout (location = 0) out vec4 gAlbedoSpecular; // rgb albedo, a specular intensity
+layout (location = 1) out vec4 gNormalShininess; // xyz world space normal, w shininess
+
+#include "material.glsl"
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+void main()
+{
+    Surface surface = SampleMaterial(TexCoords);
+    // the specular map is grey, one channel carries it
+    gAlbedoSpecular = vec4(surface.albedo, surface.specular.r);
+    gNormalShininess = vec4(normalize(Normal), surface.shininess);
+}
\ No newline at end of file
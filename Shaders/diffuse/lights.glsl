@@ -0,0 +1,51 @@
+// Shared light definitions. NR_POINT_LIGHTS and SPOT_LIGHT are normally injected by the shader preprocessor
+// to specialize a program for the scene; the defaults below match the classic 4 lamps + flashlight setup.
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 4
+#endif
+#ifndef SPOT_LIGHT
+#define SPOT_LIGHT 1
+#endif
+
+// The light structs are laid out as vec3 + float pairs so that std140 packs them without holes.
+// Keep them in sync with the C++ mirror in Utilities/LightBlock.h.
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    float constant;
+    vec3 direction;
+    float linear;
+    vec3 ambient;
+    float quadratic;
+    vec3 diffuse;
+    float cutOff;
+    vec3 specular;
+    float outerCutOff;
+};
+
+// all lighting state, uploaded once per frame by LightBlock and shared by every lit shader. The point lights come
+// last so that every NR_POINT_LIGHTS variant sees the same offsets in the one buffer.
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    SpotLight spotLight;
+#if NR_POINT_LIGHTS > 0
+    PointLight pointLights[NR_POINT_LIGHTS];
+#endif
+};
\ No newline at end of file
@@ -0,0 +1,16 @@
+// The container material, sampled the same way by the forward, clustered and G-buffer shaders.
+#include "surface.glsl"
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    float shininess;
+};
+
+uniform Material material;
+
+Surface SampleMaterial(vec2 texCoords)
+{
+    return Surface(vec3(texture(material.diffuse, texCoords)), vec3(texture(material.specular, texCoords)),
+                   material.shininess);
+}
\ No newline at end of file
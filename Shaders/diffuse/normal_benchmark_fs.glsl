@@ -0,0 +1,12 @@
+#version 330 core
+// reads every output of the vertex stage so the compiler cannot drop any of its work; --benchmark normals only
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(normalize(Normal) * 0.5 + 0.5 + FragPos * 0.001, TexCoords.x);
+}
\ No newline at end of file
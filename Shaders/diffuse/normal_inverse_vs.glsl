@@ -0,0 +1,24 @@
+#version 330 core
+#include "vertex.glsl"
+
+// diffuse_map_vs.glsl as it was before the normal matrix moved to the CPU; only --benchmark normals draws with it
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in ENCODED_NORMAL aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    FragPos = vec3(model * vec4(decodePosition(aPos), 1.0));
+    Normal = mat3(transpose(inverse(model))) * decodeNormal(aNormal);
+    TexCoords = aTexCoords;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
\ No newline at end of file
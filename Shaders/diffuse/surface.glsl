@@ -0,0 +1,7 @@
+// The surface a light shades, handed to the light math by every lit shader. Forward and clustered sample it from
+// the material, the deferred light pass reads it back from the G-buffer.
+struct Surface {
+    vec3 albedo;
+    vec3 specular;
+    float shininess;
+};
\ No newline at end of file
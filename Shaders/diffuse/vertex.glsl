@@ -0,0 +1,36 @@
+// The vertex attributes as VertexUtility::QuantizeMesh packed them. GL already turns normalized integers and half
+// floats into floats on fetch; the two encodings that need more are decoded here, both selected by the
+// preprocessor from the mesh's VertexLayout:
+// QUANTIZED_POSITIONS: snorm16 positions across the mesh bounds, position = positionOffset + positionScale * aPos
+// OCTAHEDRAL_NORMALS: the unit normal folded onto an octahedron and stored as two snorm16
+#ifdef QUANTIZED_POSITIONS
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+#endif
+
+#ifdef OCTAHEDRAL_NORMALS
+#define ENCODED_NORMAL vec2
+#else
+#define ENCODED_NORMAL vec3
+#endif
+
+vec3 decodePosition(vec3 position)
+{
+#ifdef QUANTIZED_POSITIONS
+    return positionOffset + positionScale * position;
+#else
+    return position;
+#endif
+}
+
+vec3 decodeNormal(ENCODED_NORMAL normal)
+{
+#ifdef OCTAHEDRAL_NORMALS
+    vec3 n = vec3(normal, 1.0 - abs(normal.x) - abs(normal.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+#else
+    return normal;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "Profiler.h"
+
+namespace {
+    constexpr uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+    constexpr float INFINITE = std::numeric_limits<float>::infinity();
+    // centroid bins per axis the split candidates are taken from
+    constexpr int BINS = 16;
+    // cost of visiting a node relative to testing one object
+    constexpr float TRAVERSAL_COST = 2.0f;
+
+    const BVH::Bounds EMPTY{glm::vec3(INFINITE), glm::vec3(-INFINITE)};
+
+    void grow(BVH::Bounds &bounds, const BVH::Bounds &other) {
+        bounds.min = glm::min(bounds.min, other.min);
+        bounds.max = glm::max(bounds.max, other.max);
+    }
+
+    float area(const BVH::Bounds &bounds) {
+        glm::vec3 size = bounds.max - bounds.min;
+        if (size.x < 0.0f)
+            return 0.0f;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    // false when the box is entirely behind one of the planes still in the mask; planes the box is entirely in front
+    // of are cleared from the mask
+    bool classify(const glm::vec3 &min, const glm::vec3 &max, const Frustum &frustum, uint32_t &planes) {
+        glm::vec3 center = (min + max) * 0.5f;
+        glm::vec3 halfSize = (max - min) * 0.5f;
+        for (uint32_t remaining = planes; remaining != 0; remaining &= remaining - 1) {
+            int p = std::countr_zero(remaining);
+            const glm::vec4 &plane = frustum.planes[p];
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float reach = glm::dot(glm::abs(glm::vec3(plane)), halfSize);
+            if (distance + reach < 0.0f)
+                return false;
+            if (distance - reach >= 0.0f) {
+                planes &= ~(1u << p);
+            }
+        }
+        return true;
+    }
+
+    // distance at which the ray enters the box, INFINITE when it misses
+    float slab(const glm::vec3 &min, const glm::vec3 &max, const glm::vec3 &origin, const glm::vec3 &inverseDirection) {
+        glm::vec3 t0 = (min - origin) * inverseDirection;
+        glm::vec3 t1 = (max - origin) * inverseDirection;
+        glm::vec3 entries = glm::min(t0, t1);
+        glm::vec3 exits = glm::max(t0, t1);
+        float enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+        float exit = std::min(std::min(exits.x, exits.y), exits.z);
+        return enter <= exit ? enter : INFINITE;
+    }
+}
+
+void BVH::build(std::span<const Bounds> objects) {
+    PROFILE_SCOPE("bvh build");
+    const auto start = std::chrono::steady_clock::now();
+    const auto count = static_cast<uint32_t>(objects.size());
+    nodes.clear();
+    parents.clear();
+    slotObjects.resize(count);
+    std::iota(slotObjects.begin(), slotObjects.end(), 0u);
+    objectLeaves.resize(count);
+
+    std::vector<glm::vec3> centroids(count);
+    for (uint32_t i = 0; i < count; i++) {
+        centroids[i] = (objects[i].min + objects[i].max) * 0.5f;
+    }
+    // a binary tree with at least one object per leaf has fewer than 2n nodes
+    nodes.reserve(2 * static_cast<size_t>(count));
+    parents.reserve(2 * static_cast<size_t>(count));
+    if (count > 0) {
+        buildNode(0, count, NO_PARENT, objects, centroids);
+    }
+
+    slotBounds.resize(count);
+    objectSlots.resize(count);
+    for (uint32_t slot = 0; slot < count; slot++) {
+        slotBounds[slot] = objects[slotObjects[slot]];
+        objectSlots[slotObjects[slot]] = slot;
+    }
+    counters.buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint32_t BVH::buildNode(uint32_t first, uint32_t count, uint32_t parent, std::span<const Bounds> objects,
+                        const std::vector<glm::vec3> &centroids) {
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({});
+    parents.push_back(parent);
+
+    Bounds bounds = EMPTY;
+    Bounds centroidBounds = EMPTY;
+    for (uint32_t slot = first; slot < first + count; slot++) {
+        uint32_t object = slotObjects[slot];
+        grow(bounds, objects[object]);
+        grow(centroidBounds, {centroids[object], centroids[object]});
+    }
+    nodes[index].min = bounds.min;
+    nodes[index].max = bounds.max;
+
+    // best binned split over all three axes
+    int bestAxis = -1;
+    int bestBin = 0;
+    float bestCost = INFINITE;
+    const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+    for (int axis = 0; axis < 3; axis++) {
+        if (extent[axis] <= 0.0f)
+            continue;
+        const float scale = BINS / extent[axis];
+        Bounds binBounds[BINS];
+        uint32_t binCounts[BINS] = {};
+        std::fill(std::begin(binBounds), std::end(binBounds), EMPTY);
+        for (uint32_t slot = first; slot < first + count; slot++) {
+            uint32_t object = slotObjects[slot];
+            int bin = std::min(BINS - 1, static_cast<int>((centroids[object][axis] - centroidBounds.min[axis]) * scale));
+            binCounts[bin]++;
+            grow(binBounds[bin], objects[object]);
+        }
+
+        // sweep from the right for the suffix areas, then from the left to score each plane between two bins
+        float rightAreas[BINS];
+        uint32_t rightCounts[BINS];
+        Bounds right = EMPTY;
+        uint32_t rightCount = 0;
+        for (int bin = BINS - 1; bin > 0; bin--) {
+            grow(right, binBounds[bin]);
+            rightCount += binCounts[bin];
+            rightAreas[bin] = area(right);
+            rightCounts[bin] = rightCount;
+        }
+        Bounds left = EMPTY;
+        uint32_t leftCount = 0;
+        for (int bin = 1; bin < BINS; bin++) {
+            grow(left, binBounds[bin - 1]);
+            leftCount += binCounts[bin - 1];
+            if (leftCount == 0 || rightCounts[bin] == 0)
+                continue;
+            float cost = area(left) * leftCount + rightAreas[bin] * rightCounts[bin];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = bin;
+            }
+        }
+    }
+
+    const float nodeArea = area(bounds);
+    const float leafCost = nodeArea * count;
+    const float splitCost = TRAVERSAL_COST * nodeArea + bestCost;
+    if (count <= MAX_LEAF_SIZE && (bestAxis < 0 || leafCost <= splitCost)) {
+        nodes[index].offset = first;
+        nodes[index].count = count;
+        for (uint32_t slot = first; slot < first + count; slot++) {
+            objectLeaves[slotObjects[slot]] = index;
+        }
+        return index;
+    }
+
+    uint32_t leftCount = count / 2;
+    if (bestAxis >= 0) {
+        const float scale = BINS / extent[bestAxis];
+        const float origin = centroidBounds.min[bestAxis];
+        auto middle = std::partition(slotObjects.begin() + first, slotObjects.begin() + first + count,
+                                     [&](uint32_t object) {
+                                         int bin = std::min(BINS - 1, static_cast<int>(
+                                                                (centroids[object][bestAxis] - origin) * scale));
+                                         return bin < bestBin;
+                                     });
+        leftCount = static_cast<uint32_t>(middle - (slotObjects.begin() + first));
+    }
+    // with all centroids in one spot no plane separates anything; halving the slots still bounds the depth
+
+    buildNode(first, leftCount, index, objects, centroids);
+    uint32_t rightChild = buildNode(first + leftCount, count - leftCount, index, objects, centroids);
+    nodes[index].offset = rightChild;
+    nodes[index].count = 0;
+    return index;
+}
+
+bool BVH::fit(uint32_t index) {
+    Node &node = nodes[index];
+    Bounds bounds = EMPTY;
+    if (node.count > 0) {
+        for (uint32_t slot = node.offset; slot < node.offset + node.count; slot++) {
+            grow(bounds, slotBounds[slot]);
+        }
+    } else {
+        grow(bounds, {nodes[index + 1].min, nodes[index + 1].max});
+        grow(bounds, {nodes[node.offset].min, nodes[node.offset].max});
+    }
+    if (bounds.min == node.min && bounds.max == node.max)
+        return false;
+    node.min = bounds.min;
+    node.max = bounds.max;
+    return true;
+}
+
+void BVH::move(uint32_t object, const Bounds &bounds) {
+    slotBounds[objectSlots[object]] = bounds;
+    for (uint32_t node = objectLeaves[object]; node != NO_PARENT; node = parents[node]) {
+        ++counters.refitNodes;
+        if (!fit(node))
+            break;
+    }
+}
+
+void BVH::refit(std::span<const Bounds> objects) {
+    for (uint32_t slot = 0; slot < slotBounds.size(); slot++) {
+        slotBounds[slot] = objects[slotObjects[slot]];
+    }
+    // children always come after their parent
+    for (size_t node = nodes.size(); node > 0; node--) {
+        fit(static_cast<uint32_t>(node - 1));
+    }
+}
+
+void BVH::cull(const Frustum &frustum, std::vector<uint32_t> &visible) {
+    PROFILE_SCOPE("bvh culling");
+    visible.clear();
+    ++counters.culls;
+    if (nodes.empty())
+        return;
+
+    // each entry is a node index and, in the upper 6 bits, the planes its parent was not entirely in front of;
+    // 2^26 nodes are enough for 2^25 objects
+    constexpr uint32_t ALL_PLANES = 0x3f;
+    stack.clear();
+    stack.push_back(ALL_PLANES << 26);
+    uint64_t visited = 0;
+    while (!stack.empty()) {
+        uint32_t entry = stack.back();
+        stack.pop_back();
+        uint32_t index = entry & ((1u << 26) - 1);
+        uint32_t planes = entry >> 26;
+        const Node &node = nodes[index];
+        ++visited;
+        if (planes != 0 && !classify(node.min, node.max, frustum, planes))
+            continue;
+
+        if (node.count == 0) {
+            stack.push_back(node.offset | planes << 26);
+            stack.push_back((index + 1) | planes << 26);
+            continue;
+        }
+        for (uint32_t slot = node.offset; slot < node.offset + node.count; slot++) {
+            uint32_t objectPlanes = planes;
+            if (objectPlanes == 0 || classify(slotBounds[slot].min, slotBounds[slot].max, frustum, objectPlanes)) {
+                visible.push_back(slotObjects[slot]);
+            }
+        }
+    }
+    counters.cullNodes += visited;
+}
+
+bool BVH::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, Hit &hit) {
+    ++counters.rays;
+    if (nodes.empty())
+        return false;
+
+    const glm::vec3 inverseDirection = 1.0f / direction;
+    float best = maxDistance;
+    bool found = false;
+    uint64_t visited = 0;
+    stack.clear();
+    if (slab(nodes[0].min, nodes[0].max, origin, inverseDirection) <= best) {
+        stack.push_back(0);
+    }
+    while (!stack.empty()) {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+        ++visited;
+        // a closer hit may have been found since this node was pushed
+        if (slab(node.min, node.max, origin, inverseDirection) > best)
+            continue;
+
+        if (node.count > 0) {
+            for (uint32_t slot = node.offset; slot < node.offset + node.count; slot++) {
+                float distance = slab(slotBounds[slot].min, slotBounds[slot].max, origin, inverseDirection);
+                if (distance <= best) {
+                    best = distance;
+                    hit = {slotObjects[slot], distance};
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        // visit the nearer child first, so its hits prune the farther one
+        uint32_t closer = static_cast<uint32_t>(&node - nodes.data()) + 1;
+        uint32_t farther = node.offset;
+        float closerDistance = slab(nodes[closer].min, nodes[closer].max, origin, inverseDirection);
+        float fartherDistance = slab(nodes[farther].min, nodes[farther].max, origin, inverseDirection);
+        if (fartherDistance < closerDistance) {
+            std::swap(closer, farther);
+            std::swap(closerDistance, fartherDistance);
+        }
+        if (fartherDistance <= best) {
+            stack.push_back(farther);
+        }
+        if (closerDistance <= best) {
+            stack.push_back(closer);
+        }
+    }
+    counters.rayNodes += visited;
+    return found;
+}
+
+void BVH::Stats::print(std::ostream &out, size_t objects, size_t nodes) const {
+    out << "BVH: " << objects << " objects, " << nodes << " nodes, built in " << buildSeconds * 1000.0 << " ms";
+    if (culls > 0) {
+        out << ", " << static_cast<double>(cullNodes) / culls << " nodes visited per cull";
+    }
+    if (rays > 0) {
+        out << ", " << static_cast<double>(rayNodes) / rays << " per ray";
+    }
+    out << std::endl;
+}
@@ -0,0 +1,95 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+
+// A bounding volume hierarchy over axis aligned object bounds, for culling and picking in scenes too large for a flat
+// list. build() splits by the surface area heuristic over binned centroids and stores the nodes depth first in one
+// array: a node's left child directly follows it and only the right child's index is kept, so traversals mostly walk
+// forward through memory. Moving objects are refit in place, from their leaf up, without changing the topology; after
+// many large moves the splits get worse and a rebuild restores them.
+class BVH {
+public:
+    static constexpr unsigned int MAX_LEAF_SIZE = 4;
+
+    struct Bounds {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    struct Hit {
+        uint32_t object;
+        float distance; // along the ray to where it enters the object's bounds, 0 when it starts inside
+    };
+
+    struct Stats {
+        double buildSeconds = 0.0;
+        uint64_t culls = 0;
+        uint64_t cullNodes = 0; // nodes visited, summed over all culls
+        uint64_t rays = 0;
+        uint64_t rayNodes = 0; // nodes visited, summed over all rays
+        uint64_t refitNodes = 0; // nodes refit by move()
+
+        void print(std::ostream &out, size_t objects, size_t nodes) const;
+    };
+
+    // replace the objects and build a new tree; object indices are positions in this span
+    void build(std::span<const Bounds> objects);
+
+    // give one object new bounds and refit the nodes above it, stopping at the first that does not change
+    void move(uint32_t object, const Bounds &bounds);
+
+    // give every object new bounds and refit the whole tree
+    void refit(std::span<const Bounds> objects);
+
+    // indices of the objects whose bounds are inside or crossing the frustum, in tree order. Nodes entirely in front
+    // of a plane skip it for their whole subtree.
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible);
+
+    // the object whose bounds the ray enters first, within maxDistance; direction need not be normalized, distances
+    // are in units of its length
+    bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, Hit &hit);
+
+    size_t size() const { return slotObjects.size(); }
+
+    size_t nodeCount() const { return nodes.size(); }
+
+    const Stats &stats() const { return counters; }
+
+    void printStats(std::ostream &out) const { counters.print(out, size(), nodeCount()); }
+
+private:
+    struct alignas(32) Node {
+        glm::vec3 min;
+        uint32_t offset; // leaf: first slot; inner node: index of the right child, the left one follows the node
+        glm::vec3 max;
+        uint32_t count; // objects in a leaf, 0 for inner nodes
+    };
+
+    static_assert(sizeof(Node) == 32, "two nodes per cache line");
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> parents;
+    // objects in leaf order: a leaf owns the slots offset .. offset + count - 1
+    std::vector<Bounds> slotBounds;
+    std::vector<uint32_t> slotObjects;
+    std::vector<uint32_t> objectSlots;
+    std::vector<uint32_t> objectLeaves;
+    std::vector<uint32_t> stack; // traversal scratch
+    Stats counters;
+
+    uint32_t buildNode(uint32_t first, uint32_t count, uint32_t parent, std::span<const Bounds> objects,
+                       const std::vector<glm::vec3> &centroids);
+
+    // recompute a node's bounds from its slots or children; false when they did not change
+    bool fit(uint32_t node);
+};
+
+#endif //BVH_H
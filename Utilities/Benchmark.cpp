@@ -0,0 +1,760 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "BVH.h"
+#include "FrustumCuller.h"
+#include "GLStateCache.h"
+#include "JobSystem.h"
+#include "ModelImporter.h"
+#include "Shader.h"
+#include "TransformStore.h"
+#include "TransformUtility.h"
+#include "VertexUtility.h"
+
+#ifdef HAVE_EGL
+#include "HeadlessContext.h"
+#endif
+
+namespace {
+    double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // boxes of 0.5 to 1.5 units scattered with the density of the demo scene
+    std::vector<BVH::Bounds> randomBoxes(size_t count, std::mt19937 &rng) {
+        float extent = 15.0f * std::cbrt(std::max(1.0f, count / 10.0f));
+        std::uniform_real_distribution<float> position(-extent, extent);
+        std::uniform_real_distribution<float> size(0.25f, 0.75f);
+        std::vector<BVH::Bounds> boxes(count);
+        for (BVH::Bounds &box: boxes) {
+            glm::vec3 center(position(rng), position(rng), position(rng));
+            glm::vec3 halfSize(size(rng), size(rng), size(rng));
+            box = {center - halfSize, center + halfSize};
+        }
+        return boxes;
+    }
+
+    // the demo camera's projection, looking from the middle of the scene in a random direction
+    Frustum randomFrustum(std::mt19937 &rng) {
+        std::uniform_real_distribution<float> angle(-180.0f, 180.0f);
+        std::uniform_real_distribution<float> pitch(-60.0f, 60.0f);
+        Camera camera(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), angle(rng), pitch(rng));
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+        return Camera::ExtractFrustum(projection * camera.GetViewMatrix());
+    }
+
+    glm::quat randomRotation(std::mt19937 &rng) {
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        return glm::angleAxis(unit(rng) * 3.14159265f,
+                              glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(1e-3f)));
+    }
+
+    // one transform in eight is a root, the others hang below one of the 64 created before them, up to 4 levels deep
+    void randomHierarchy(TransformStore &store, size_t count, std::mt19937 &rng) {
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        store.reserve(count);
+        std::vector<int> depths(count, 0);
+        for (size_t i = 0; i < count; i++) {
+            TransformStore::Handle parent = TransformStore::NO_PARENT;
+            if (i > 0 && rng() % 8 != 0) {
+                parent = static_cast<TransformStore::Handle>(i - 1 - rng() % std::min<size_t>(i, 64));
+                if (depths[parent] == 3) {
+                    parent = TransformStore::NO_PARENT;
+                } else {
+                    depths[i] = depths[parent] + 1;
+                }
+            }
+            store.create(glm::vec3(unit(rng), unit(rng), unit(rng)) * 10.0f, randomRotation(rng),
+                         glm::vec3(1.0f + 0.1f * unit(rng)), parent);
+        }
+    }
+
+    // the first box along the ray, by testing every one
+    float bruteForceRay(const std::vector<BVH::Bounds> &boxes, const glm::vec3 &origin, const glm::vec3 &direction) {
+        float best = std::numeric_limits<float>::infinity();
+        // the same arithmetic as the BVH's slab test, so the distances compare exactly
+        const glm::vec3 inverseDirection = 1.0f / direction;
+        for (const BVH::Bounds &box: boxes) {
+            glm::vec3 t0 = (box.min - origin) * inverseDirection;
+            glm::vec3 t1 = (box.max - origin) * inverseDirection;
+            glm::vec3 entries = glm::min(t0, t1);
+            glm::vec3 exits = glm::max(t0, t1);
+            float enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+            float exit = std::min(std::min(exits.x, exits.y), exits.z);
+            if (enter <= exit) {
+                best = std::min(best, enter);
+            }
+        }
+        return best;
+    }
+
+    // position, normal and texture coordinates, like the cube
+    constexpr unsigned int MESH_STRIDE = 8;
+
+    void addMeshVertex(std::vector<float> &vertices, const glm::vec3 &position, const glm::vec3 &normal,
+                       const glm::vec2 &uv) {
+        vertices.insert(vertices.end(), {position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y});
+    }
+
+    // size * size quads as an unindexed triangle list, the triangles in random order like a careless exporter's
+    std::vector<float> shuffledGrid(unsigned int size, std::mt19937 &rng) {
+        std::vector<std::array<glm::vec2, 3> > triangles;
+        for (unsigned int y = 0; y < size; y++) {
+            for (unsigned int x = 0; x < size; x++) {
+                const glm::vec2 corner(x, y);
+                triangles.push_back({corner, corner + glm::vec2(1, 0), corner + glm::vec2(1, 1)});
+                triangles.push_back({corner, corner + glm::vec2(1, 1), corner + glm::vec2(0, 1)});
+            }
+        }
+        std::shuffle(triangles.begin(), triangles.end(), rng);
+        std::vector<float> vertices;
+        vertices.reserve(triangles.size() * 3 * MESH_STRIDE);
+        for (const auto &triangle: triangles) {
+            for (const glm::vec2 &point: triangle) {
+                addMeshVertex(vertices, glm::vec3(point.x, 0.0f, point.y), glm::vec3(0, 1, 0), point / float(size));
+            }
+        }
+        return vertices;
+    }
+
+    // a UV sphere as an unindexed triangle list, ring by ring
+    std::vector<float> sphere(unsigned int rings, unsigned int segments) {
+        auto point = [&](unsigned int ring, unsigned int segment) {
+            const float theta = glm::pi<float>() * ring / rings;
+            const float phi = glm::two_pi<float>() * segment / segments;
+            return glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+        };
+        std::vector<float> vertices;
+        auto add = [&](unsigned int ring, unsigned int segment) {
+            const glm::vec3 p = point(ring, segment);
+            addMeshVertex(vertices, p, p, glm::vec2(float(segment) / segments, float(ring) / rings));
+        };
+        for (unsigned int ring = 0; ring < rings; ring++) {
+            for (unsigned int segment = 0; segment < segments; segment++) {
+                if (ring > 0) {
+                    add(ring, segment);
+                    add(ring, segment + 1);
+                    add(ring + 1, segment + 1);
+                }
+                if (ring + 1 < rings) {
+                    add(ring, segment);
+                    add(ring + 1, segment + 1);
+                    add(ring + 1, segment);
+                }
+            }
+        }
+        return vertices;
+    }
+
+    // a wavy grid of quads as an OBJ file, the way exporters write one: every element on its own line with six
+    // decimals. Every other row of faces uses negative indices and the material changes every 16 rows.
+    std::string wavyGridObj(int rows, int columns) {
+        std::string obj;
+        char line[128];
+        auto append = [&](int length) { obj.append(line, static_cast<size_t>(length)); };
+        for (int r = 0; r <= rows; r++) {
+            for (int c = 0; c <= columns; c++) {
+                const float x = c * 0.1f, z = r * 0.1f;
+                append(std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", x, 0.2f * std::sin(x) * std::cos(z), z));
+            }
+        }
+        for (int r = 0; r <= rows; r++) {
+            for (int c = 0; c <= columns; c++) {
+                append(std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", float(c) / columns, float(r) / rows));
+            }
+        }
+        for (int r = 0; r <= rows; r++) {
+            for (int c = 0; c <= columns; c++) {
+                const float x = c * 0.1f, z = r * 0.1f;
+                const glm::vec3 normal = glm::normalize(glm::vec3(-0.2f * std::cos(x) * std::cos(z), 1.0f,
+                                                                  0.2f * std::sin(x) * std::sin(z)));
+                append(std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", normal.x, normal.y, normal.z));
+            }
+        }
+        const int count = (rows + 1) * (columns + 1);
+        for (int r = 0; r < rows; r++) {
+            if (r % 16 == 0) {
+                append(std::snprintf(line, sizeof(line), "usemtl band%d\n", r / 16 % 2));
+            }
+            const int base = r % 2 == 0 ? 1 : -count;
+            for (int c = 0; c < columns; c++) {
+                const int a = base + r * (columns + 1) + c, b = a + 1, d = a + columns + 1, e = d + 1;
+                append(std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, d, d, d,
+                                     e, e, e, b, b, b));
+            }
+        }
+        return obj;
+    }
+
+    // the triangles of a mesh as sorted vertex data, to check that optimising only changed their order
+    std::vector<std::vector<float> > sortedTriangles(const IndexedMesh &mesh) {
+        std::vector<std::vector<float> > triangles(mesh.indices.size() / 3);
+        for (size_t t = 0; t < triangles.size(); t++) {
+            for (int k = 0; k < 3; k++) {
+                const float *vertex = &mesh.vertices[mesh.indices[t * 3 + k] * mesh.stride];
+                triangles[t].insert(triangles[t].end(), vertex, vertex + mesh.stride);
+            }
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+}
+
+bool Benchmark::run(const std::string &name, std::ostream &out) {
+    if (name == "bvh") {
+        bvh(out);
+        return true;
+    }
+    if (name == "transforms") {
+        transforms(out);
+        return true;
+    }
+    if (name == "jobs") {
+        jobs(out);
+        return true;
+    }
+    if (name == "mesh") {
+        mesh(out);
+        return true;
+    }
+    if (name == "normals") {
+        normals(out);
+        return true;
+    }
+    if (name == "import") {
+        modelImport(out);
+        return true;
+    }
+    std::cerr << "Unknown benchmark: " << name << ", expected bvh, transforms, jobs, mesh, normals or import\n";
+    return false;
+}
+
+void Benchmark::bvh(std::ostream &out) {
+    constexpr int FRUSTUMS = 64;
+    constexpr int RAYS = 10000;
+    constexpr int CHECKED_RAYS = 100;
+
+    for (size_t count: {size_t(10000), size_t(100000), size_t(1000000)}) {
+        std::mt19937 rng(42);
+        std::vector<BVH::Bounds> boxes = randomBoxes(count, rng);
+        out << count << " objects" << std::endl;
+
+        BVH bvh;
+        bvh.build(boxes);
+        out << "  build: " << bvh.stats().buildSeconds * 1000.0 << " ms, " << bvh.nodeCount() << " nodes"
+            << std::endl;
+
+        // frustum culling, hierarchical against flat; both must report the same objects
+        std::vector<glm::vec3> centers(count);
+        std::vector<glm::vec3> halfSizes(count);
+        for (size_t i = 0; i < count; i++) {
+            centers[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+            halfSizes[i] = (boxes[i].max - boxes[i].min) * 0.5f;
+        }
+        FrustumCuller flat;
+        flat.setBoxes(centers, halfSizes);
+        std::vector<Frustum> frustums;
+        for (int i = 0; i < FRUSTUMS; i++) {
+            frustums.push_back(randomFrustum(rng));
+        }
+        std::vector<uint32_t> visible;
+        std::vector<uint32_t> reference;
+        size_t visibleTotal = 0;
+        double bvhMilliseconds = 0.0;
+        double flatMilliseconds = 0.0;
+        bool mismatch = false;
+        for (const Frustum &frustum: frustums) {
+            auto start = std::chrono::steady_clock::now();
+            bvh.cull(frustum, visible);
+            bvhMilliseconds += millisecondsSince(start);
+            start = std::chrono::steady_clock::now();
+            flat.cull(frustum, reference);
+            flatMilliseconds += millisecondsSince(start);
+            visibleTotal += visible.size();
+            std::sort(visible.begin(), visible.end());
+            mismatch |= visible != reference;
+        }
+        out << "  frustum cull: " << bvhMilliseconds / FRUSTUMS << " ms (flat " << flatMilliseconds / FRUSTUMS
+            << " ms), " << visibleTotal / FRUSTUMS << " visible, "
+            << static_cast<double>(bvh.stats().cullNodes) / bvh.stats().culls << " nodes visited" << std::endl;
+        if (mismatch) {
+            out << "ERROR::BENCHMARK::BVH_CULL_MISMATCH" << std::endl;
+        }
+
+        // picking rays from inside the scene in random directions
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::vector<glm::vec3> origins(RAYS);
+        std::vector<glm::vec3> directions(RAYS);
+        for (int i = 0; i < RAYS; i++) {
+            origins[i] = centers[rng() % count] + glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f;
+            directions[i] = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(1e-3f));
+        }
+        int hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < RAYS; i++) {
+            BVH::Hit hit{};
+            hits += bvh.raycast(origins[i], directions[i], 100.0f, hit);
+        }
+        double rayMilliseconds = millisecondsSince(start);
+        out << "  ray query: " << rayMilliseconds * 1000.0 / RAYS << " us, " << hits << " of " << RAYS << " hit, "
+            << static_cast<double>(bvh.stats().rayNodes) / bvh.stats().rays << " nodes visited" << std::endl;
+        for (int i = 0; i < CHECKED_RAYS; i++) {
+            BVH::Hit hit{};
+            float expected = bruteForceRay(boxes, origins[i], directions[i]);
+            float found = bvh.raycast(origins[i], directions[i], std::numeric_limits<float>::infinity(), hit)
+                              ? hit.distance
+                              : std::numeric_limits<float>::infinity();
+            if (found != expected) {
+                out << "ERROR::BENCHMARK::BVH_RAY_MISMATCH " << found << " != " << expected << std::endl;
+                break;
+            }
+        }
+
+        // 1% of the objects drift a little: refit them one by one, then refit everything at once
+        std::uniform_int_distribution<size_t> pick(0, count - 1);
+        std::vector<uint32_t> moved(count / 100);
+        for (uint32_t &object: moved) {
+            object = static_cast<uint32_t>(pick(rng));
+            glm::vec3 offset(unit(rng), unit(rng), unit(rng));
+            boxes[object].min += offset;
+            boxes[object].max += offset;
+        }
+        start = std::chrono::steady_clock::now();
+        for (uint32_t object: moved) {
+            bvh.move(object, boxes[object]);
+        }
+        double moveMilliseconds = millisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        bvh.refit(boxes);
+        out << "  refit: " << moved.size() << " moves in " << moveMilliseconds << " ms ("
+            << static_cast<double>(bvh.stats().refitNodes) / moved.size() << " nodes each), full refit "
+            << millisecondsSince(start) << " ms" << std::endl;
+    }
+}
+
+void Benchmark::transforms(std::ostream &out) {
+    constexpr int FRAMES = 20;
+
+    for (size_t count: {size_t(10000), size_t(100000)}) {
+        std::mt19937 rng(42);
+        TransformStore store;
+        randomHierarchy(store, count, rng);
+        out << count << " transforms" << std::endl;
+        store.update();
+
+        std::vector<glm::quat> rotations(count);
+        for (glm::quat &rotation: rotations) {
+            rotation = randomRotation(rng);
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < FRAMES; frame++) {
+            for (size_t i = 0; i < count; i++) {
+                store.setRotation(static_cast<TransformStore::Handle>(i), rotations[(i + frame) % count]);
+            }
+            store.update();
+        }
+        out << "  all changed, set and update: " << millisecondsSince(start) / FRAMES << " ms per frame" << std::endl;
+
+        size_t recomputed = 0;
+        double updateMilliseconds = 0.0;
+        for (int frame = 0; frame < FRAMES; frame++) {
+            for (size_t i = 0; i < count / 10; i++) {
+                store.setRotation(static_cast<TransformStore::Handle>(rng() % count), rotations[i]);
+            }
+            start = std::chrono::steady_clock::now();
+            recomputed += store.update();
+            updateMilliseconds += millisecondsSince(start);
+        }
+        out << "  10% changed: " << updateMilliseconds / FRAMES << " ms per frame, " << recomputed / FRAMES
+            << " recomputed with their descendants" << std::endl;
+
+        // what rebuilding every matrix with glm costs, and a check that the store agrees with it
+        std::vector<glm::mat4> reference(count);
+        start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < FRAMES; frame++) {
+            for (size_t i = 0; i < count; i++) {
+                auto transform = static_cast<TransformStore::Handle>(i);
+                glm::mat4 local = glm::translate(glm::mat4(1.0f), store.position(transform)) *
+                                  glm::mat4_cast(store.rotation(transform)) *
+                                  glm::scale(glm::mat4(1.0f), store.scale(transform));
+                TransformStore::Handle parent = store.parent(transform);
+                reference[i] = parent == TransformStore::NO_PARENT ? local : reference[parent] * local;
+            }
+        }
+        out << "  scalar glm rebuild: " << millisecondsSince(start) / FRAMES << " ms per frame" << std::endl;
+
+        float largest = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            for (int column = 0; column < 4; column++) {
+                glm::vec4 difference = glm::abs(store.worldMatrices()[i][column] - reference[i][column]);
+                largest = std::max(largest, std::max(std::max(difference.x, difference.y),
+                                                     std::max(difference.z, difference.w)));
+            }
+        }
+        if (largest > 1e-3f) {
+            out << "ERROR::BENCHMARK::TRANSFORM_MISMATCH " << largest << std::endl;
+        }
+    }
+}
+
+void Benchmark::jobs(std::ostream &out) {
+    constexpr size_t TRANSFORMS = 100000;
+    constexpr size_t BOXES = 1000000;
+    constexpr int FRAMES = 20;
+    constexpr int FRUSTUMS = 64;
+    constexpr size_t EMPTY_JOBS = 4096;
+
+    std::mt19937 rng(42);
+    TransformStore store;
+    randomHierarchy(store, TRANSFORMS, rng);
+    std::vector<glm::quat> rotations(TRANSFORMS);
+    for (glm::quat &rotation: rotations) {
+        rotation = randomRotation(rng);
+    }
+    std::vector<BVH::Bounds> boxes = randomBoxes(BOXES, rng);
+    std::vector<glm::vec3> centers(BOXES);
+    std::vector<glm::vec3> halfSizes(BOXES);
+    for (size_t i = 0; i < BOXES; i++) {
+        centers[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+        halfSizes[i] = (boxes[i].max - boxes[i].min) * 0.5f;
+    }
+    FrustumCuller culler;
+    culler.setBoxes(centers, halfSizes);
+    std::vector<Frustum> frustums;
+    for (int i = 0; i < FRUSTUMS; i++) {
+        frustums.push_back(randomFrustum(rng));
+    }
+
+    // single threaded references
+    for (int frame = 0; frame < FRAMES; frame++) {
+        for (size_t i = 0; i < TRANSFORMS; i++) {
+            store.setRotation(static_cast<TransformStore::Handle>(i), rotations[(i + frame) % TRANSFORMS]);
+        }
+        store.update();
+    }
+    const std::vector<glm::mat4> referenceWorld(store.worldMatrices().begin(), store.worldMatrices().end());
+    std::vector<std::vector<uint32_t> > referenceVisible(FRUSTUMS);
+    for (int i = 0; i < FRUSTUMS; i++) {
+        culler.cull(frustums[i], referenceVisible[i]);
+    }
+
+    // 0 workers is the GL thread alone; past the cores the workers only compete for them
+    std::vector<unsigned int> workerCounts{0};
+    const unsigned int maxWorkers = std::max(1u, JobSystem::defaultWorkers());
+    for (unsigned int workers = 1; workers <= maxWorkers; workers = workers * 2 + 1) {
+        workerCounts.push_back(workers);
+    }
+    if (workerCounts.back() != maxWorkers) {
+        workerCounts.push_back(maxWorkers);
+    }
+    out << TRANSFORMS << " transforms, " << BOXES << " boxes, " << std::thread::hardware_concurrency() << " cores"
+        << std::endl;
+
+    double serialTransforms = 0.0;
+    double serialCull = 0.0;
+    for (unsigned int workers: workerCounts) {
+        JobSystem jobs(workers);
+
+        double transformMilliseconds = 0.0;
+        for (int frame = 0; frame < FRAMES; frame++) {
+            for (size_t i = 0; i < TRANSFORMS; i++) {
+                store.setRotation(static_cast<TransformStore::Handle>(i), rotations[(i + frame) % TRANSFORMS]);
+            }
+            const auto start = std::chrono::steady_clock::now();
+            store.update(&jobs);
+            transformMilliseconds += millisecondsSince(start);
+        }
+        transformMilliseconds /= FRAMES;
+        // the same arithmetic in the same order per matrix, so the results match to the bit
+        if (std::memcmp(store.worldMatrices().data(), referenceWorld.data(), TRANSFORMS * sizeof(glm::mat4)) != 0) {
+            out << "ERROR::BENCHMARK::PARALLEL_TRANSFORM_MISMATCH " << workers << " workers" << std::endl;
+        }
+
+        std::vector<uint32_t> visible;
+        bool mismatch = false;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < FRUSTUMS; i++) {
+            culler.cull(frustums[i], visible, &jobs);
+            mismatch |= visible != referenceVisible[i];
+        }
+        const double cullMilliseconds = millisecondsSince(start) / FRUSTUMS;
+        if (mismatch) {
+            out << "ERROR::BENCHMARK::PARALLEL_CULL_MISMATCH " << workers << " workers" << std::endl;
+        }
+
+        // scheduling overhead: jobs that do next to nothing
+        std::vector<uint32_t> touched(EMPTY_JOBS);
+        start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < FRAMES; frame++) {
+            jobs.parallelFor(EMPTY_JOBS, 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    touched[i]++;
+                }
+            });
+        }
+        const double emptyMilliseconds = millisecondsSince(start) / FRAMES;
+
+        if (workers == 0) {
+            serialTransforms = transformMilliseconds;
+            serialCull = cullMilliseconds;
+        }
+        out << "  " << jobs.threadCount() << " threads: transform update " << transformMilliseconds << " ms (x"
+            << serialTransforms / transformMilliseconds << "), cull " << cullMilliseconds << " ms (x"
+            << serialCull / cullMilliseconds << "), parallelFor of " << EMPTY_JOBS << " items "
+            << emptyMilliseconds * 1000.0 << " us" << std::endl;
+        out << "    ";
+        jobs.stats().print(out);
+    }
+}
+
+void Benchmark::mesh(std::ostream &out) {
+    std::mt19937 rng(42);
+    struct Input {
+        const char *name;
+        std::vector<float> vertices;
+    };
+    Input inputs[] = {
+        {"grid 256x256, shuffled", shuffledGrid(256, rng)},
+        {"sphere 256x512", sphere(256, 512)},
+    };
+    auto cacheStats = [&](const IndexedMesh &mesh) {
+        for (unsigned int cacheSize: {16u, 32u}) {
+            const VertexCacheStats stats = VertexUtility::AnalyzeVertexCache(mesh.indices, mesh.vertexCount(),
+                                                                             cacheSize);
+            out << (cacheSize == 16 ? "ACMR/ATVR" : ",") << " " << cacheSize << " entries " << stats.ACMR() << " / "
+                << stats.ATVR();
+        }
+        out << std::endl;
+    };
+    for (const Input &input: inputs) {
+        const size_t vertexCount = input.vertices.size() / MESH_STRIDE;
+        out << input.name << ": " << vertexCount / 3 << " triangles" << std::endl;
+
+        auto start = std::chrono::steady_clock::now();
+        IndexedMesh mesh = VertexUtility::WeldVertices(input.vertices, MESH_STRIDE);
+        out << "  weld: " << millisecondsSince(start) << " ms, " << vertexCount << " -> " << mesh.vertexCount()
+            << " vertices" << std::endl;
+        out << "  input order: ";
+        cacheStats(mesh);
+        const std::vector<std::vector<float> > reference = sortedTriangles(mesh);
+
+        start = std::chrono::steady_clock::now();
+        VertexUtility::OptimizeVertexCache(mesh.indices, mesh.vertexCount());
+        out << "  vertex cache order: " << millisecondsSince(start) << " ms, ";
+        cacheStats(mesh);
+
+        start = std::chrono::steady_clock::now();
+        VertexUtility::OptimizeVertexFetch(mesh);
+        out << "  vertex fetch order: " << millisecondsSince(start) << " ms" << std::endl;
+
+        if (sortedTriangles(mesh) != reference) {
+            out << "ERROR::BENCHMARK::MESH_TRIANGLES_CHANGED " << input.name << std::endl;
+        }
+
+        const std::pair<const char *, VertexEncoding> encodings[] = {
+            {"compact", VertexEncoding::compact()},
+            {"quantized", VertexEncoding::quantized()},
+        };
+        for (const auto &[encodingName, encoding]: encodings) {
+            start = std::chrono::steady_clock::now();
+            const QuantizedMesh packed = VertexUtility::QuantizeMesh(mesh, encoding);
+            out << "  " << encodingName << ": " << millisecondsSince(start) << " ms, " << MESH_STRIDE * sizeof(float)
+                << " -> " << packed.layout.stride() << " bytes a vertex, error " << packed.maxPositionError
+                << " / " << packed.maxNormalError << " rad" << std::endl;
+        }
+    }
+}
+
+void Benchmark::normals(std::ostream &out) {
+    constexpr size_t MATRICES = 1000000;
+    constexpr unsigned int DRAWS = 16;
+    constexpr int FRAMES = 10;
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+    std::vector<glm::mat4> models(MATRICES);
+    for (glm::mat4 &model: models) {
+        model = glm::scale(glm::mat4_cast(randomRotation(rng)), glm::vec3(scale(rng), scale(rng), scale(rng)));
+    }
+    std::vector<glm::mat3> batch(MATRICES), scalar(MATRICES);
+    auto start = std::chrono::steady_clock::now();
+    TransformUtility::NormalMatrices(models, batch);
+    const double batchMilliseconds = millisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < MATRICES; i++) {
+        scalar[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+    }
+    const double scalarMilliseconds = millisecondsSince(start);
+    float maxError = 0.0f;
+    for (size_t i = 0; i < MATRICES; i++) {
+        for (int c = 0; c < 3; c++) {
+            const glm::vec3 difference = glm::abs(batch[i][c] - scalar[i][c]);
+            maxError = std::max({maxError, difference.x, difference.y, difference.z});
+        }
+    }
+    out << MATRICES << " normal matrices: NormalMatrices " << batchMilliseconds << " ms, glm transpose(inverse()) "
+        << scalarMilliseconds << " ms, largest difference " << maxError << std::endl;
+    if (maxError > 1e-4f) {
+        out << "ERROR::BENCHMARK::NORMAL_MATRIX_MISMATCH " << maxError << std::endl;
+    }
+
+#ifdef HAVE_EGL
+    // a tiny framebuffer, so hardly any fragments are shaded and the draws time the vertex stage
+    HeadlessContext context(16, 16);
+    if (!context.valid())
+        return;
+    const IndexedMesh indexed = VertexUtility::OptimizeMesh(sphere(256, 512), MESH_STRIDE);
+    const QuantizedMesh mesh = VertexUtility::QuantizeMesh(indexed, VertexEncoding::full());
+    const TriangleBuffers buffers = VertexUtility::CreateMesh(mesh);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 4.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+    out << "sphere 256x512: " << mesh.vertexCount() << " vertices, " << mesh.indices.size() / 3 << " triangles, "
+        << DRAWS << " draws a frame" << std::endl;
+
+    double milliseconds[2] = {};
+    const char *vertexShaders[] = {
+        "../Shaders/diffuse/normal_inverse_vs.glsl",
+        "../Shaders/diffuse/diffuse_map_vs.glsl"
+    };
+    for (int variant = 0; variant < 2; variant++) {
+        Shader shader(vertexShaders[variant], "../Shaders/diffuse/normal_benchmark_fs.glsl");
+        const UniformHandle model = shader.uniform("model");
+        const UniformHandle normalMatrix = shader.uniform("normalMatrix");
+        shader.use();
+        shader.setMat4(shader.uniform("view"), view);
+        shader.setMat4(shader.uniform("projection"), projection);
+        glState.bindVertexArray(buffers.VAO);
+        // the first frame compiles the shader variant in the driver and is not counted
+        for (int frame = -1; frame < FRAMES; frame++) {
+            if (frame == 0) {
+                start = std::chrono::steady_clock::now();
+            }
+            for (unsigned int draw = 0; draw < DRAWS; draw++) {
+                shader.setMat4(model, models[draw]);
+                if (normalMatrix.valid()) {
+                    shader.setMat3(normalMatrix, batch[draw]);
+                }
+                glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, nullptr);
+            }
+            glFinish();
+        }
+        milliseconds[variant] = millisecondsSince(start) / FRAMES;
+    }
+    const double vertices = double(mesh.vertexCount()) * DRAWS;
+    out << "  inverse() per vertex: " << milliseconds[0] << " ms a frame, " << vertices / milliseconds[0] / 1000.0
+        << " M vertices/s" << std::endl;
+    out << "  normal matrix uniform: " << milliseconds[1] << " ms a frame, " << vertices / milliseconds[1] / 1000.0
+        << " M vertices/s (x" << milliseconds[0] / milliseconds[1] << ")" << std::endl;
+    glDeleteVertexArrays(1, &buffers.VAO);
+    glDeleteBuffers(1, &buffers.VBO);
+    glDeleteBuffers(1, &buffers.EBO);
+#else
+    out << "Built without EGL, no vertex stage timings" << std::endl;
+#endif
+}
+
+void Benchmark::modelImport(std::ostream &out) {
+    constexpr size_t FLOATS = 2000000;
+    constexpr int ROWS = 256;
+    constexpr int COLUMNS = 512;
+
+    // coordinates as exporters write them: six decimals, and every eighth in scientific notation
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+    std::string text;
+    char buffer[64];
+    for (size_t i = 0; i < FLOATS; i++) {
+        const float value = coordinate(rng);
+        const int length = i % 8 == 0
+                               ? std::snprintf(buffer, sizeof(buffer), "%.7e ", value * 1e-3f)
+                               : std::snprintf(buffer, sizeof(buffer), "%.6f ", value);
+        text.append(buffer, static_cast<size_t>(length));
+    }
+    const double megabytes = text.size() / (1024.0 * 1024.0);
+    const char *end = text.data() + text.size();
+    std::vector<float> parsed(FLOATS), fromChars(FLOATS), strtofValues(FLOATS);
+
+    auto start = std::chrono::steady_clock::now();
+    const char *p = text.data();
+    for (size_t i = 0; i < FLOATS; i++) {
+        p = ModelImporter::parseFloat(p, end, parsed[i]) + 1;
+    }
+    const double parseFloatMilliseconds = millisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    p = text.data();
+    for (size_t i = 0; i < FLOATS; i++) {
+        p = std::from_chars(p, end, fromChars[i]).ptr + 1;
+    }
+    const double fromCharsMilliseconds = millisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    p = text.c_str();
+    for (size_t i = 0; i < FLOATS; i++) {
+        char *next;
+        strtofValues[i] = std::strtof(p, &next);
+        p = next + 1;
+    }
+    const double strtofMilliseconds = millisecondsSince(start);
+    out << FLOATS << " floats, " << megabytes << " MiB: parseFloat " << parseFloatMilliseconds << " ms ("
+        << megabytes * 1000.0 / parseFloatMilliseconds << " MiB/s), from_chars " << fromCharsMilliseconds << " ms ("
+        << megabytes * 1000.0 / fromCharsMilliseconds << " MiB/s), strtof " << strtofMilliseconds << " ms ("
+        << megabytes * 1000.0 / strtofMilliseconds << " MiB/s)" << std::endl;
+    // both round correctly, so they agree to the bit
+    if (std::memcmp(parsed.data(), fromChars.data(), FLOATS * sizeof(float)) != 0) {
+        out << "ERROR::BENCHMARK::PARSE_FLOAT_MISMATCH" << std::endl;
+    }
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "benchmark_import.obj";
+    {
+        const std::string obj = wavyGridObj(ROWS, COLUMNS);
+        std::ofstream file(path, std::ios::binary);
+        file.write(obj.data(), static_cast<std::streamsize>(obj.size()));
+    }
+    const size_t expectedVertices = size_t(ROWS + 1) * (COLUMNS + 1);
+    const size_t expectedTriangles = size_t(ROWS) * COLUMNS * 2;
+    out << "OBJ grid " << ROWS << "x" << COLUMNS << ": " << std::filesystem::file_size(path) / (1024.0 * 1024.0)
+        << " MiB, " << expectedTriangles << " triangles" << std::endl;
+    ImportedModel reference;
+    for (unsigned int workers: {0u, std::max(1u, JobSystem::defaultWorkers())}) {
+        JobSystem jobs(workers);
+        ModelImporter importer(jobs);
+        ImportedModel model;
+        start = std::chrono::steady_clock::now();
+        const bool loaded = importer.load(path.string(), model);
+        const double importMilliseconds = millisecondsSince(start);
+        out << "  " << jobs.threadCount() << " threads: " << importMilliseconds << " ms ("
+            << importer.stats().bytes / (1024.0 * 1024.0) * 1000.0 / importMilliseconds << " MiB/s), ";
+        importer.stats().print(out);
+        if (!loaded || model.mesh.vertexCount() != expectedVertices ||
+            model.mesh.indices.size() != expectedTriangles * 3 || model.parts.size() != 2) {
+            out << "ERROR::BENCHMARK::IMPORT_WRONG_MESH " << model.mesh.vertexCount() << " vertices, "
+                << model.mesh.indices.size() / 3 << " triangles, " << model.parts.size() << " parts" << std::endl;
+        }
+        // the chunks are merged in file order, so the threads change nothing
+        if (reference.mesh.indices.empty()) {
+            reference = std::move(model);
+        } else if (model.mesh.vertices != reference.mesh.vertices || model.mesh.indices != reference.mesh.indices) {
+            out << "ERROR::BENCHMARK::IMPORT_THREADS_DIFFER " << workers << " workers" << std::endl;
+        }
+    }
+    start = std::chrono::steady_clock::now();
+    ModelImporter::optimize(reference);
+    out << "  vertex cache and fetch order: " << millisecondsSince(start) << " ms" << std::endl;
+    std::filesystem::remove(path);
+}
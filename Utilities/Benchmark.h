@@ -0,0 +1,40 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <iostream>
+#include <string>
+
+// Timings of the CPU side data structures on synthetic scenes, run with --benchmark NAME instead of rendering.
+// Only normals needs a GL context, and makes a headless one of its own. Each benchmark also checks its results
+// against a brute force reference and prints an ERROR line when they disagree.
+class Benchmark {
+public:
+    // false when there is no benchmark of that name
+    static bool run(const std::string &name, std::ostream &out);
+
+private:
+    // BVH build, frustum culling (against the flat FrustumCuller), ray queries and refit at 10k, 100k and 1M objects
+    static void bvh(std::ostream &out);
+
+    // TransformStore updates of all and of a tenth of the transforms in a hierarchy, against rebuilding every world
+    // matrix with scalar glm
+    static void transforms(std::ostream &out);
+
+    // the parallel transform update and flat culling with 0, 1, 3, 7, ... job workers, against the single threaded
+    // results, plus what parallelFor costs when the jobs do next to nothing
+    static void jobs(std::ostream &out);
+
+    // welding, vertex cache and vertex fetch optimisation of unindexed meshes: a grid with its triangles shuffled and
+    // a sphere, with the cache statistics before and after
+    static void mesh(std::ostream &out);
+
+    // TransformUtility::NormalMatrices against scalar glm, then the vertex stage of a dense sphere drawn with the
+    // normal matrix from a uniform and with the inverse() per vertex it replaced (headless GL, llvmpipe on the CPU)
+    static void normals(std::ostream &out);
+
+    // ModelImporter::parseFloat against std::from_chars and strtof, and the import of a generated OBJ file with a
+    // quarter million triangles on one thread and on all of them
+    static void modelImport(std::ostream &out);
+};
+
+#endif //BENCHMARK_H
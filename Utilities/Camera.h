@@ -23,6 +23,13 @@ const float SENSITIVITY = 0.1f;
 const float ZOOM = 45.0f;
 
 
+// The six planes of a view frustum in world space, in the order left, right, bottom, top, near, far. Each plane is
+// (normal, distance) with a normalized normal pointing inwards, so dot(normal, p) + distance is the signed distance of
+// p to the plane and is negative outside.
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
 // An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
 class Camera {
 public:
@@ -67,6 +74,23 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // extracts the frustum planes from a view-projection matrix: each plane is the sum or difference of the fourth
+    // row of the matrix and one of the other rows (Gribb & Hartmann), for GL's -w <= z <= w clip space
+    static Frustum ExtractFrustum(const glm::mat4 &viewProjection) {
+        glm::mat4 rows = glm::transpose(viewProjection);
+        Frustum frustum{};
+        frustum.planes[0] = rows[3] + rows[0];
+        frustum.planes[1] = rows[3] - rows[0];
+        frustum.planes[2] = rows[3] + rows[1];
+        frustum.planes[3] = rows[3] - rows[1];
+        frustum.planes[4] = rows[3] + rows[2];
+        frustum.planes[5] = rows[3] - rows[2];
+        for (glm::vec4 &plane: frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime) {
         float velocity = MovementSpeed * deltaTime;
@@ -0,0 +1,174 @@
+#include "FrustumCuller.h"
+
+#include <bit>
+#include <chrono>
+#include <cmath>
+
+#include <glm/simd/geometric.h>
+
+#include "Profiler.h"
+
+namespace {
+    // volumes tested per batch; the arrays are padded to a multiple of it so no batch needs a tail
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+    constexpr size_t BATCH = 8;
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    constexpr size_t BATCH = 4;
+#else
+    constexpr size_t BATCH = 1;
+#endif
+    // volumes per range of a parallel cull; a multiple of every batch size
+    constexpr size_t RANGE = 8192;
+}
+
+void FrustumCuller::resize(size_t volumes) {
+    count = volumes;
+    // padding lanes hold empty volumes at the origin; cull() drops their indices
+    size_t padded = (volumes + BATCH - 1) / BATCH * BATCH;
+    for (std::vector<float> *lane: {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ}) {
+        lane->assign(padded, 0.0f);
+    }
+}
+
+void FrustumCuller::setBoxes(std::span<const glm::vec3> centers, std::span<const glm::vec3> halfSizes) {
+    resize(centers.size());
+    spheres = false;
+    for (size_t i = 0; i < count; i++) {
+        centerX[i] = centers[i].x;
+        centerY[i] = centers[i].y;
+        centerZ[i] = centers[i].z;
+        extentX[i] = halfSizes[i].x;
+        extentY[i] = halfSizes[i].y;
+        extentZ[i] = halfSizes[i].z;
+    }
+}
+
+void FrustumCuller::setBox(uint32_t index, const glm::vec3 &center, const glm::vec3 &halfSize) {
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    extentX[index] = halfSize.x;
+    extentY[index] = halfSize.y;
+    extentZ[index] = halfSize.z;
+}
+
+void FrustumCuller::setSpheres(std::span<const glm::vec3> centers, std::span<const float> radii) {
+    resize(centers.size());
+    spheres = true;
+    for (size_t i = 0; i < count; i++) {
+        centerX[i] = centers[i].x;
+        centerY[i] = centers[i].y;
+        centerZ[i] = centers[i].z;
+        extentX[i] = radii[i];
+    }
+}
+
+// A volume is outside a plane when its center is further behind it than the volume reaches along the normal. That
+// reach is the radius for a sphere (the planes are normalized) and |normal| . halfSize for a box.
+template<bool Spheres>
+unsigned int FrustumCuller::testBatch(const Frustum &frustum, size_t first) const {
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+    __m256 x = _mm256_loadu_ps(&centerX[first]);
+    __m256 y = _mm256_loadu_ps(&centerY[first]);
+    __m256 z = _mm256_loadu_ps(&centerZ[first]);
+    __m256 ex = _mm256_loadu_ps(&extentX[first]);
+    __m256 ey = _mm256_loadu_ps(&extentY[first]);
+    __m256 ez = _mm256_loadu_ps(&extentZ[first]);
+    __m256 outside = _mm256_setzero_ps();
+    for (const glm::vec4 &plane: frustum.planes) {
+        __m256 distance = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x), _mm256_mul_ps(_mm256_set1_ps(plane.y), y)),
+            _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), z), _mm256_set1_ps(plane.w)));
+        __m256 reach = ex;
+        if constexpr (!Spheres) {
+            reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), ex),
+                                                _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.y)), ey)),
+                                  _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.z)), ez));
+        }
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(),
+                                                      _CMP_LT_OQ));
+    }
+    return ~static_cast<unsigned int>(_mm256_movemask_ps(outside)) & 0xffu;
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    glm_vec4 x = _mm_loadu_ps(&centerX[first]);
+    glm_vec4 y = _mm_loadu_ps(&centerY[first]);
+    glm_vec4 z = _mm_loadu_ps(&centerZ[first]);
+    glm_vec4 ex = _mm_loadu_ps(&extentX[first]);
+    glm_vec4 ey = _mm_loadu_ps(&extentY[first]);
+    glm_vec4 ez = _mm_loadu_ps(&extentZ[first]);
+    glm_vec4 outside = _mm_setzero_ps();
+    for (const glm::vec4 &plane: frustum.planes) {
+        glm_vec4 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x),
+                                                  _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+                                       _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z), _mm_set1_ps(plane.w)));
+        glm_vec4 reach = ex;
+        if constexpr (!Spheres) {
+            reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex),
+                                          _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey)),
+                               _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez));
+        }
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+    }
+    return ~static_cast<unsigned int>(_mm_movemask_ps(outside)) & 0xfu;
+#else
+    for (const glm::vec4 &plane: frustum.planes) {
+        float distance = plane.x * centerX[first] + plane.y * centerY[first] + plane.z * centerZ[first] + plane.w;
+        float reach = extentX[first];
+        if constexpr (!Spheres) {
+            reach = std::abs(plane.x) * extentX[first] + std::abs(plane.y) * extentY[first] +
+                    std::abs(plane.z) * extentZ[first];
+        }
+        if (distance + reach < 0.0f)
+            return 0;
+    }
+    return 1;
+#endif
+}
+
+void FrustumCuller::cullRange(const Frustum &frustum, size_t first, size_t end, std::vector<uint32_t> &visible) const {
+    for (; first < end; first += BATCH) {
+        unsigned int mask = spheres ? testBatch<true>(frustum, first) : testBatch<false>(frustum, first);
+        // padding lanes are only ever in the last batch, past count
+        for (; mask != 0; mask &= mask - 1) {
+            size_t index = first + std::countr_zero(mask);
+            if (index >= count)
+                break;
+            visible.push_back(static_cast<uint32_t>(index));
+        }
+    }
+}
+
+void FrustumCuller::cull(const Frustum &frustum, std::vector<uint32_t> &visible, JobSystem *jobs) {
+    PROFILE_SCOPE("frustum culling");
+    const auto start = std::chrono::steady_clock::now();
+    visible.clear();
+    if (jobs && jobs->threadCount() > 1 && count > RANGE) {
+        const size_t ranges = (count + RANGE - 1) / RANGE;
+        if (rangeVisible.size() < ranges) {
+            rangeVisible.resize(ranges);
+        }
+        jobs->parallelFor(ranges, 1, [&](size_t begin, size_t end) {
+            for (size_t range = begin; range < end; range++) {
+                rangeVisible[range].clear();
+                cullRange(frustum, range * RANGE, std::min((range + 1) * RANGE, count), rangeVisible[range]);
+            }
+        });
+        for (size_t range = 0; range < ranges; range++) {
+            visible.insert(visible.end(), rangeVisible[range].begin(), rangeVisible[range].end());
+        }
+    } else {
+        cullRange(frustum, 0, count, visible);
+    }
+
+    ++counters.frames;
+    counters.tested += count;
+    counters.visible += visible.size();
+    counters.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FrustumCuller::Stats::print(std::ostream &out, const char *what) const {
+    if (frames == 0)
+        return;
+    out << "Frustum culling: " << static_cast<double>(visible) / frames << " of " << tested / frames << " " << what
+        << " visible per frame, " << seconds * 1000.0 / frames << " ms per frame" << std::endl;
+}
@@ -0,0 +1,65 @@
+#ifndef FRUSTUMCULLER_H
+#define FRUSTUMCULLER_H
+
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "JobSystem.h"
+
+// Frustum culling of a fixed set of bounding volumes, either world space boxes or spheres. The volumes are stored as
+// SoA arrays padded to the SIMD width, and cull() tests 8 (AVX) or 4 (SSE) of them at a time against the six planes,
+// writing the indices of the volumes that are not entirely behind a plane to a compact list. Like any plane test it is
+// conservative: a box just outside a frustum corner can still be reported visible.
+class FrustumCuller {
+public:
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t tested = 0; // summed over all frames
+        uint64_t visible = 0; // summed over all frames
+        double seconds = 0.0;
+
+        void print(std::ostream &out, const char *what) const;
+    };
+
+    // replace the volumes with boxes, given as center and half size
+    void setBoxes(std::span<const glm::vec3> centers, std::span<const glm::vec3> halfSizes);
+
+    // replace the volumes with spheres
+    void setSpheres(std::span<const glm::vec3> centers, std::span<const float> radii);
+
+    // move one box, e.g. after its object moved
+    void setBox(uint32_t index, const glm::vec3 &center, const glm::vec3 &halfSize);
+
+    // indices of the volumes inside or crossing the frustum, ascending. With jobs, ranges of volumes are tested in
+    // parallel into lists of their own that are joined in order, so the result is the same.
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible, JobSystem *jobs = nullptr);
+
+    size_t size() const { return count; }
+
+    const Stats &stats() const { return counters; }
+
+private:
+    // x, y, z of the centers and, for boxes, the half sizes; spheres keep their radius in extentX
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    size_t count = 0;
+    bool spheres = false;
+    std::vector<std::vector<uint32_t> > rangeVisible; // per range of a parallel cull
+    Stats counters;
+
+    void resize(size_t volumes);
+
+    // bit k is set when volume first + k is not outside any plane
+    template<bool Spheres>
+    unsigned int testBatch(const Frustum &frustum, size_t first) const;
+
+    // append the visible volumes of [first, end) to visible; first is a multiple of the batch size
+    void cullRange(const Frustum &frustum, size_t first, size_t end, std::vector<uint32_t> &visible) const;
+};
+
+#endif //FRUSTUMCULLER_H
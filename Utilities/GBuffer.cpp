@@ -0,0 +1,90 @@
+#include "GBuffer.h"
+
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+
+
+// the attachments go to consecutive units, in the order of textures[]
+static_assert(GBuffer::NORMAL_SHININESS_UNIT == GBuffer::ALBEDO_SPECULAR_UNIT + 1 &&
+              GBuffer::DEPTH_UNIT == GBuffer::ALBEDO_SPECULAR_UNIT + 2);
+
+GBuffer::GBuffer(unsigned int width, unsigned int height) : width(width), height(height) {
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &output);
+    // core profiles draw nothing without a VAO, even when no attribute is read
+    glGenVertexArrays(1, &emptyVAO);
+    allocate();
+}
+
+GBuffer::~GBuffer() {
+    glState.deleteFramebuffers(1, &FBO);
+    glState.deleteTextures(3, textures);
+    glState.deleteVertexArrays(1, &emptyVAO);
+}
+
+bool GBuffer::allocate() {
+    if (FBO != 0) {
+        glState.deleteFramebuffers(1, &FBO);
+        glState.deleteTextures(3, textures);
+        FBO = 0;
+    }
+    unsigned int framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenTextures(3, textures);
+
+    const GLenum internalFormats[3] = {GL_RGBA8, GL_RGBA16F, GL_DEPTH24_STENCIL8};
+    const GLenum formats[3] = {GL_RGBA, GL_RGBA, GL_DEPTH_STENCIL};
+    const GLenum types[3] = {GL_UNSIGNED_BYTE, GL_HALF_FLOAT, GL_UNSIGNED_INT_24_8};
+    const GLenum attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_DEPTH_STENCIL_ATTACHMENT};
+    for (int i = 0; i < 3; i++) {
+        glState.bindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], types[i], nullptr);
+        // the light pass fetches texels, but a texture without mipmaps must not ask for them to be complete
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, textures[i], 0);
+    }
+    glState.bindTexture(GL_TEXTURE_2D, 0);
+    const GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, drawBuffers);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glState.bindFramebuffer(GL_FRAMEBUFFER, output);
+    if (!complete) {
+        std::cout << "ERROR::GBUFFER::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glState.deleteFramebuffers(1, &framebuffer);
+        return false;
+    }
+    FBO = framebuffer;
+    return true;
+}
+
+void GBuffer::resize(unsigned int newWidth, unsigned int newHeight) {
+    if (newWidth == width && newHeight == height)
+        return;
+    width = newWidth;
+    height = newHeight;
+    allocate();
+}
+
+void GBuffer::beginGeometry() const {
+    glState.bindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void GBuffer::beginLighting() const {
+    glState.bindFramebuffer(GL_FRAMEBUFFER, output);
+    for (int i = 0; i < 3; i++) {
+        glState.bindTexture(ALBEDO_SPECULAR_UNIT + i, GL_TEXTURE_2D, textures[i]);
+    }
+}
+
+void GBuffer::resolveDepth() const {
+    glState.bindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+    glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, output);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, output);
+}
@@ -0,0 +1,50 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+// The G-buffer of the deferred pipeline: albedo and specular intensity (RGBA8), world space normal and shininess
+// (RGBA16F), and a depth texture the light pass rebuilds positions from. The geometry pass renders into it; the light
+// pass reads it and writes to the framebuffer that was bound when the G-buffer was created.
+class GBuffer {
+public:
+    // texture units of the attachments in the light pass; 0 to 4 are the material maps and the cluster buffers
+    static constexpr int ALBEDO_SPECULAR_UNIT = 5;
+    static constexpr int NORMAL_SHININESS_UNIT = 6;
+    static constexpr int DEPTH_UNIT = 7;
+
+    GBuffer(unsigned int width, unsigned int height);
+
+    ~GBuffer();
+
+    GBuffer(const GBuffer &) = delete;
+
+    GBuffer &operator=(const GBuffer &) = delete;
+
+    bool valid() const { return FBO != 0; }
+
+    // reallocate the attachments when the framebuffer size changed
+    void resize(unsigned int width, unsigned int height);
+
+    // clear the G-buffer and render into it
+    void beginGeometry() const;
+
+    // render into the output framebuffer again, with the attachments bound to their units
+    void beginLighting() const;
+
+    // a vertex array without attributes: the light pass draws one fullscreen triangle, 3 vertices made from gl_VertexID
+    unsigned int fullscreenVertexArray() const { return emptyVAO; }
+
+    // copy the scene depth into the output framebuffer, so forward passes after the light pass are occluded by it
+    void resolveDepth() const;
+
+private:
+    unsigned int FBO = 0;
+    unsigned int textures[3] = {};
+    unsigned int emptyVAO = 0;
+    int output = 0; // the framebuffer the light pass writes to
+    unsigned int width = 0;
+    unsigned int height = 0;
+
+    bool allocate();
+};
+
+#endif //GBUFFER_H
@@ -0,0 +1,418 @@
+#include "GLStateCache.h"
+
+#include <algorithm>
+
+namespace {
+    constexpr GLenum bufferTargets[] = {
+        GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_TEXTURE_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_PACK_BUFFER,
+        GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER
+    };
+    // GL 3.3 queries the texture buffer and copy bindings by their target names
+    constexpr GLenum bufferQueries[] = {
+        GL_ARRAY_BUFFER_BINDING, GL_UNIFORM_BUFFER_BINDING, GL_TEXTURE_BUFFER, GL_PIXEL_UNPACK_BUFFER_BINDING,
+        GL_PIXEL_PACK_BUFFER_BINDING, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER
+    };
+    constexpr GLenum textureTargets[] = {
+        GL_TEXTURE_2D, GL_TEXTURE_BUFFER, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_3D
+    };
+    constexpr GLenum textureQueries[] = {
+        GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_BUFFER, GL_TEXTURE_BINDING_CUBE_MAP, GL_TEXTURE_BINDING_2D_ARRAY,
+        GL_TEXTURE_BINDING_3D
+    };
+    constexpr GLenum capabilityNames[] = {GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST};
+}
+
+int GLStateCache::bufferTarget(GLenum target) {
+    for (int i = 0; i < BUFFER_TARGETS; i++) {
+        if (bufferTargets[i] == target)
+            return i;
+    }
+    return -1;
+}
+
+int GLStateCache::textureTarget(GLenum target) {
+    for (int i = 0; i < TEXTURE_TARGETS; i++) {
+        if (textureTargets[i] == target)
+            return i;
+    }
+    return -1;
+}
+
+int GLStateCache::capability(GLenum capability) {
+    for (int i = 0; i < CAPABILITIES; i++) {
+        if (capabilityNames[i] == capability)
+            return i;
+    }
+    return -1;
+}
+
+void GLStateCache::invalidate() {
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    for (unsigned int &buffer: buffers) {
+        buffer = UNKNOWN;
+    }
+    activeUnit = UNKNOWN;
+    for (auto &unit: textures) {
+        for (unsigned int &texture: unit) {
+            texture = UNKNOWN;
+        }
+    }
+    drawFramebuffer = UNKNOWN;
+    readFramebuffer = UNKNOWN;
+    for (unsigned int &enabled: capabilities) {
+        enabled = UNKNOWN;
+    }
+    blendSource = UNKNOWN;
+    blendDestination = UNKNOWN;
+    depthFunction = UNKNOWN;
+    depthWrite = UNKNOWN;
+    viewportKnown = false;
+}
+
+unsigned int GLStateCache::query(GLenum name) {
+    GLint value = 0;
+    glGetIntegerv(name, &value);
+    return static_cast<unsigned int>(value);
+}
+
+unsigned int GLStateCache::queryTexture(int unit, int target) {
+    const unsigned int active = query(GL_ACTIVE_TEXTURE);
+    glActiveTexture(GL_TEXTURE0 + unit);
+    const unsigned int texture = query(textureQueries[target]);
+    glActiveTexture(active);
+    return texture;
+}
+
+bool GLStateCache::agrees(const char *what, unsigned int cached, unsigned int driver) {
+    if (cached == driver)
+        return true;
+    std::cout << "ERROR::GL_STATE_CACHE::MISMATCH " << what << ": cached " << cached << ", driver " << driver
+              << std::endl;
+    ++counters.mismatches;
+    return false;
+}
+
+void GLStateCache::useProgram(unsigned int id) {
+    if (program == id && (!validation || agrees("program", program, query(GL_CURRENT_PROGRAM)))) {
+        ++counters.programs.skipped;
+        return;
+    }
+    glUseProgram(id);
+    ++counters.programs.issued;
+    program = id;
+}
+
+void GLStateCache::bindVertexArray(unsigned int id) {
+    if (vertexArray == id && (!validation || agrees("vertex array", vertexArray, query(GL_VERTEX_ARRAY_BINDING)))) {
+        ++counters.vertexArrays.skipped;
+        return;
+    }
+    glBindVertexArray(id);
+    ++counters.vertexArrays.issued;
+    vertexArray = id;
+}
+
+void GLStateCache::bindBuffer(GLenum target, unsigned int buffer) {
+    const int index = bufferTarget(target);
+    if (index >= 0 && buffers[index] == buffer &&
+        (!validation || agrees("buffer", buffers[index], query(bufferQueries[index])))) {
+        ++counters.buffers.skipped;
+        return;
+    }
+    glBindBuffer(target, buffer);
+    ++counters.buffers.issued;
+    if (index >= 0) {
+        buffers[index] = buffer;
+    }
+}
+
+void GLStateCache::bindBufferBase(GLenum target, unsigned int index, unsigned int buffer) {
+    glBindBufferBase(target, index, buffer);
+    ++counters.buffers.issued;
+    const int generic = bufferTarget(target);
+    if (generic >= 0) {
+        buffers[generic] = buffer;
+    }
+}
+
+void GLStateCache::bindBufferRange(GLenum target, unsigned int index, unsigned int buffer, size_t offset,
+                                   size_t size) {
+    glBindBufferRange(target, index, buffer, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+    ++counters.buffers.issued;
+    const int generic = bufferTarget(target);
+    if (generic >= 0) {
+        buffers[generic] = buffer;
+    }
+}
+
+void GLStateCache::activeTexture(int unit) {
+    const auto id = static_cast<unsigned int>(unit);
+    if (activeUnit == id &&
+        (!validation || agrees("active texture", GL_TEXTURE0 + activeUnit, query(GL_ACTIVE_TEXTURE)))) {
+        ++counters.textures.skipped;
+        return;
+    }
+    glActiveTexture(GL_TEXTURE0 + id);
+    ++counters.textures.issued;
+    activeUnit = id;
+}
+
+void GLStateCache::bindTexture(GLenum target, unsigned int texture) {
+    const int index = textureTarget(target);
+    const bool tracked = index >= 0 && activeUnit < MAX_TEXTURE_UNITS;
+    if (index >= 0 && !tracked) {
+        // some unit gets the texture, and we do not know which one
+        for (auto &unit: textures) {
+            unit[index] = UNKNOWN;
+        }
+    }
+    if (tracked && textures[activeUnit][index] == texture &&
+        (!validation || agrees("texture", texture, queryTexture(static_cast<int>(activeUnit), index)))) {
+        ++counters.textures.skipped;
+        return;
+    }
+    glBindTexture(target, texture);
+    ++counters.textures.issued;
+    if (tracked) {
+        textures[activeUnit][index] = texture;
+    }
+}
+
+void GLStateCache::bindTexture(int unit, GLenum target, unsigned int texture) {
+    if (unit < 0 || unit >= MAX_TEXTURE_UNITS) {
+        std::cout << "ERROR::GL_STATE_CACHE::TEXTURE_UNIT_OUT_OF_RANGE " << unit << std::endl;
+        return;
+    }
+    // an unchanged binding does not need its unit active either
+    const int index = textureTarget(target);
+    if (index >= 0 && textures[unit][index] == texture &&
+        (!validation || agrees("texture", texture, queryTexture(unit, index)))) {
+        ++counters.textures.skipped;
+        return;
+    }
+    activeTexture(unit);
+    bindTexture(target, texture);
+}
+
+void GLStateCache::bindFramebuffer(GLenum target, unsigned int framebuffer) {
+    const bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    const bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    if ((!draw || drawFramebuffer == framebuffer) && (!read || readFramebuffer == framebuffer) &&
+        (!validation || ((!draw || agrees("draw framebuffer", framebuffer, query(GL_DRAW_FRAMEBUFFER_BINDING))) &&
+                         (!read || agrees("read framebuffer", framebuffer, query(GL_READ_FRAMEBUFFER_BINDING)))))) {
+        ++counters.framebuffers.skipped;
+        return;
+    }
+    glBindFramebuffer(target, framebuffer);
+    ++counters.framebuffers.issued;
+    if (draw) {
+        drawFramebuffer = framebuffer;
+    }
+    if (read) {
+        readFramebuffer = framebuffer;
+    }
+}
+
+void GLStateCache::setCapability(GLenum name, bool enabled) {
+    const int index = capability(name);
+    const unsigned int value = enabled ? 1 : 0;
+    if (index >= 0 && capabilities[index] == value &&
+        (!validation || agrees("capability", value, glIsEnabled(name) ? 1 : 0))) {
+        ++counters.state.skipped;
+        return;
+    }
+    if (enabled) {
+        glEnable(name);
+    } else {
+        glDisable(name);
+    }
+    ++counters.state.issued;
+    if (index >= 0) {
+        capabilities[index] = value;
+    }
+}
+
+void GLStateCache::enable(GLenum capability) {
+    setCapability(capability, true);
+}
+
+void GLStateCache::disable(GLenum capability) {
+    setCapability(capability, false);
+}
+
+void GLStateCache::blendFunc(GLenum source, GLenum destination) {
+    if (blendSource == source && blendDestination == destination &&
+        (!validation || (agrees("blend source", source, query(GL_BLEND_SRC_RGB)) &&
+                         agrees("blend destination", destination, query(GL_BLEND_DST_RGB))))) {
+        ++counters.state.skipped;
+        return;
+    }
+    glBlendFunc(source, destination);
+    ++counters.state.issued;
+    blendSource = source;
+    blendDestination = destination;
+}
+
+void GLStateCache::depthFunc(GLenum function) {
+    if (depthFunction == function && (!validation || agrees("depth function", function, query(GL_DEPTH_FUNC)))) {
+        ++counters.state.skipped;
+        return;
+    }
+    glDepthFunc(function);
+    ++counters.state.issued;
+    depthFunction = function;
+}
+
+void GLStateCache::depthMask(bool write) {
+    const unsigned int value = write ? 1 : 0;
+    if (depthWrite == value && (!validation || agrees("depth mask", value, query(GL_DEPTH_WRITEMASK)))) {
+        ++counters.state.skipped;
+        return;
+    }
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+    ++counters.state.issued;
+    depthWrite = value;
+}
+
+void GLStateCache::viewport(int x, int y, int width, int height) {
+    const int box[4] = {x, y, width, height};
+    bool same = viewportKnown;
+    for (int i = 0; i < 4 && same; i++) {
+        same = viewportBox[i] == box[i];
+    }
+    if (same && validation) {
+        GLint driver[4];
+        glGetIntegerv(GL_VIEWPORT, driver);
+        for (int i = 0; i < 4 && same; i++) {
+            same = agrees("viewport", static_cast<unsigned int>(box[i]), static_cast<unsigned int>(driver[i]));
+        }
+    }
+    if (same) {
+        ++counters.state.skipped;
+        return;
+    }
+    glViewport(x, y, width, height);
+    ++counters.state.issued;
+    std::copy(box, box + 4, viewportBox);
+    viewportKnown = true;
+}
+
+void GLStateCache::deleteProgram(unsigned int id) {
+    glDeleteProgram(id);
+    // it stays current until the next glUseProgram, but its name may come back for a new program
+    if (program == id) {
+        program = UNKNOWN;
+    }
+}
+
+void GLStateCache::deleteVertexArrays(int count, const unsigned int *ids) {
+    glDeleteVertexArrays(count, ids);
+    for (int i = 0; i < count; i++) {
+        if (ids[i] != 0 && vertexArray == ids[i]) {
+            vertexArray = 0;
+        }
+    }
+}
+
+void GLStateCache::deleteBuffers(int count, const unsigned int *ids) {
+    glDeleteBuffers(count, ids);
+    for (int i = 0; i < count; i++) {
+        for (unsigned int &buffer: buffers) {
+            if (ids[i] != 0 && buffer == ids[i]) {
+                buffer = 0;
+            }
+        }
+    }
+}
+
+void GLStateCache::deleteTextures(int count, const unsigned int *ids) {
+    glDeleteTextures(count, ids);
+    for (int i = 0; i < count; i++) {
+        for (auto &unit: textures) {
+            for (unsigned int &texture: unit) {
+                if (ids[i] != 0 && texture == ids[i]) {
+                    texture = 0;
+                }
+            }
+        }
+    }
+}
+
+void GLStateCache::deleteFramebuffers(int count, const unsigned int *ids) {
+    glDeleteFramebuffers(count, ids);
+    for (int i = 0; i < count; i++) {
+        if (ids[i] == 0)
+            continue;
+        if (drawFramebuffer == ids[i]) {
+            drawFramebuffer = 0;
+        }
+        if (readFramebuffer == ids[i]) {
+            readFramebuffer = 0;
+        }
+    }
+}
+
+bool GLStateCache::validate() {
+    const uint64_t before = counters.mismatches;
+    auto check = [&](const char *what, unsigned int &cached, unsigned int driver) {
+        if (cached != UNKNOWN && !agrees(what, cached, driver)) {
+            cached = UNKNOWN;
+        }
+    };
+    check("program", program, query(GL_CURRENT_PROGRAM));
+    check("vertex array", vertexArray, query(GL_VERTEX_ARRAY_BINDING));
+    for (int i = 0; i < BUFFER_TARGETS; i++) {
+        check("buffer", buffers[i], query(bufferQueries[i]));
+    }
+    if (activeUnit != UNKNOWN && !agrees("active texture", GL_TEXTURE0 + activeUnit, query(GL_ACTIVE_TEXTURE))) {
+        activeUnit = UNKNOWN;
+    }
+    for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+        for (int target = 0; target < TEXTURE_TARGETS; target++) {
+            if (textures[unit][target] != UNKNOWN) {
+                check("texture", textures[unit][target], queryTexture(unit, target));
+            }
+        }
+    }
+    check("draw framebuffer", drawFramebuffer, query(GL_DRAW_FRAMEBUFFER_BINDING));
+    check("read framebuffer", readFramebuffer, query(GL_READ_FRAMEBUFFER_BINDING));
+    for (int i = 0; i < CAPABILITIES; i++) {
+        check("capability", capabilities[i], glIsEnabled(capabilityNames[i]) ? 1 : 0);
+    }
+    check("blend source", blendSource, query(GL_BLEND_SRC_RGB));
+    check("blend destination", blendDestination, query(GL_BLEND_DST_RGB));
+    check("depth function", depthFunction, query(GL_DEPTH_FUNC));
+    check("depth mask", depthWrite, query(GL_DEPTH_WRITEMASK));
+    if (viewportKnown) {
+        GLint driver[4];
+        glGetIntegerv(GL_VIEWPORT, driver);
+        for (int i = 0; i < 4 && viewportKnown; i++) {
+            viewportKnown = agrees("viewport", static_cast<unsigned int>(viewportBox[i]),
+                                   static_cast<unsigned int>(driver[i]));
+        }
+    }
+    return counters.mismatches == before;
+}
+
+void GLStateCache::Stats::print(std::ostream &out) const {
+    if (frames == 0)
+        return;
+    const char *separator = ": ";
+    auto counter = [&](const char *what, const Counter &counter) {
+        out << separator << what << " " << static_cast<double>(counter.issued) / frames << " issued / "
+            << static_cast<double>(counter.skipped) / frames << " skipped";
+        separator = ", ";
+    };
+    out << "GL state per frame";
+    counter("programs", programs);
+    counter("vertex arrays", vertexArrays);
+    counter("buffers", buffers);
+    counter("textures", textures);
+    counter("framebuffers", framebuffers);
+    counter("state", state);
+    out << std::endl;
+    if (mismatches > 0) {
+        out << "GL state cache: " << mismatches << " stale values found by validation" << std::endl;
+    }
+}
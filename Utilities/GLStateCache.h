@@ -0,0 +1,149 @@
+#ifndef GLSTATECACHE_H
+#define GLSTATECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include <glad/glad.h>
+
+// A shadow copy of the GL state we change every frame: the program, vertex array, buffer and framebuffer bindings,
+// the texture of every unit, the enabled capabilities, blend and depth state and the viewport. A call that would set
+// what is already there never reaches the driver. Everything starts out unknown, so the first call of each kind is
+// always issued; invalidate() goes back to that, e.g. after a new context was made current or after code that does
+// not go through the cache.
+// Objects must be deleted through the cache as well, so a name GL hands out again is not mistaken for a bound one.
+// With validation on, every skipped call first checks the shadow against glGet*, and validate() compares all of it.
+// Everything here is touched from the GL thread only.
+class GLStateCache {
+public:
+    static constexpr int MAX_TEXTURE_UNITS = 16;
+
+    struct Counter {
+        uint64_t issued = 0;
+        uint64_t skipped = 0;
+    };
+
+    struct Stats {
+        uint64_t frames = 0;
+        Counter programs;
+        Counter vertexArrays;
+        Counter buffers;
+        Counter textures; // glActiveTexture and glBindTexture
+        Counter framebuffers;
+        Counter state; // capabilities, blend and depth state, viewport
+        uint64_t mismatches = 0; // found by validation
+
+        void print(std::ostream &out) const;
+    };
+
+    GLStateCache() { invalidate(); }
+
+    // forget everything; the next call of each kind goes to the driver
+    void invalidate();
+
+    void useProgram(unsigned int program);
+
+    void bindVertexArray(unsigned int vertexArray);
+
+    // the element array binding belongs to the bound vertex array and always goes to the driver
+    void bindBuffer(GLenum target, unsigned int buffer);
+
+    // binds the indexed binding point and, like GL, the generic one
+    void bindBufferBase(GLenum target, unsigned int index, unsigned int buffer);
+
+    void bindBufferRange(GLenum target, unsigned int index, unsigned int buffer, size_t offset, size_t size);
+
+    void activeTexture(int unit);
+
+    // on the active unit
+    void bindTexture(GLenum target, unsigned int texture);
+
+    void bindTexture(int unit, GLenum target, unsigned int texture);
+
+    // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+    void bindFramebuffer(GLenum target, unsigned int framebuffer);
+
+    void enable(GLenum capability);
+
+    void disable(GLenum capability);
+
+    void blendFunc(GLenum source, GLenum destination);
+
+    void depthFunc(GLenum function);
+
+    void depthMask(bool write);
+
+    void viewport(int x, int y, int width, int height);
+
+    // GL unbinds deleted objects, except a deleted program that is in use
+    void deleteProgram(unsigned int program);
+
+    void deleteVertexArrays(int count, const unsigned int *vertexArrays);
+
+    void deleteBuffers(int count, const unsigned int *buffers);
+
+    void deleteTextures(int count, const unsigned int *textures);
+
+    void deleteFramebuffers(int count, const unsigned int *framebuffers);
+
+    void setValidation(bool enabled) { validation = enabled; }
+
+    bool validating() const { return validation; }
+
+    // compare every known value with the driver's, report and forget the ones that differ; true if all matched
+    bool validate();
+
+    void endFrame() { ++counters.frames; }
+
+    void resetStats() { counters = Stats{}; }
+
+    const Stats &stats() const { return counters; }
+
+private:
+    static constexpr unsigned int UNKNOWN = ~0u;
+
+    enum BufferTarget { ArrayBuffer, UniformBuffer, TextureBuffer, PixelUnpackBuffer, PixelPackBuffer, CopyReadBuffer,
+                        CopyWriteBuffer, BUFFER_TARGETS };
+
+    enum TextureTarget { Texture2D, TextureBufferTexture, TextureCubeMap, Texture2DArray, Texture3D, TEXTURE_TARGETS };
+
+    enum Capability { DepthTest, Blend, CullFace, ScissorTest, StencilTest, CAPABILITIES };
+
+    static int bufferTarget(GLenum target);
+
+    static int textureTarget(GLenum target);
+
+    static int capability(GLenum capability);
+
+    unsigned int program = UNKNOWN;
+    unsigned int vertexArray = UNKNOWN;
+    unsigned int buffers[BUFFER_TARGETS];
+    unsigned int activeUnit = UNKNOWN;
+    unsigned int textures[MAX_TEXTURE_UNITS][TEXTURE_TARGETS];
+    unsigned int drawFramebuffer = UNKNOWN;
+    unsigned int readFramebuffer = UNKNOWN;
+    unsigned int capabilities[CAPABILITIES]; // 0, 1 or UNKNOWN
+    unsigned int blendSource = UNKNOWN;
+    unsigned int blendDestination = UNKNOWN;
+    unsigned int depthFunction = UNKNOWN;
+    unsigned int depthWrite = UNKNOWN;
+    int viewportBox[4] = {};
+    bool viewportKnown = false;
+    bool validation = false;
+    Stats counters;
+
+    // validation: true if the driver's value is the cached one; reports and counts it if not
+    bool agrees(const char *what, unsigned int cached, unsigned int driver);
+
+    static unsigned int query(GLenum name);
+
+    // the texture bound to target on a unit, without changing the active unit
+    static unsigned int queryTexture(int unit, int target);
+
+    void setCapability(GLenum capability, bool enabled);
+};
+
+inline GLStateCache glState;
+
+#endif //GLSTATECACHE_H
@@ -0,0 +1,32 @@
+#ifndef GLSTATS_H
+#define GLSTATS_H
+
+#include <cstdint>
+#include <iostream>
+
+// Counters for the driver calls we issue on the hot path. Everything here is touched from the GL thread only.
+struct GLStats {
+    uint64_t uniformLookups = 0; // glGetUniformLocation
+    uint64_t uniformUploads = 0; // glUniform*
+    uint64_t bufferUploads = 0; // glBufferData/glBufferSubData
+    uint64_t drawCalls = 0; // glDraw*
+    uint64_t frames = 0;
+
+    void endFrame() { ++frames; }
+
+    void reset() { *this = GLStats{}; }
+
+    void print(std::ostream &out) const {
+        if (frames == 0)
+            return;
+        out << "GL calls per frame over " << frames << " frames:"
+            << " uniform lookups " << static_cast<double>(uniformLookups) / frames
+            << ", uniform uploads " << static_cast<double>(uniformUploads) / frames
+            << ", buffer uploads " << static_cast<double>(bufferUploads) / frames
+            << ", draw calls " << static_cast<double>(drawCalls) / frames << std::endl;
+    }
+};
+
+inline GLStats glStats;
+
+#endif //GLSTATS_H
@@ -0,0 +1,144 @@
+#include "HeadlessContext.h"
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "GLStateCache.h"
+
+HeadlessContext::HeadlessContext(unsigned int width, unsigned int height) : width(width), height(height) {
+    if (createContext()) {
+        createFramebuffer();
+    }
+}
+
+HeadlessContext::~HeadlessContext() {
+    if (FBO != 0) {
+        glState.deleteFramebuffers(1, &FBO);
+        glDeleteRenderbuffers(1, &colorRBO);
+        glDeleteRenderbuffers(1, &depthRBO);
+    }
+    if (display != nullptr) {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != nullptr) {
+            eglDestroyContext(display, context);
+        }
+        eglTerminate(display);
+    }
+}
+
+bool HeadlessContext::createContext() {
+    // prefer the surfaceless platform, it needs neither X11 nor a DRM device
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    if (getPlatformDisplay != nullptr) {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY) {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        std::cerr << "Failed to initialize EGL\n";
+        return false;
+    }
+    display = eglDisplay;
+
+    // we never create an EGL surface, so don't insist on any surface type
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, 0,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) || configCount == 0) {
+        std::cerr << "Failed to choose an EGL config\n";
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL has no desktop OpenGL support\n";
+        return false;
+    }
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if (eglContext == EGL_NO_CONTEXT) {
+        std::cerr << "Failed to create an OpenGL 3.3 context\n";
+        return false;
+    }
+    context = eglContext;
+
+    if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        std::cerr << "Failed to make the surfaceless context current\n";
+        return false;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) {
+        std::cerr << "Failed to initialize GLAD\n";
+        return false;
+    }
+    // whatever the cache knew belonged to another context
+    glState.invalidate();
+    return true;
+}
+
+bool HeadlessContext::createFramebuffer() {
+    unsigned int framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    glGenRenderbuffers(1, &colorRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+
+    glGenRenderbuffers(1, &depthRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR::FRAMEBUFFER:: Offscreen framebuffer is not complete\n";
+        glState.deleteFramebuffers(1, &framebuffer);
+        return false;
+    }
+    FBO = framebuffer;
+    glState.viewport(0, 0, width, height);
+    return true;
+}
+
+bool HeadlessContext::writePPM(const std::string &path) const {
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 3);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open " << path << " for writing\n";
+        return false;
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+    // GL rows start at the bottom, PPM rows at the top
+    size_t stride = static_cast<size_t>(width) * 3;
+    for (unsigned int row = height; row > 0; row--) {
+        file.write(reinterpret_cast<const char *>(pixels.data() + (row - 1) * stride), stride);
+    }
+    if (!file) {
+        std::cerr << "Failed to write " << path << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef HEADLESSCONTEXT_H
+#define HEADLESSCONTEXT_H
+
+#include <string>
+
+// An OpenGL 3.3 core context without any window system: a surfaceless EGL display (Mesa llvmpipe works fine)
+// rendering into an offscreen framebuffer of a fixed size. Used for batch runs and benchmarks on machines
+// without a display or GPU.
+class HeadlessContext {
+public:
+    HeadlessContext(unsigned int width, unsigned int height);
+
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext &) = delete;
+
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    // false when no display, context or framebuffer could be created; the reason has been printed already
+    bool valid() const { return FBO != 0; }
+
+    // write the current contents of the framebuffer as a binary PPM, top row first
+    bool writePPM(const std::string &path) const;
+
+private:
+    void *display = nullptr;
+    void *context = nullptr;
+    unsigned int FBO = 0;
+    unsigned int colorRBO = 0;
+    unsigned int depthRBO = 0;
+    unsigned int width;
+    unsigned int height;
+
+    bool createContext();
+
+    bool createFramebuffer();
+};
+
+#endif //HEADLESSCONTEXT_H
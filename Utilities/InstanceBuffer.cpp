@@ -0,0 +1,91 @@
+#include "InstanceBuffer.h"
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+#include "GLStats.h"
+
+InstanceBuffer::InstanceBuffer() {
+    glGenBuffers(1, &modelVBO);
+    glGenBuffers(1, &normalVBO);
+}
+
+InstanceBuffer::~InstanceBuffer() {
+    glState.deleteBuffers(1, &modelVBO);
+    glState.deleteBuffers(1, &normalVBO);
+}
+
+// (re)allocate or orphan a buffer and fill its first bytes
+static void uploadInstanceData(unsigned int buffer, size_t capacityBytes, bool grow, const void *data, size_t bytes) {
+    glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (grow) {
+        glBufferData(GL_ARRAY_BUFFER, capacityBytes, data, GL_DYNAMIC_DRAW);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, capacityBytes, nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+    }
+    ++glStats.bufferUploads;
+}
+
+void InstanceBuffer::point(unsigned int modelBuffer, size_t modelOffset, unsigned int normalBuffer,
+                           size_t normalOffset) const {
+    glState.bindVertexArray(vertexArray);
+    glState.bindBuffer(GL_ARRAY_BUFFER, modelBuffer);
+    for (unsigned int column = 0; column < 4; column++) {
+        glVertexAttribPointer(MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                              (void *) (modelOffset + column * sizeof(glm::vec4)));
+    }
+    glState.bindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+    for (unsigned int column = 0; column < 3; column++) {
+        glVertexAttribPointer(NORMAL_MATRIX_LOCATION + column, 3, GL_FLOAT, GL_FALSE, sizeof(glm::mat3),
+                              (void *) (normalOffset + column * sizeof(glm::vec3)));
+    }
+}
+
+void InstanceBuffer::attach(unsigned int VAO) {
+    vertexArray = VAO;
+    point(modelVBO, 0, normalVBO, 0);
+    for (unsigned int location = MODEL_LOCATION; location < NORMAL_MATRIX_LOCATION + 3; location++) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    glState.bindVertexArray(0);
+}
+
+void InstanceBuffer::upload(std::span<const glm::mat4> models, std::span<const glm::mat3> normalMatrices) {
+    bool grow = models.size() > capacity;
+    if (grow) {
+        capacity = static_cast<unsigned int>(models.size());
+    }
+    uploadInstanceData(modelVBO, capacity * sizeof(glm::mat4), grow, models.data(), models.size_bytes());
+    if (!normalMatrices.empty()) {
+        uploadInstanceData(normalVBO, capacity * sizeof(glm::mat3), grow, normalMatrices.data(),
+                           normalMatrices.size_bytes());
+    }
+    instances = static_cast<unsigned int>(models.size());
+    if (streaming) {
+        point(modelVBO, 0, normalVBO, 0);
+        streaming = false;
+    }
+}
+
+void InstanceBuffer::stream(UploadRing &ring, std::span<const glm::mat4> models,
+                            std::span<const glm::mat3> normalMatrices) {
+    if (models.empty()) {
+        instances = 0;
+        return;
+    }
+    const UploadRing::Allocation modelData = ring.upload(models.data(), models.size_bytes());
+    UploadRing::Allocation normalData;
+    if (!normalMatrices.empty()) {
+        normalData = ring.upload(normalMatrices.data(), normalMatrices.size_bytes());
+    }
+    if (!modelData.valid() || (!normalMatrices.empty() && !normalData.valid())) {
+        upload(models, normalMatrices);
+        return;
+    }
+    // without normal matrices the attributes keep reading the own buffer, like after upload()
+    point(ring.buffer(), modelData.offset, normalMatrices.empty() ? normalVBO : ring.buffer(), normalData.offset);
+    instances = static_cast<unsigned int>(models.size());
+    streaming = true;
+}
@@ -0,0 +1,51 @@
+#ifndef INSTANCEBUFFER_H
+#define INSTANCEBUFFER_H
+
+#include <span>
+#include <glm/glm.hpp>
+
+#include "UploadRing.h"
+
+// Per-instance model and normal matrices in dynamic vertex buffers. A mat4 attribute takes four consecutive
+// locations (one vec4 column each) and a mat3 three, all with divisor 1 so they advance once per instance.
+// Data that changes every frame can be streamed through the upload ring instead; the attributes then point at this
+// frame's copy in the ring, until the next upload() points them back at the own buffers.
+class InstanceBuffer {
+public:
+    static constexpr unsigned int MODEL_LOCATION = 3;
+    static constexpr unsigned int NORMAL_MATRIX_LOCATION = 7;
+
+    InstanceBuffer();
+
+    ~InstanceBuffer();
+
+    InstanceBuffer(const InstanceBuffer &) = delete;
+
+    InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+    // add the instance attributes to a VAO; the VAO's own per-vertex attributes are left untouched
+    void attach(unsigned int VAO);
+
+    // replace the instance data; the buffers are orphaned so an in-flight draw never stalls the upload.
+    // Normal matrices are optional, shaders that do no lighting never read them.
+    void upload(std::span<const glm::mat4> models, std::span<const glm::mat3> normalMatrices = {});
+
+    // copy the instance data into this frame's region of the ring; it has to be streamed again every frame the
+    // instances are drawn. Falls back to upload() when the ring is full.
+    void stream(UploadRing &ring, std::span<const glm::mat4> models, std::span<const glm::mat3> normalMatrices = {});
+
+    unsigned int count() const { return instances; }
+
+private:
+    unsigned int modelVBO = 0;
+    unsigned int normalVBO = 0;
+    unsigned int capacity = 0;
+    unsigned int instances = 0;
+    unsigned int vertexArray = 0;
+    bool streaming = false;
+
+    // point the attributes of the attached VAO at the data
+    void point(unsigned int modelBuffer, size_t modelOffset, unsigned int normalBuffer, size_t normalOffset) const;
+};
+
+#endif //INSTANCEBUFFER_H
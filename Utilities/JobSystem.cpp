@@ -0,0 +1,252 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+namespace {
+    // the system and queue of the calling thread; a thread belongs to at most one system at a time
+    thread_local const JobSystem *currentSystem = nullptr;
+    thread_local void *currentQueue = nullptr;
+
+    // rounds of looking for work before an idle worker goes to sleep
+    constexpr int IDLE_SPINS = 64;
+
+    static_assert((JobSystem::QUEUE_SIZE & (JobSystem::QUEUE_SIZE - 1)) == 0, "the deque index wraps with a mask");
+}
+
+// The deque follows Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models"
+// (2013), with a fixed ring instead of a growing one: push() fails when it is full and the caller runs the job itself.
+bool JobSystem::Queue::push(Job *job) {
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= static_cast<int64_t>(QUEUE_SIZE))
+        return false;
+    slots[b & (QUEUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+JobSystem::Job *JobSystem::Queue::pop() {
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Job *job = slots[b & (QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // the last job: race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+JobSystem::Job *JobSystem::Queue::steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+    Job *job = slots[t & (QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+    // losing the race to the owner or another thief is not worth a retry, the caller moves on to the next queue
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+unsigned int JobSystem::defaultWorkers() {
+    const unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+JobSystem::JobSystem(unsigned int workerCount) {
+    queues.reserve(workerCount + 1);
+    for (unsigned int i = 0; i <= workerCount; i++) {
+        queues.push_back(std::make_unique<Queue>());
+        queues.back()->index = i;
+    }
+    currentSystem = this;
+    currentQueue = queues[0].get();
+    workers.reserve(workerCount);
+    for (unsigned int i = 1; i <= workerCount; i++) {
+        workers.emplace_back(&JobSystem::work, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker: workers) {
+        worker.join();
+    }
+    if (currentSystem == this) {
+        currentSystem = nullptr;
+        currentQueue = nullptr;
+    }
+}
+
+JobSystem::Queue *JobSystem::localQueue() const {
+    return currentSystem == this ? static_cast<Queue *>(currentQueue) : nullptr;
+}
+
+size_t JobSystem::chunkSize(size_t count, size_t grain) const {
+    if (threadCount() == 1)
+        return count;
+    // a few chunks per thread, so threads that finish early have something left to steal
+    const size_t chunks = threadCount() * 4;
+    return std::max<size_t>({grain, (count + chunks - 1) / chunks, 1});
+}
+
+void JobSystem::submit(Function function, const void *task, size_t begin, size_t end, Counter &counter,
+                       Counter *dependency) {
+    counter.pending.fetch_add(1, std::memory_order_relaxed);
+    Queue *local = localQueue();
+    Job *job = nullptr;
+    if (local) {
+        job = &local->records[local->nextRecord++ & (QUEUE_SIZE - 1)];
+        // still in flight from QUEUE_SIZE submissions ago; running the new one right here is always correct
+        if (job->busy.load(std::memory_order_acquire)) {
+            job = nullptr;
+        }
+    }
+    if (!job) {
+        (local ? local : queues[0].get())->inlined.fetch_add(1, std::memory_order_relaxed);
+        while (dependency && !dependency->done()) {
+            std::this_thread::yield();
+        }
+        Job record{function, task, begin, end, &counter};
+        execute(&record);
+        return;
+    }
+
+    job->function = function;
+    job->task = task;
+    job->begin = begin;
+    job->end = end;
+    job->counter = &counter;
+    job->busy.store(true, std::memory_order_relaxed);
+    if (dependency) {
+        std::lock_guard lock(dependency->mutex);
+        if (dependency->pending.load(std::memory_order_acquire) > 0) {
+            // the job that brings the dependency to zero schedules it
+            dependency->waiting.push_back(job);
+            return;
+        }
+    }
+    schedule(job);
+}
+
+void JobSystem::schedule(Job *job) {
+    Queue *local = localQueue();
+    if (!local || !local->push(job)) {
+        (local ? local : queues[0].get())->inlined.fetch_add(1, std::memory_order_relaxed);
+        execute(job);
+        return;
+    }
+    pushes.fetch_add(1);
+    if (sleeping.load() > 0) {
+        std::lock_guard lock(sleepMutex);
+        wake.notify_one();
+    }
+}
+
+JobSystem::Job *JobSystem::next(Queue *local) {
+    if (Job *job = local->pop())
+        return job;
+    // start with the queue after our own, so the thieves spread out over the victims
+    const size_t count = queues.size();
+    for (size_t k = 1; k < count; k++) {
+        if (Job *job = queues[(local->index + k) % count]->steal()) {
+            local->stolen.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::execute(Job *job) {
+    job->function(job->task, job->begin, job->end);
+    Queue *local = localQueue();
+    (local ? local : queues[0].get())->jobs.fetch_add(1, std::memory_order_relaxed);
+
+    Counter *counter = job->counter;
+    // the record can be handed out again from here on
+    job->busy.store(false, std::memory_order_release);
+    std::vector<Job *> ready;
+    {
+        // counted down under the lock, so a job submitted against this counter either sees it pending and waits in
+        // the list, or sees it done and is scheduled right away
+        std::lock_guard lock(counter->mutex);
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ready.swap(counter->waiting);
+        }
+    }
+    for (Job *waiting: ready) {
+        schedule(waiting);
+    }
+}
+
+void JobSystem::wait(Counter &counter) {
+    Queue *local = localQueue();
+    while (!counter.done()) {
+        Job *job = local ? next(local) : nullptr;
+        if (job) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    // the last job counted down inside the counter's lock; once we get the lock it has let go of the counter, and the
+    // caller may destroy it
+    std::lock_guard lock(counter.mutex);
+}
+
+void JobSystem::work(unsigned int index) {
+    Queue *local = queues[index].get();
+    currentSystem = this;
+    currentQueue = local;
+    int idle = 0;
+    while (true) {
+        const uint64_t seen = pushes.load();
+        if (Job *job = next(local)) {
+            execute(job);
+            idle = 0;
+            continue;
+        }
+        if (stopping.load())
+            return;
+        if (++idle < IDLE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+        // anything pushed since seen was read wakes us, including a push that raced the search above
+        std::unique_lock lock(sleepMutex);
+        sleeping++;
+        wake.wait(lock, [&] { return stopping.load() || pushes.load() != seen; });
+        sleeping--;
+        idle = 0;
+    }
+}
+
+JobSystem::Stats JobSystem::stats() const {
+    Stats total;
+    total.threads = threadCount();
+    for (const auto &queue: queues) {
+        total.jobs += queue->jobs.load(std::memory_order_relaxed);
+        total.stolen += queue->stolen.load(std::memory_order_relaxed);
+        total.inlined += queue->inlined.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void JobSystem::Stats::print(std::ostream &out) const {
+    out << "Jobs: " << threads << " threads, " << jobs << " run, " << stolen << " stolen, " << inlined << " run inline" << std::endl;
+}
@@ -0,0 +1,170 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing scheduler for fine grained frame work. Every thread has a Chase-Lev deque: it pushes and pops its own
+// jobs at the bottom without locks, idle threads steal the oldest job from the top of someone else's. Jobs count down
+// a Counter when they finish; a job can wait for another counter before it starts, and wait() runs other jobs until
+// a counter reaches zero, so nested parallelFor calls inside jobs never block a thread.
+// The thread that creates the system (the GL thread) takes part in wait() as well; jobs submitted from any other
+// thread that is not one of the workers simply run right away on that thread.
+class JobSystem {
+    struct Job;
+
+public:
+    // deque slots and job records per thread; a thread can have at most this many unfinished jobs
+    static constexpr size_t QUEUE_SIZE = 4096;
+
+    // unfinished jobs, plus the jobs waiting for them to finish
+    class Counter {
+    public:
+        bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        std::atomic<uint32_t> pending{0};
+        std::mutex mutex;
+        std::vector<Job *> waiting;
+    };
+
+    struct Stats {
+        unsigned int threads = 0;
+        uint64_t jobs = 0;
+        uint64_t stolen = 0;
+        uint64_t inlined = 0; // run on the spot, because the queue was full or the thread has none
+
+        void print(std::ostream &out) const;
+    };
+
+    // one less than the cores: the GL thread is the last one
+    static unsigned int defaultWorkers();
+
+    explicit JobSystem(unsigned int workers = defaultWorkers());
+
+    // finishes the jobs already queued, then joins the workers
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // queue task(); it must stay alive until the counter says the job finished
+    template<typename Task>
+    void run(const Task &task, Counter &counter) {
+        submit(&call<Task>, &task, 0, 0, counter, nullptr);
+    }
+
+    // like run(), but the job only starts once dependency is done
+    template<typename Task>
+    void run(const Task &task, Counter &counter, Counter &dependency) {
+        submit(&call<Task>, &task, 0, 0, counter, &dependency);
+    }
+
+    // a temporary would be gone before the job runs
+    template<typename Task>
+    void run(const Task &&task, Counter &counter) = delete;
+
+    template<typename Task>
+    void run(const Task &&task, Counter &counter, Counter &dependency) = delete;
+
+    // run other jobs until the counter is zero
+    void wait(Counter &counter);
+
+    // body(begin, end) over [0, count) in chunks of at least grain items, spread over all threads; returns once every
+    // chunk is done
+    template<typename Body>
+    void parallelFor(size_t count, size_t grain, const Body &body) {
+        const size_t chunk = chunkSize(count, grain);
+        if (chunk >= count) {
+            if (count > 0) {
+                body(size_t(0), count);
+            }
+            return;
+        }
+        Counter counter;
+        for (size_t begin = 0; begin < count; begin += chunk) {
+            submit(&callRange<Body>, &body, begin, std::min(begin + chunk, count), counter, nullptr);
+        }
+        wait(counter);
+    }
+
+    // the workers plus the thread that waits
+    unsigned int threadCount() const { return static_cast<unsigned int>(queues.size()); }
+
+    Stats stats() const;
+
+private:
+    using Function = void (*)(const void *task, size_t begin, size_t end);
+
+    struct Job {
+        Function function;
+        const void *task;
+        size_t begin, end;
+        Counter *counter;
+        std::atomic<bool> busy{false};
+    };
+
+    // a Chase-Lev deque plus the job records its owner hands out; only the owner touches bottom and the records
+    struct Queue {
+        std::atomic<int64_t> top{0};
+        std::atomic<int64_t> bottom{0};
+        std::unique_ptr<std::atomic<Job *>[]> slots{new std::atomic<Job *>[QUEUE_SIZE]};
+        std::unique_ptr<Job[]> records{new Job[QUEUE_SIZE]};
+        size_t nextRecord = 0;
+        size_t index = 0;
+        std::atomic<uint64_t> jobs{0}, stolen{0}, inlined{0};
+
+        bool push(Job *job);
+
+        Job *pop();
+
+        Job *steal();
+    };
+
+    std::vector<std::unique_ptr<Queue> > queues; // 0 belongs to the creating thread
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping{false};
+
+    // idle workers sleep until something was pushed
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<uint64_t> pushes{0};
+    std::atomic<unsigned int> sleeping{0};
+
+    template<typename Task>
+    static void call(const void *task, size_t, size_t) {
+        (*static_cast<const Task *>(task))();
+    }
+
+    template<typename Body>
+    static void callRange(const void *body, size_t begin, size_t end) {
+        (*static_cast<const Body *>(body))(begin, end);
+    }
+
+    size_t chunkSize(size_t count, size_t grain) const;
+
+    // the calling thread's queue, nullptr for threads outside the system
+    Queue *localQueue() const;
+
+    void submit(Function function, const void *task, size_t begin, size_t end, Counter &counter,
+                Counter *dependency);
+
+    void schedule(Job *job);
+
+    // one job from the own queue, or stolen from another one
+    Job *next(Queue *local);
+
+    void execute(Job *job);
+
+    void work(unsigned int index);
+};
+
+#endif //JOBSYSTEM_H
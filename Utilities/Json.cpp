@@ -0,0 +1,252 @@
+#include "Json.h"
+
+#include <charconv>
+
+namespace {
+    const JsonValue NULL_VALUE;
+
+    void appendUtf8(std::string &out, unsigned int codePoint) {
+        if (codePoint < 0x80) {
+            out += static_cast<char>(codePoint);
+        } else if (codePoint < 0x800) {
+            out += static_cast<char>(0xc0 | codePoint >> 6);
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        } else if (codePoint < 0x10000) {
+            out += static_cast<char>(0xe0 | codePoint >> 12);
+            out += static_cast<char>(0x80 | (codePoint >> 6 & 0x3f));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | codePoint >> 18);
+            out += static_cast<char>(0x80 | (codePoint >> 12 & 0x3f));
+            out += static_cast<char>(0x80 | (codePoint >> 6 & 0x3f));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        }
+    }
+}
+
+// recursive descent over the text
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text) : text(text) {}
+
+    bool parseDocument(JsonValue &root, std::string &error) {
+        skipSpace();
+        if (!parseValue(root, 0)) {
+            error = message + " at byte " + std::to_string(position);
+            return false;
+        }
+        skipSpace();
+        if (position != text.size()) {
+            error = "trailing characters at byte " + std::to_string(position);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr int MAX_DEPTH = 256;
+
+    std::string_view text;
+    size_t position = 0;
+    std::string message;
+
+    bool fail(const char *what) {
+        message = what;
+        return false;
+    }
+
+    void skipSpace() {
+        while (position < text.size() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' ||
+                                          text[position] == '\r')) {
+            position++;
+        }
+    }
+
+    bool literal(std::string_view word) {
+        if (text.substr(position, word.size()) != word)
+            return fail("unexpected character");
+        position += word.size();
+        return true;
+    }
+
+    bool parseValue(JsonValue &value, int depth) {
+        if (depth > MAX_DEPTH)
+            return fail("nested too deeply");
+        if (position >= text.size())
+            return fail("unexpected end");
+        switch (text[position]) {
+            case '{':
+                return parseObject(value, depth);
+            case '[':
+                return parseArray(value, depth);
+            case '"':
+                value.kind = JsonValue::Type::String;
+                return parseString(value.text);
+            case 't':
+                value.kind = JsonValue::Type::Bool;
+                value.flag = true;
+                return literal("true");
+            case 'f':
+                value.kind = JsonValue::Type::Bool;
+                return literal("false");
+            case 'n':
+                return literal("null");
+            default:
+                return parseNumber(value);
+        }
+    }
+
+    bool parseObject(JsonValue &value, int depth) {
+        value.kind = JsonValue::Type::Object;
+        position++;
+        skipSpace();
+        if (position < text.size() && text[position] == '}') {
+            position++;
+            return true;
+        }
+        while (true) {
+            skipSpace();
+            if (position >= text.size() || text[position] != '"')
+                return fail("expected a key");
+            value.members.emplace_back();
+            if (!parseString(value.members.back().first))
+                return false;
+            skipSpace();
+            if (position >= text.size() || text[position] != ':')
+                return fail("expected ':'");
+            position++;
+            skipSpace();
+            if (!parseValue(value.members.back().second, depth + 1))
+                return false;
+            skipSpace();
+            if (position < text.size() && text[position] == ',') {
+                position++;
+                continue;
+            }
+            if (position < text.size() && text[position] == '}') {
+                position++;
+                return true;
+            }
+            return fail("expected ',' or '}'");
+        }
+    }
+
+    bool parseArray(JsonValue &value, int depth) {
+        value.kind = JsonValue::Type::Array;
+        position++;
+        skipSpace();
+        if (position < text.size() && text[position] == ']') {
+            position++;
+            return true;
+        }
+        while (true) {
+            skipSpace();
+            value.items.emplace_back();
+            if (!parseValue(value.items.back(), depth + 1))
+                return false;
+            skipSpace();
+            if (position < text.size() && text[position] == ',') {
+                position++;
+                continue;
+            }
+            if (position < text.size() && text[position] == ']') {
+                position++;
+                return true;
+            }
+            return fail("expected ',' or ']'");
+        }
+    }
+
+    bool parseHex(unsigned int &codePoint) {
+        if (position + 4 > text.size())
+            return fail("bad escape");
+        const char *begin = text.data() + position;
+        const auto [end, error] = std::from_chars(begin, begin + 4, codePoint, 16);
+        if (error != std::errc() || end != begin + 4)
+            return fail("bad escape");
+        position += 4;
+        return true;
+    }
+
+    bool parseString(std::string &out) {
+        position++;
+        while (position < text.size()) {
+            const char c = text[position++];
+            if (c == '"')
+                return true;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (position >= text.size())
+                break;
+            const char escaped = text[position++];
+            switch (escaped) {
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'n':
+                    out += '\n';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'u': {
+                    unsigned int codePoint;
+                    if (!parseHex(codePoint))
+                        return false;
+                    // a surrogate pair
+                    if (codePoint >= 0xd800 && codePoint < 0xdc00 && text.substr(position, 2) == "\\u") {
+                        position += 2;
+                        unsigned int low;
+                        if (!parseHex(low))
+                            return false;
+                        codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    appendUtf8(out, codePoint);
+                    break;
+                }
+                default:
+                    out += escaped;
+            }
+        }
+        return fail("unterminated string");
+    }
+
+    bool parseNumber(JsonValue &value) {
+        const char *begin = text.data() + position;
+        const char *end = text.data() + text.size();
+        // from_chars takes no leading '+', and JSON has none either
+        const auto [last, error] = std::from_chars(begin, end, value.value);
+        if (error != std::errc() || last == begin)
+            return fail("unexpected character");
+        value.kind = JsonValue::Type::Number;
+        position += static_cast<size_t>(last - begin);
+        return true;
+    }
+};
+
+bool JsonValue::parse(std::string_view text, JsonValue &root, std::string &error) {
+    root = JsonValue();
+    return JsonParser(text).parseDocument(root, error);
+}
+
+const JsonValue &JsonValue::operator[](size_t index) const {
+    return kind == Type::Array && index < items.size() ? items[index] : NULL_VALUE;
+}
+
+const JsonValue &JsonValue::operator[](std::string_view key) const {
+    if (kind != Type::Object)
+        return NULL_VALUE;
+    for (const auto &[name, member]: members) {
+        if (name == key)
+            return member;
+    }
+    return NULL_VALUE;
+}
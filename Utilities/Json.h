@@ -0,0 +1,51 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A small JSON document model, enough for the scene descriptions of model formats. Values are read only; looking up
+// a key or an index that is not there gives a null value instead of failing, so optional fields read as
+// value["key"].number(default).
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    // parse text into root; on failure error says where
+    static bool parse(std::string_view text, JsonValue &root, std::string &error);
+
+    Type type() const { return kind; }
+
+    bool isNull() const { return kind == Type::Null; }
+
+    bool boolean(bool fallback = false) const { return kind == Type::Bool ? flag : fallback; }
+
+    double number(double fallback = 0.0) const { return kind == Type::Number ? value : fallback; }
+
+    // empty unless a string
+    const std::string &string() const { return text; }
+
+    // elements of an array or members of an object
+    size_t size() const { return kind == Type::Object ? members.size() : items.size(); }
+
+    const JsonValue &operator[](size_t index) const;
+
+    const JsonValue &operator[](std::string_view key) const;
+
+    bool has(std::string_view key) const { return !(*this)[key].isNull(); }
+
+private:
+    Type kind = Type::Null;
+    bool flag = false;
+    double value = 0.0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue> > members;
+
+    friend class JsonParser;
+};
+
+#endif //JSON_H
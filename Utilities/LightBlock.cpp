@@ -0,0 +1,80 @@
+#include "LightBlock.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+#include "GLStats.h"
+
+LightBlock::LightBlock() {
+    glGenBuffers(1, &UBO);
+    glState.bindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlockData), nullptr, GL_DYNAMIC_DRAW);
+    glState.bindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+}
+
+LightBlock::~LightBlock() {
+    glState.deleteBuffers(1, &UBO);
+}
+
+void LightBlock::bind(unsigned int program) {
+    unsigned int index = glGetUniformBlockIndex(program, "Lights");
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, index, BINDING);
+    }
+}
+
+template<typename T>
+void LightBlock::assign(T &target, const T &value) {
+    // the structs are plain floats with explicit padding, so a byte compare is exact
+    if (std::memcmp(&target, &value, sizeof(T)) != 0) {
+        target = value;
+        size_t offset = reinterpret_cast<const char *>(&target) - reinterpret_cast<const char *>(&block);
+        dirtyBegin = std::min(dirtyBegin, offset);
+        dirtyEnd = std::max(dirtyEnd, offset + sizeof(T));
+        changed = true;
+    }
+}
+
+void LightBlock::setDirLight(const DirLight &light) {
+    assign(block.dirLight, light);
+}
+
+void LightBlock::setPointLight(unsigned int index, const PointLight &light) {
+    if (index < MAX_POINT_LIGHTS) {
+        assign(block.pointLights[index], light);
+    }
+}
+
+void LightBlock::setSpotLight(const SpotLight &light) {
+    assign(block.spotLight, light);
+}
+
+void LightBlock::upload(UploadRing &ring) {
+    if (changed) {
+        changed = false;
+        const UploadRing::Allocation allocation = ring.upload(&block, sizeof(LightBlockData), ring.uniformAlignment());
+        if (allocation.valid()) {
+            glState.bindBufferRange(GL_UNIFORM_BUFFER, BINDING, ring.buffer(), allocation.offset,
+                                    sizeof(LightBlockData));
+            boundToUBO = false;
+            return;
+        }
+    }
+    // unchanged since the last frame (or the ring is full): the block lives in our own buffer, which only needs the
+    // bytes that changed since it was last written
+    if (dirtyBegin < dirtyEnd) {
+        glState.bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, dirtyBegin, dirtyEnd - dirtyBegin,
+                        reinterpret_cast<const char *>(&block) + dirtyBegin);
+        ++glStats.bufferUploads;
+        dirtyBegin = sizeof(LightBlockData);
+        dirtyEnd = 0;
+    }
+    if (!boundToUBO) {
+        glState.bindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+        boundToUBO = true;
+    }
+}
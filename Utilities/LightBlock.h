@@ -0,0 +1,128 @@
+#ifndef LIGHTBLOCK_H
+#define LIGHTBLOCK_H
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "UploadRing.h"
+
+// capacity of the buffer; each shader variant declares only the NR_POINT_LIGHTS it actually shades
+#define MAX_POINT_LIGHTS 64
+
+// C++ mirrors of the light structs in the std140 "Lights" block of Shaders/diffuse/lights.glsl.
+// vec3 members are 16 byte aligned in std140, so every vec3 is followed by a float or explicit padding.
+struct DirLight {
+    glm::vec3 direction;
+    float pad0;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+struct PointLight {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 ambient;
+    float linear;
+    glm::vec3 diffuse;
+    float quadratic;
+    glm::vec3 specular;
+    float pad0;
+};
+
+struct SpotLight {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 direction;
+    float linear;
+    glm::vec3 ambient;
+    float quadratic;
+    glm::vec3 diffuse;
+    float cutOff;
+    glm::vec3 specular;
+    float outerCutOff;
+};
+
+struct LightBlockData {
+    DirLight dirLight;
+    SpotLight spotLight;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+};
+
+static_assert(offsetof(DirLight, ambient) == 16);
+static_assert(offsetof(DirLight, diffuse) == 32);
+static_assert(offsetof(DirLight, specular) == 48);
+static_assert(sizeof(DirLight) == 64);
+
+static_assert(offsetof(PointLight, constant) == 12);
+static_assert(offsetof(PointLight, ambient) == 16);
+static_assert(offsetof(PointLight, linear) == 28);
+static_assert(offsetof(PointLight, diffuse) == 32);
+static_assert(offsetof(PointLight, quadratic) == 44);
+static_assert(offsetof(PointLight, specular) == 48);
+static_assert(sizeof(PointLight) == 64);
+
+static_assert(offsetof(SpotLight, constant) == 12);
+static_assert(offsetof(SpotLight, direction) == 16);
+static_assert(offsetof(SpotLight, linear) == 28);
+static_assert(offsetof(SpotLight, ambient) == 32);
+static_assert(offsetof(SpotLight, quadratic) == 44);
+static_assert(offsetof(SpotLight, diffuse) == 48);
+static_assert(offsetof(SpotLight, cutOff) == 60);
+static_assert(offsetof(SpotLight, specular) == 64);
+static_assert(offsetof(SpotLight, outerCutOff) == 76);
+static_assert(sizeof(SpotLight) == 80);
+
+static_assert(offsetof(LightBlockData, spotLight) == 64);
+static_assert(offsetof(LightBlockData, pointLights) == 144);
+static_assert(sizeof(LightBlockData) == 144 + MAX_POINT_LIGHTS * 64);
+
+// The data behind the "Lights" block. Setters only touch the CPU copy and widen the dirty byte range when a value
+// actually changed. In a frame where something changed, upload() copies the block into this frame's region of the
+// upload ring and binds that range, which costs one memcpy instead of a glBufferSubData into a buffer the previous
+// frame may still be reading. Once nothing changes, the block is bound from a uniform buffer of its own, which is
+// brought up to date with one glBufferSubData of the dirty range; the same happens when the ring is full.
+class LightBlock {
+public:
+    static constexpr unsigned int BINDING = 0;
+
+    LightBlock();
+
+    ~LightBlock();
+
+    LightBlock(const LightBlock &) = delete;
+
+    LightBlock &operator=(const LightBlock &) = delete;
+
+    // point the shader's "Lights" block at our binding; shaders without the block are ignored
+    static void bind(unsigned int program);
+
+    void setDirLight(const DirLight &light);
+
+    void setPointLight(unsigned int index, const PointLight &light);
+
+    void setSpotLight(const SpotLight &light);
+
+    const LightBlockData &data() const { return block; }
+
+    // once per frame, between the ring's beginFrame() and flush()
+    void upload(UploadRing &ring);
+
+private:
+    unsigned int UBO = 0;
+    LightBlockData block{};
+    // bytes of the block that UBO does not hold yet
+    size_t dirtyBegin = 0;
+    size_t dirtyEnd = sizeof(LightBlockData);
+    // something changed since the last upload()
+    bool changed = true;
+    bool boundToUBO = true;
+
+    template<typename T>
+    void assign(T &target, const T &value);
+};
+
+#endif //LIGHTBLOCK_H
@@ -0,0 +1,290 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <glm/simd/geometric.h>
+
+#include "GLStateCache.h"
+#include "GLStats.h"
+#include "Profiler.h"
+
+namespace {
+    // lights are binned up to the point where they have faded to this fraction of their brightest channel
+    constexpr float CUTOFF = 5.0f / 256.0f;
+
+    enum Buffer { LIGHT_DATA, GRID, INDEX };
+
+    constexpr GLenum FORMATS[3] = {GL_RGBA32F, GL_RG32UI, GL_R16UI};
+    constexpr int UNITS[3] = {LightClusters::LIGHT_DATA_UNIT, LightClusters::GRID_UNIT, LightClusters::INDEX_UNIT};
+
+    void uploadTextureBuffer(unsigned int buffer, size_t size, const void *data) {
+        glState.bindBuffer(GL_TEXTURE_BUFFER, buffer);
+        // a fresh store every time, so the driver never waits for last frame's reads
+        glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(size, 4)), data, GL_STREAM_DRAW);
+        ++glStats.bufferUploads;
+    }
+}
+
+LightClusters::LightClusters(JobSystem &jobs)
+    : jobs(jobs), sliceTotals(CLUSTER_Z), grid(CLUSTER_COUNT * 2) {
+    glGenBuffers(3, buffers);
+    glGenTextures(3, textures);
+    for (int i = 0; i < 3; i++) {
+        uploadTextureBuffer(buffers[i], 0, nullptr);
+        glState.bindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, FORMATS[i], buffers[i]);
+    }
+    glState.bindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+LightClusters::~LightClusters() {
+    glState.deleteTextures(3, textures);
+    glState.deleteBuffers(3, buffers);
+}
+
+float LightClusters::lightRadius(const PointLight &light) {
+    float brightest = std::max({light.diffuse.r, light.diffuse.g, light.diffuse.b,
+                                light.specular.r, light.specular.g, light.specular.b});
+    // solve brightest / (constant + linear * d + quadratic * d^2) = CUTOFF for d
+    float c = light.constant - brightest / CUTOFF;
+    if (c >= 0.0f)
+        return 0.0f;
+    if (light.quadratic > 0.0f) {
+        return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) /
+               (2.0f * light.quadratic);
+    }
+    if (light.linear > 0.0f)
+        return -c / light.linear;
+    return INFINITY;
+}
+
+void LightClusters::addDefines(ShaderDefines &defines) {
+    defines.set("NR_POINT_LIGHTS", 0);
+    defines.set("CLUSTER_X", static_cast<int>(CLUSTER_X));
+    defines.set("CLUSTER_Y", static_cast<int>(CLUSTER_Y));
+    defines.set("CLUSTER_Z", static_cast<int>(CLUSTER_Z));
+}
+
+void LightClusters::setLights(std::span<const PointLight> lights) {
+    lightCount = static_cast<unsigned int>(std::min<size_t>(lights.size(), MAX_LIGHTS));
+    size_t padded = (lightCount + 3) & ~size_t(3);
+    centerX.assign(padded, 0.0f);
+    centerY.assign(padded, 0.0f);
+    centerZ.assign(padded, 0.0f);
+    radius.assign(padded, 0.0f);
+    bounds.resize(padded);
+    for (unsigned int i = 0; i < lightCount; i++) {
+        centerX[i] = lights[i].position.x;
+        centerY[i] = lights[i].position.y;
+        centerZ[i] = lights[i].position.z;
+        radius[i] = lightRadius(lights[i]);
+    }
+    uploadTextureBuffer(buffers[LIGHT_DATA], lightCount * sizeof(PointLight), lights.data());
+}
+
+glm::vec2 LightClusters::tileScale(unsigned int width, unsigned int height) {
+    return {static_cast<float>(CLUSTER_X) / width, static_cast<float>(CLUSTER_Y) / height};
+}
+
+unsigned int LightClusters::slice(float depth) const {
+    int z = static_cast<int>(std::floor(std::log(depth) * sliceScale + sliceBias));
+    return static_cast<unsigned int>(std::clamp(z, 0, static_cast<int>(CLUSTER_Z) - 1));
+}
+
+void LightClusters::bin(const glm::mat4 &view, float fovY, float aspect, float near, float far) {
+    PROFILE_SCOPE("light binning");
+    auto start = std::chrono::steady_clock::now();
+
+    nearPlane = near;
+    farPlane = far;
+    sliceScale = CLUSTER_Z / std::log(far / near);
+    sliceBias = -std::log(near) * sliceScale;
+    float tanY = std::tan(fovY * 0.5f);
+    float tanX = tanY * aspect;
+    for (unsigned int i = 0; i <= CLUSTER_X; i++) {
+        float slope = (-1.0f + 2.0f * i / CLUSTER_X) * tanX;
+        planesX[i] = {slope, 1.0f / std::sqrt(1.0f + slope * slope)};
+    }
+    for (unsigned int i = 0; i <= CLUSTER_Y; i++) {
+        float slope = (-1.0f + 2.0f * i / CLUSTER_Y) * tanY;
+        planesY[i] = {slope, 1.0f / std::sqrt(1.0f + slope * slope)};
+    }
+
+    // phase 1: the cluster range of every light, in chunks of whole SIMD groups
+    jobs.parallelFor(bounds.size() / 4, 16, [&](size_t begin, size_t end) {
+        computeBounds(begin * 4, end * 4, view);
+    });
+
+    visible.clear();
+    for (unsigned int i = 0; i < lightCount; i++) {
+        if (bounds[i].minZ <= bounds[i].maxZ) {
+            visible.push_back(static_cast<uint16_t>(i));
+        }
+    }
+
+    // phase 2: every z slice counts its lists on its own, so no two tasks ever write the same cluster
+    jobs.parallelFor(CLUSTER_Z, 1, [this](size_t begin, size_t end) {
+        for (size_t z = begin; z < end; z++) {
+            countSlice(static_cast<unsigned int>(z));
+        }
+    });
+    uint32_t total = 0;
+    std::vector<uint32_t> sliceBase(CLUSTER_Z);
+    for (unsigned int z = 0; z < CLUSTER_Z; z++) {
+        sliceBase[z] = total;
+        total += sliceTotals[z];
+    }
+    indices.resize(total);
+    jobs.parallelFor(CLUSTER_Z, 1, [&](size_t begin, size_t end) {
+        for (size_t z = begin; z < end; z++) {
+            fillSlice(static_cast<unsigned int>(z), sliceBase[z]);
+        }
+    });
+
+    counters.frames++;
+    counters.indices += total;
+    counters.visibleLights += visible.size();
+    for (size_t c = 0; c < CLUSTER_COUNT; c++) {
+        counters.maxPerCluster = std::max(counters.maxPerCluster, grid[c * 2 + 1]);
+    }
+    counters.binSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void LightClusters::upload() {
+    // a texture buffer view of the upload ring would save the orphaning, but llvmpipe samples such a view about a
+    // hundred times slower than a buffer of its own
+    uploadTextureBuffer(buffers[GRID], grid.size() * sizeof(uint32_t), grid.data());
+    uploadTextureBuffer(buffers[INDEX], indices.size() * sizeof(uint16_t), indices.data());
+}
+
+void LightClusters::computeBounds(size_t begin, size_t end, const glm::mat4 &view) {
+    const glm::mat4 &m = view;
+    for (size_t i = begin; i < end; i += 4) {
+        float vz[4];
+        int right[4], left[4], above[4], below[4];
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        glm_vec4 x = _mm_loadu_ps(&centerX[i]);
+        glm_vec4 y = _mm_loadu_ps(&centerY[i]);
+        glm_vec4 z = _mm_loadu_ps(&centerZ[i]);
+        glm_vec4 r = _mm_loadu_ps(&radius[i]);
+        glm_vec4 negR = _mm_sub_ps(_mm_setzero_ps(), r);
+        auto row = [&](int k) {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][k]), x), _mm_mul_ps(_mm_set1_ps(m[1][k]), y)),
+                              _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][k]), z), _mm_set1_ps(m[3][k])));
+        };
+        glm_vec4 px = row(0);
+        glm_vec4 py = row(1);
+        glm_vec4 pz = row(2);
+        _mm_storeu_ps(vz, pz);
+
+        // count the planes each sphere lies entirely beyond; compare masks are -1, so subtracting them counts
+        auto countPlanes = [&](glm_vec4 p, const TilePlane *planes, unsigned int tiles, int *after, int *before) {
+            __m128i entirelyAfter = _mm_setzero_si128();
+            __m128i entirelyBefore = _mm_setzero_si128();
+            for (unsigned int j = 0; j <= tiles; j++) {
+                glm_vec4 d = _mm_mul_ps(_mm_add_ps(p, _mm_mul_ps(pz, _mm_set1_ps(planes[j].slope))),
+                                        _mm_set1_ps(planes[j].invLength));
+                if (j > 0)
+                    entirelyAfter = _mm_sub_epi32(entirelyAfter, _mm_castps_si128(_mm_cmpge_ps(d, r)));
+                if (j < tiles)
+                    entirelyBefore = _mm_sub_epi32(entirelyBefore, _mm_castps_si128(_mm_cmple_ps(d, negR)));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(after), entirelyAfter);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(before), entirelyBefore);
+        };
+        countPlanes(px, planesX, CLUSTER_X, right, left);
+        countPlanes(py, planesY, CLUSTER_Y, above, below);
+#else
+        for (int k = 0; k < 4; k++) {
+            glm::vec3 p = glm::vec3(m * glm::vec4(centerX[i + k], centerY[i + k], centerZ[i + k], 1.0f));
+            float r = radius[i + k];
+            vz[k] = p.z;
+            right[k] = left[k] = above[k] = below[k] = 0;
+            for (unsigned int j = 0; j <= CLUSTER_X; j++) {
+                float d = (p.x + p.z * planesX[j].slope) * planesX[j].invLength;
+                right[k] += j > 0 && d >= r;
+                left[k] += j < CLUSTER_X && d <= -r;
+            }
+            for (unsigned int j = 0; j <= CLUSTER_Y; j++) {
+                float d = (p.y + p.z * planesY[j].slope) * planesY[j].invLength;
+                above[k] += j > 0 && d >= r;
+                below[k] += j < CLUSTER_Y && d <= -r;
+            }
+        }
+#endif
+        for (size_t k = 0; k < 4 && i + k < lightCount; k++) {
+            float depth = -vz[k];
+            float r = radius[i + k];
+            int minX = right[k], maxX = static_cast<int>(CLUSTER_X) - 1 - left[k];
+            int minY = above[k], maxY = static_cast<int>(CLUSTER_Y) - 1 - below[k];
+            Bounds b{1, 0, 1, 0, 1, 0};
+            if (minX <= maxX && minY <= maxY && depth + r > nearPlane && depth - r < farPlane) {
+                b.minX = static_cast<uint8_t>(minX);
+                b.maxX = static_cast<uint8_t>(maxX);
+                b.minY = static_cast<uint8_t>(minY);
+                b.maxY = static_cast<uint8_t>(maxY);
+                b.minZ = static_cast<uint8_t>(slice(std::max(depth - r, nearPlane)));
+                b.maxZ = static_cast<uint8_t>(slice(std::min(depth + r, farPlane)));
+            }
+            bounds[i + k] = b;
+        }
+    }
+}
+
+void LightClusters::countSlice(unsigned int z) {
+    uint32_t *cells = &grid[z * CLUSTER_X * CLUSTER_Y * 2];
+    for (unsigned int c = 0; c < CLUSTER_X * CLUSTER_Y; c++) {
+        cells[c * 2 + 1] = 0;
+    }
+    uint32_t total = 0;
+    for (uint16_t l: visible) {
+        const Bounds &b = bounds[l];
+        if (z < b.minZ || z > b.maxZ)
+            continue;
+        for (unsigned int y = b.minY; y <= b.maxY; y++) {
+            for (unsigned int x = b.minX; x <= b.maxX; x++) {
+                cells[(y * CLUSTER_X + x) * 2 + 1]++;
+            }
+        }
+        total += (b.maxY - b.minY + 1) * (b.maxX - b.minX + 1);
+    }
+    sliceTotals[z] = total;
+}
+
+void LightClusters::fillSlice(unsigned int z, uint32_t base) {
+    uint32_t *cells = &grid[z * CLUSTER_X * CLUSTER_Y * 2];
+    uint32_t cursor[CLUSTER_X * CLUSTER_Y];
+    for (unsigned int c = 0; c < CLUSTER_X * CLUSTER_Y; c++) {
+        cells[c * 2] = base;
+        cursor[c] = base;
+        base += cells[c * 2 + 1];
+    }
+    // lights go in ascending index order, so the shading order and with it the image is deterministic
+    for (uint16_t l: visible) {
+        const Bounds &b = bounds[l];
+        if (z < b.minZ || z > b.maxZ)
+            continue;
+        for (unsigned int y = b.minY; y <= b.maxY; y++) {
+            for (unsigned int x = b.minX; x <= b.maxX; x++) {
+                indices[cursor[y * CLUSTER_X + x]++] = l;
+            }
+        }
+    }
+}
+
+void LightClusters::bind() const {
+    for (int i = 0; i < 3; i++) {
+        glState.bindTexture(UNITS[i], GL_TEXTURE_BUFFER, textures[i]);
+    }
+}
+
+void LightClusters::Stats::print(std::ostream &out) const {
+    if (frames == 0)
+        return;
+    out << "Light clusters: " << static_cast<double>(visibleLights) / frames << " visible lights, "
+        << static_cast<double>(indices) / frames << " list entries per frame (max " << maxPerCluster
+        << " per cluster), binning " << binSeconds * 1000.0 / frames << " ms per frame" << std::endl;
+}
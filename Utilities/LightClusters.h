@@ -0,0 +1,121 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "LightBlock.h"
+#include "ShaderPreprocessor.h"
+#include "JobSystem.h"
+
+// Light binning for clustered forward shading. The view frustum is cut into CLUSTER_X * CLUSTER_Y screen tiles and
+// CLUSTER_Z slices that grow exponentially with depth. Every frame bin() finds the clusters each light sphere
+// touches, on the CPU and spread over the job system, and upload() puts the per cluster light lists into texture
+// buffers that clusters.glsl reads. The cost per fragment then depends on the lights near it, not on the total.
+class LightClusters {
+public:
+    static constexpr unsigned int CLUSTER_X = 16;
+    static constexpr unsigned int CLUSTER_Y = 9;
+    static constexpr unsigned int CLUSTER_Z = 24;
+    static constexpr unsigned int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+    // light indices are stored as 16 bit
+    static constexpr unsigned int MAX_LIGHTS = 16384;
+
+    // texture units of the buffers; 0 and 1 are the material maps
+    static constexpr int LIGHT_DATA_UNIT = 2;
+    static constexpr int GRID_UNIT = 3;
+    static constexpr int INDEX_UNIT = 4;
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t visibleLights = 0; // summed over all frames
+        uint64_t indices = 0; // summed over all frames
+        unsigned int maxPerCluster = 0;
+        double binSeconds = 0.0;
+
+        void print(std::ostream &out) const;
+    };
+
+    // the job system must outlive the clusters
+    explicit LightClusters(JobSystem &jobs);
+
+    ~LightClusters();
+
+    LightClusters(const LightClusters &) = delete;
+
+    LightClusters &operator=(const LightClusters &) = delete;
+
+    // distance at which the attenuation has brought the light's brightest channel down to 5/256
+    static float lightRadius(const PointLight &light);
+
+    // the defines a clustered shader variant is compiled with
+    static void addDefines(ShaderDefines &defines);
+
+    // GL thread: replace the scene lights (at most MAX_LIGHTS) and upload them
+    void setLights(std::span<const PointLight> lights);
+
+    // any thread, once per frame and no GL: bin the lights into the clusters of this camera
+    void bin(const glm::mat4 &view, float fovY, float aspect, float near, float far);
+
+    // GL thread, after bin(): upload the cluster lists
+    void upload();
+
+    // GL thread: bind the three texture buffers to their units
+    void bind() const;
+
+    // shader uniforms: clusters per pixel, and the log(depth) -> slice mapping of the last bin()
+    static glm::vec2 tileScale(unsigned int width, unsigned int height);
+
+    glm::vec2 depthScale() const { return {sliceScale, sliceBias}; }
+
+    const Stats &stats() const { return counters; }
+
+private:
+    // cluster range a light touches; empty when minZ > maxZ
+    struct Bounds {
+        uint8_t minX, maxX, minY, maxY, minZ, maxZ;
+    };
+
+    // a side plane of the tile grid through the eye: x (or y) = -z * slope, normalized by invLength
+    struct TilePlane {
+        float slope;
+        float invLength;
+    };
+
+    JobSystem &jobs;
+
+    // world space light spheres as SoA, padded to a multiple of 4 so the SIMD loop needs no tail
+    std::vector<float> centerX, centerY, centerZ, radius;
+    unsigned int lightCount = 0;
+
+    std::vector<Bounds> bounds;
+    std::vector<uint16_t> visible; // lights with a non-empty cluster range, ascending
+    std::vector<uint32_t> sliceTotals; // light indices per z slice
+    std::vector<uint32_t> grid; // per cluster: offset into indices, count
+    std::vector<uint16_t> indices;
+
+    TilePlane planesX[CLUSTER_X + 1];
+    TilePlane planesY[CLUSTER_Y + 1];
+    float sliceScale = 0.0f;
+    float sliceBias = 0.0f;
+    float nearPlane = 0.1f;
+    float farPlane = 100.0f;
+
+    unsigned int buffers[3] = {};
+    unsigned int textures[3] = {};
+    Stats counters;
+
+    void computeBounds(size_t begin, size_t end, const glm::mat4 &view);
+
+    unsigned int slice(float depth) const;
+
+    void countSlice(unsigned int z);
+
+    void fillSlice(unsigned int z, uint32_t base);
+};
+
+#endif //LIGHTCLUSTERS_H
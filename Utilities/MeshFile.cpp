@@ -0,0 +1,226 @@
+#include "MeshFile.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MESH_FILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    size_t aligned(size_t offset) {
+        return (offset + MeshFile::ALIGNMENT - 1) / MeshFile::ALIGNMENT * MeshFile::ALIGNMENT;
+    }
+
+    void writeZeros(std::ofstream &file, size_t count) {
+        static const char zeros[MeshFile::ALIGNMENT] = {};
+        file.write(zeros, static_cast<std::streamsize>(count));
+    }
+
+    glm::vec3 readVec3(const float *values) {
+        return {values[0], values[1], values[2]};
+    }
+
+    void writeVec3(float *values, const glm::vec3 &v) {
+        values[0] = v.x;
+        values[1] = v.y;
+        values[2] = v.z;
+    }
+}
+
+bool MeshFile::write(const std::string &path, const QuantizedMesh &mesh) {
+    const std::span<const VertexLayout::Attribute> attributes = mesh.layout.attributes();
+    if (attributes.size() > MAX_ATTRIBUTES) {
+        std::cout << "ERROR::MESH_FILE::TOO_MANY_ATTRIBUTES " << attributes.size() << std::endl;
+        return false;
+    }
+    Header header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.vertexCount = static_cast<uint32_t>(mesh.vertexCount());
+    header.vertexStride = mesh.layout.stride();
+    header.vertexOffset = aligned(sizeof(Header));
+    header.indexOffset = aligned(header.vertexOffset + mesh.vertices.size());
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    header.attributeCount = static_cast<uint32_t>(attributes.size());
+    for (size_t i = 0; i < attributes.size(); i++) {
+        header.attributes[i] = {static_cast<uint8_t>(attributes[i].location),
+                                static_cast<uint8_t>(attributes[i].format),
+                                static_cast<uint16_t>(attributes[i].offset)};
+    }
+    writeVec3(header.boundsMin, mesh.boundsMin);
+    writeVec3(header.boundsMax, mesh.boundsMax);
+    writeVec3(header.positionOffset, mesh.positionOffset);
+    writeVec3(header.positionScale, mesh.positionScale);
+
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        writeZeros(file, header.vertexOffset - sizeof(header));
+        file.write(reinterpret_cast<const char *>(mesh.vertices.data()),
+                   static_cast<std::streamsize>(mesh.vertices.size()));
+        writeZeros(file, header.indexOffset - header.vertexOffset - mesh.vertices.size());
+        file.write(reinterpret_cast<const char *>(mesh.indices.data()),
+                   static_cast<std::streamsize>(mesh.indices.size() * sizeof(unsigned int)));
+        if (!file) {
+            std::cout << "ERROR::MESH_FILE::WRITE_FAILED " << temporary << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::cout << "ERROR::MESH_FILE::WRITE_FAILED " << path << ": " << error.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+MeshFile::~MeshFile() {
+    close();
+}
+
+bool MeshFile::open(const std::string &path) {
+    close();
+#ifdef MESH_FILE_MMAP
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        std::cout << "ERROR::MESH_FILE::NOT_FOUND " << path << std::endl;
+        return false;
+    }
+    struct stat status{};
+    if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+        size = static_cast<size_t>(status.st_size);
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapping != MAP_FAILED) {
+            data = static_cast<const unsigned char *>(mapping);
+            mapped = true;
+            // read once, front to back, by the upload
+            madvise(mapping, size, MADV_SEQUENTIAL);
+        }
+    }
+    // the mapping keeps the file alive
+    ::close(descriptor);
+    if (!data) {
+        size = 0;
+        std::cout << "ERROR::MESH_FILE::MAP_FAILED " << path << std::endl;
+        return false;
+    }
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cout << "ERROR::MESH_FILE::NOT_FOUND " << path << std::endl;
+        return false;
+    }
+    contents.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(contents.data()), static_cast<std::streamsize>(contents.size()));
+    if (!file || contents.empty()) {
+        std::cout << "ERROR::MESH_FILE::READ_FAILED " << path << std::endl;
+        contents.clear();
+        return false;
+    }
+    data = contents.data();
+    size = contents.size();
+#endif
+    if (!validate(path)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MeshFile::validate(const std::string &path) {
+    if (size < sizeof(Header) || header().magic != MAGIC) {
+        std::cout << "ERROR::MESH_FILE::NOT_A_MESH " << path << std::endl;
+        return false;
+    }
+    const Header &h = header();
+    if (h.version != VERSION) {
+        std::cout << "ERROR::MESH_FILE::VERSION " << path << ": " << h.version << ", expected " << VERSION << std::endl;
+        return false;
+    }
+    const uint64_t vertexBytes = uint64_t(h.vertexCount) * h.vertexStride;
+    const uint64_t indexBytes = uint64_t(h.indexCount) * sizeof(unsigned int);
+    // every bound is checked as a difference, so offsets near 2^64 cannot wrap around and pass
+    if (h.vertexOffset % ALIGNMENT != 0 || h.indexOffset % ALIGNMENT != 0 || h.vertexOffset < sizeof(Header) ||
+        h.indexOffset > size || h.vertexOffset > h.indexOffset || vertexBytes > h.indexOffset - h.vertexOffset ||
+        indexBytes > size - h.indexOffset || h.attributeCount > MAX_ATTRIBUTES) {
+        std::cout << "ERROR::MESH_FILE::CORRUPT " << path << std::endl;
+        return false;
+    }
+    // the layout is rebuilt from the formats and has to come out the same as the one written
+    vertexLayout = VertexLayout();
+    for (uint32_t i = 0; i < h.attributeCount; i++) {
+        const Attribute &attribute = h.attributes[i];
+        if (attribute.format > static_cast<uint8_t>(VertexFormat::Snorm10x3)) {
+            std::cout << "ERROR::MESH_FILE::UNKNOWN_FORMAT " << path << ": " << int(attribute.format) << std::endl;
+            return false;
+        }
+        vertexLayout.add(attribute.location, static_cast<VertexFormat>(attribute.format));
+        if (vertexLayout.attributes().back().offset != attribute.offset) {
+            std::cout << "ERROR::MESH_FILE::CORRUPT " << path << ": attribute " << i << " offset" << std::endl;
+            return false;
+        }
+    }
+    if (vertexLayout.stride() != h.vertexStride) {
+        std::cout << "ERROR::MESH_FILE::CORRUPT " << path << ": stride " << h.vertexStride << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void MeshFile::close() {
+#ifdef MESH_FILE_MMAP
+    if (mapped) {
+        munmap(const_cast<unsigned char *>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    contents = {};
+    vertexLayout = VertexLayout();
+}
+
+std::span<const unsigned char> MeshFile::vertices() const {
+    if (!data)
+        return {};
+    const Header &h = header();
+    return {data + h.vertexOffset, size_t(h.vertexCount) * h.vertexStride};
+}
+
+std::span<const unsigned int> MeshFile::indices() const {
+    if (!data)
+        return {};
+    const Header &h = header();
+    return {reinterpret_cast<const unsigned int *>(data + h.indexOffset), h.indexCount};
+}
+
+glm::vec3 MeshFile::boundsMin() const {
+    return readVec3(header().boundsMin);
+}
+
+glm::vec3 MeshFile::boundsMax() const {
+    return readVec3(header().boundsMax);
+}
+
+glm::vec3 MeshFile::positionOffset() const {
+    return readVec3(header().positionOffset);
+}
+
+glm::vec3 MeshFile::positionScale() const {
+    return readVec3(header().positionScale);
+}
+
+TriangleBuffers MeshFile::upload() const {
+    return VertexUtility::CreateMesh(vertices(), indices(), vertexLayout);
+}
@@ -0,0 +1,98 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "VertexUtility.h"
+
+// A packed mesh on disk, laid out so that it can be drawn straight from a memory mapping: a fixed header with the
+// vertex layout and bounds, then the vertices and the 32 bit indices, each starting at a multiple of ALIGNMENT.
+// Files are written by the converter (--convert-mesh) in the byte order of the machine, little endian in practice;
+// a file of the other byte order fails the magic check.
+// open() maps the file read only and checks the header against its size, but not the indices against the vertex
+// count, which would touch every page of a large file; upload() then hands the mapped blobs to GL, which copies them
+// into its buffers without any copy of ours. close() (or the destructor) drops the mapping again, so once uploaded a
+// mesh costs no resident memory on the CPU side.
+class MeshFile {
+public:
+    static constexpr uint32_t MAGIC = 0x4853454d; // "MESH"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr unsigned int MAX_ATTRIBUTES = 8;
+
+    struct Attribute {
+        uint8_t location;
+        uint8_t format; // VertexFormat
+        uint16_t offset;
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vertexCount;
+        uint32_t vertexStride;
+        uint64_t vertexOffset; // bytes from the start of the file
+        uint64_t indexOffset;
+        uint32_t indexCount;
+        uint32_t attributeCount;
+        Attribute attributes[MAX_ATTRIBUTES];
+        float boundsMin[3];
+        float boundsMax[3];
+        float positionOffset[3]; // see QuantizedMesh
+        float positionScale[3];
+    };
+
+    static_assert(sizeof(Header) == 120, "the header is read straight from the file");
+
+    // write mesh to path, through a temporary file so that a crash never leaves a truncated mesh behind
+    static bool write(const std::string &path, const QuantizedMesh &mesh);
+
+    MeshFile() = default;
+
+    ~MeshFile();
+
+    MeshFile(const MeshFile &) = delete;
+
+    MeshFile &operator=(const MeshFile &) = delete;
+
+    // map the file and check its header; reports and returns false if it is not a mesh this build can read
+    bool open(const std::string &path);
+
+    void close();
+
+    bool isOpen() const { return data != nullptr; }
+
+    const Header &header() const { return *reinterpret_cast<const Header *>(data); }
+
+    const VertexLayout &layout() const { return vertexLayout; }
+
+    std::span<const unsigned char> vertices() const;
+
+    std::span<const unsigned int> indices() const;
+
+    glm::vec3 boundsMin() const;
+
+    glm::vec3 boundsMax() const;
+
+    glm::vec3 positionOffset() const;
+
+    glm::vec3 positionScale() const;
+
+    // GL thread: create the mesh's buffers and vertex array from the mapping
+    TriangleBuffers upload() const;
+
+private:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    bool mapped = false; // false: read into contents, where memory mapping is not available
+    std::vector<unsigned char> contents;
+    VertexLayout vertexLayout;
+
+    bool validate(const std::string &path);
+};
+
+#endif //MESHFILE_H
@@ -0,0 +1,1077 @@
+#include "ModelImporter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Json.h"
+
+namespace {
+    constexpr unsigned int STRIDE = 8;
+    constexpr uint32_t NONE = ~0u;
+
+    double secondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool readFile(const std::filesystem::path &path, std::vector<char> &contents) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        contents.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(contents.data(), static_cast<std::streamsize>(contents.size()));
+        return static_cast<bool>(file);
+    }
+
+    std::string lowerExtension(const std::string &path) {
+        std::string extension = std::filesystem::path(path).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension;
+    }
+
+    bool isDigit(char c) {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char *skipSpace(const char *p, const char *end) {
+        while (p < end && isSpace(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+    // the rest of the line without surrounding white space
+    std::string_view restOfLine(const char *p, const char *end) {
+        p = skipSpace(p, end);
+        const char *last = end;
+        while (last > p && isSpace(last[-1])) {
+            last--;
+        }
+        return {p, static_cast<size_t>(last - p)};
+    }
+
+    // the values 10^0 to 10^22 are exact in a double
+    constexpr double POWERS_OF_TEN[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+        1e20, 1e21, 1e22
+    };
+
+    // a decimal integer, with sign; returns p when there is none
+    const char *parseInt(const char *p, const char *end, int64_t &value) {
+        const char *start = p;
+        const bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) {
+            p++;
+        }
+        if (p >= end || !isDigit(*p))
+            return start;
+        int64_t magnitude = 0;
+        for (; p < end && isDigit(*p); p++) {
+            if (magnitude < (int64_t(1) << 40)) {
+                magnitude = magnitude * 10 + (*p - '0');
+            }
+        }
+        value = negative ? -magnitude : magnitude;
+        return p;
+    }
+}
+
+const char *ModelImporter::parseFloat(const char *text, const char *end, float &value) {
+    const char *p = text;
+    const bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+    // up to 19 significant digits fit the mantissa; anything longer takes the slow path
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    bool truncated = false;
+    for (; p < end && isDigit(*p); p++) {
+        any = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exponent++;
+            truncated |= *p != '0';
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && isDigit(*p); p++) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            } else {
+                truncated |= *p != '0';
+            }
+        }
+    }
+    const char *start = text < end && *text == '+' ? text + 1 : text;
+    if (!any) {
+        // inf and nan, or not a number at all
+        const auto [last, error] = std::from_chars(start, end, value);
+        return error == std::errc() ? last : text;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int64_t power = 0;
+        const char *last = parseInt(p + 1, end, power);
+        if (last != p + 1) {
+            exponent += static_cast<int>(std::clamp<int64_t>(power, -100000, 100000));
+            p = last;
+        }
+    }
+    // Clinger's fast path: both the mantissa and the power of ten are exact doubles, so one multiplication or
+    // division rounds correctly to double. Rounding that to float is only wrong when the double lies exactly halfway
+    // between two floats (the low 29 bits of its mantissa are 1 followed by zeros); from_chars decides those.
+    if (!truncated && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double result = static_cast<double>(mantissa);
+        result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+        uint64_t bits;
+        std::memcpy(&bits, &result, sizeof(bits));
+        if ((bits & 0x1fffffff) != 0x10000000) {
+            value = static_cast<float>(negative ? -result : result);
+            return p;
+        }
+    }
+    const auto [last, error] = std::from_chars(start, p, value);
+    if (error == std::errc::result_out_of_range) {
+        const float magnitude = exponent > 0 ? std::numeric_limits<float>::infinity() : 0.0f;
+        value = negative ? -magnitude : magnitude;
+    }
+    return p;
+}
+
+void ModelImporter::Stats::print(std::ostream &out) const {
+    out << bytes / (1024.0 * 1024.0) << " MiB: read " << readSeconds * 1000.0 << " ms, parse " << parseSeconds * 1000.0
+        << " ms, build " << buildSeconds * 1000.0 << " ms" << std::endl;
+}
+
+bool ModelImporter::canLoad(const std::string &path) {
+    const std::string extension = lowerExtension(path);
+    return extension == ".obj" || extension == ".gltf" || extension == ".glb";
+}
+
+bool ModelImporter::load(const std::string &path, ImportedModel &model) {
+    model = ImportedModel();
+    counters = Stats();
+    const std::string extension = lowerExtension(path);
+    if (extension == ".obj")
+        return loadObj(path, model);
+    if (extension == ".gltf" || extension == ".glb")
+        return loadGltf(path, model);
+    std::cout << "ERROR::MODEL_IMPORTER::UNKNOWN_FORMAT " << path << std::endl;
+    return false;
+}
+
+void ModelImporter::optimize(ImportedModel &model) {
+    const size_t vertexCount = model.mesh.vertexCount();
+    std::span<unsigned int> indices(model.mesh.indices);
+    for (const ModelPart &part: model.parts) {
+        VertexUtility::OptimizeVertexCache(indices.subspan(part.firstIndex, part.indexCount), vertexCount);
+    }
+    // renumbering keeps the order of the indices, so the parts stay where they are
+    VertexUtility::OptimizeVertexFetch(model.mesh);
+}
+
+namespace {
+    // what one chunk of an OBJ file holds. Indices are stored 0 based; a relative (negative) index is stored as an
+    // index into the chunk's own elements, which may be negative, with its bit set in relative.
+    struct ObjChunk {
+        std::vector<float> positions; // 3 per position
+        std::vector<float> texCoords; // 2 per coordinate
+        std::vector<float> normals; // 3 per normal
+        std::vector<int32_t> corners; // position, texture coordinate and normal of every triangle corner, -1 if none
+        std::vector<uint8_t> relative; // per corner: bit 0 position, 1 texture coordinate, 2 normal
+        std::vector<std::pair<size_t, std::string> > materials; // triangle (of this chunk) and the name it switches to
+        std::vector<std::string> libraries;
+        size_t positionBase = 0, texCoordBase = 0, normalBase = 0, cornerBase = 0;
+    };
+
+    // "p", "p/t", "p//n" or "p/t/n"
+    const char *parseObjCorner(const char *p, const char *end, const ObjChunk &chunk, int32_t corner[3],
+                               uint8_t &relative) {
+        const size_t counts[3] = {chunk.positions.size() / 3, chunk.texCoords.size() / 2, chunk.normals.size() / 3};
+        relative = 0;
+        for (int slot = 0; slot < 3; slot++) {
+            corner[slot] = -1;
+            if (slot > 0) {
+                if (p >= end || *p != '/')
+                    continue;
+                p++;
+            }
+            int64_t index = 0;
+            const char *last = parseInt(p, end, index);
+            if (last == p)
+                continue;
+            p = last;
+            if (index > 0) {
+                corner[slot] = static_cast<int32_t>(index - 1);
+            } else if (index < 0) {
+                corner[slot] = static_cast<int32_t>(static_cast<int64_t>(counts[slot]) + index);
+                relative |= static_cast<uint8_t>(1u << slot);
+            }
+        }
+        return p;
+    }
+
+    void parseObjChunk(const char *p, const char *end, ObjChunk &chunk) {
+        // the corners of the current polygon; reused, so faces allocate nothing once it has grown
+        std::vector<int32_t> polygon;
+        std::vector<uint8_t> polygonRelative;
+        while (p < end) {
+            const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            if (!lineEnd) {
+                lineEnd = end;
+            }
+            p = skipSpace(p, lineEnd);
+            if (p + 1 < lineEnd && p[0] == 'v' && isSpace(p[1])) {
+                float xyz[3] = {};
+                const char *q = p + 1;
+                for (float &value: xyz) {
+                    q = ModelImporter::parseFloat(skipSpace(q, lineEnd), lineEnd, value);
+                }
+                chunk.positions.insert(chunk.positions.end(), xyz, xyz + 3);
+            } else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+                float uv[2] = {};
+                const char *q = p + 2;
+                for (float &value: uv) {
+                    q = ModelImporter::parseFloat(skipSpace(q, lineEnd), lineEnd, value);
+                }
+                chunk.texCoords.insert(chunk.texCoords.end(), uv, uv + 2);
+            } else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+                float xyz[3] = {};
+                const char *q = p + 2;
+                for (float &value: xyz) {
+                    q = ModelImporter::parseFloat(skipSpace(q, lineEnd), lineEnd, value);
+                }
+                chunk.normals.insert(chunk.normals.end(), xyz, xyz + 3);
+            } else if (p + 1 < lineEnd && p[0] == 'f' && isSpace(p[1])) {
+                polygon.clear();
+                polygonRelative.clear();
+                const char *q = skipSpace(p + 1, lineEnd);
+                while (q < lineEnd) {
+                    int32_t corner[3];
+                    uint8_t relative;
+                    const char *last = parseObjCorner(q, lineEnd, chunk, corner, relative);
+                    if (last == q)
+                        break;
+                    polygon.insert(polygon.end(), corner, corner + 3);
+                    polygonRelative.push_back(relative);
+                    q = skipSpace(last, lineEnd);
+                }
+                // a fan around the first corner
+                for (size_t i = 2; i < polygonRelative.size(); i++) {
+                    for (size_t corner: {size_t(0), i - 1, i}) {
+                        chunk.corners.insert(chunk.corners.end(), &polygon[corner * 3], &polygon[corner * 3] + 3);
+                        chunk.relative.push_back(polygonRelative[corner]);
+                    }
+                }
+            } else if (lineEnd - p > 7 && std::string_view(p, 6) == "usemtl" && isSpace(p[6])) {
+                chunk.materials.emplace_back(chunk.corners.size() / 9, std::string(restOfLine(p + 6, lineEnd)));
+            } else if (lineEnd - p > 7 && std::string_view(p, 6) == "mtllib" && isSpace(p[6])) {
+                chunk.libraries.emplace_back(restOfLine(p + 6, lineEnd));
+            }
+            p = lineEnd + 1;
+        }
+    }
+
+    // newmtl, map_Kd and map_Ks of an MTL file; texture paths are made relative to the working directory
+    void loadObjMaterials(const std::filesystem::path &path, std::vector<ModelMaterial> &materials,
+                          std::unordered_map<std::string, int> &byName, size_t &bytes) {
+        std::vector<char> contents;
+        if (!readFile(path, contents)) {
+            std::cout << "ERROR::MODEL_IMPORTER::MATERIALS_NOT_FOUND " << path.string() << std::endl;
+            return;
+        }
+        bytes += contents.size();
+        const std::filesystem::path directory = path.parent_path();
+        const char *p = contents.data();
+        const char *end = p + contents.size();
+        ModelMaterial *material = nullptr;
+        while (p < end) {
+            const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            if (!lineEnd) {
+                lineEnd = end;
+            }
+            p = skipSpace(p, lineEnd);
+            const char *keyEnd = p;
+            while (keyEnd < lineEnd && !isSpace(*keyEnd)) {
+                keyEnd++;
+            }
+            const std::string_view key(p, static_cast<size_t>(keyEnd - p));
+            const std::string_view value = restOfLine(keyEnd, lineEnd);
+            if (key == "newmtl") {
+                auto [entry, added] = byName.try_emplace(std::string(value), static_cast<int>(materials.size()));
+                if (added) {
+                    materials.push_back({std::string(value), {}, {}});
+                }
+                material = &materials[static_cast<size_t>(entry->second)];
+            } else if (material && (key == "map_Kd" || key == "map_Ks") && !value.empty()) {
+                // options such as "-bm 1" come first, the file name last
+                const size_t space = value.find_last_of(" \t");
+                const std::string_view file = space == std::string_view::npos ? value : value.substr(space + 1);
+                (key == "map_Kd" ? material->diffuseTexture : material->specularTexture) =
+                        (directory / std::string(file)).string();
+            }
+            p = lineEnd + 1;
+        }
+    }
+
+    // a shared vertex for every distinct (position, texture coordinate, normal) of the corners, found through a list
+    // of the vertices made for each position
+    struct VertexKey {
+        int32_t texCoord;
+        int32_t normal;
+    };
+
+    // area weighted face normals summed up per position
+    std::vector<glm::vec3> positionNormals(std::span<const float> positions, std::span<const int32_t> corners) {
+        std::vector<glm::vec3> normals(positions.size() / 3, glm::vec3(0.0f));
+        auto position = [&](int32_t i) {
+            return glm::vec3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+        };
+        for (size_t t = 0; t + 9 <= corners.size(); t += 9) {
+            const int32_t a = corners[t], b = corners[t + 3], c = corners[t + 6];
+            const glm::vec3 normal = glm::cross(position(b) - position(a), position(c) - position(a));
+            normals[a] += normal;
+            normals[b] += normal;
+            normals[c] += normal;
+        }
+        for (glm::vec3 &normal: normals) {
+            const float length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+        return normals;
+    }
+}
+
+bool ModelImporter::loadObj(const std::string &path, ImportedModel &model) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<char> contents;
+    if (!readFile(path, contents)) {
+        std::cout << "ERROR::MODEL_IMPORTER::NOT_FOUND " << path << std::endl;
+        return false;
+    }
+    counters.bytes = contents.size();
+    counters.readSeconds = secondsSince(start);
+
+    // chunks of about 1 MiB, a few per thread at least, each starting at the beginning of a line
+    start = std::chrono::steady_clock::now();
+    const char *text = contents.data();
+    const size_t size = contents.size();
+    const size_t chunkCount = std::clamp<size_t>(size >> 20, 1, static_cast<size_t>(jobs.threadCount()) * 64);
+    std::vector<size_t> bounds(chunkCount + 1, size);
+    bounds[0] = 0;
+    for (size_t c = 1; c < chunkCount; c++) {
+        size_t at = std::max(size * c / chunkCount, bounds[c - 1]);
+        const void *newline = at < size ? std::memchr(text + at, '\n', size - at) : nullptr;
+        bounds[c] = newline ? static_cast<size_t>(static_cast<const char *>(newline) - text) + 1 : size;
+    }
+    std::vector<ObjChunk> chunks(chunkCount);
+    jobs.parallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            parseObjChunk(text + bounds[c], text + bounds[c + 1], chunks[c]);
+        }
+    });
+    counters.parseSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    // where every chunk's elements go in the merged arrays
+    size_t positionCount = 0, texCoordCount = 0, normalCount = 0, cornerCount = 0;
+    for (ObjChunk &chunk: chunks) {
+        chunk.positionBase = positionCount;
+        chunk.texCoordBase = texCoordCount;
+        chunk.normalBase = normalCount;
+        chunk.cornerBase = cornerCount;
+        positionCount += chunk.positions.size() / 3;
+        texCoordCount += chunk.texCoords.size() / 2;
+        normalCount += chunk.normals.size() / 3;
+        cornerCount += chunk.relative.size();
+    }
+    if (cornerCount == 0 || positionCount >= NONE) {
+        std::cout << "ERROR::MODEL_IMPORTER::NO_TRIANGLES " << path << std::endl;
+        return false;
+    }
+    std::vector<float> positions(positionCount * 3), texCoords(texCoordCount * 2), normals(normalCount * 3);
+    std::vector<int32_t> corners(cornerCount * 3);
+    std::atomic<bool> badIndex{false};
+    bool missingNormals = false;
+    jobs.parallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+        bool missing = false;
+        for (size_t c = begin; c < end; c++) {
+            ObjChunk &chunk = chunks[c];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionBase * 3);
+            std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + chunk.texCoordBase * 2);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalBase * 3);
+            const size_t bases[3] = {chunk.positionBase, chunk.texCoordBase, chunk.normalBase};
+            const size_t counts[3] = {positionCount, texCoordCount, normalCount};
+            for (size_t k = 0; k < chunk.relative.size(); k++) {
+                int32_t *corner = &corners[(chunk.cornerBase + k) * 3];
+                for (int slot = 0; slot < 3; slot++) {
+                    int64_t index = chunk.corners[k * 3 + slot];
+                    if (chunk.relative[k] >> slot & 1u) {
+                        index += static_cast<int64_t>(bases[slot]);
+                    }
+                    if (index >= static_cast<int64_t>(counts[slot]) || (index < 0 && chunk.relative[k] >> slot & 1u)) {
+                        // a texture coordinate or normal that is not there is left out, a position is fatal
+                        if (slot == 0) {
+                            badIndex.store(true, std::memory_order_relaxed);
+                        }
+                        index = -1;
+                    }
+                    corner[slot] = static_cast<int32_t>(index);
+                }
+                if (corner[0] < 0) {
+                    badIndex.store(true, std::memory_order_relaxed);
+                    corner[0] = 0;
+                }
+                missing |= corner[2] < 0;
+            }
+            chunk.positions = {};
+            chunk.texCoords = {};
+            chunk.normals = {};
+            chunk.corners = {};
+            chunk.relative = {};
+        }
+        if (missing) {
+            std::atomic_ref(missingNormals).store(true, std::memory_order_relaxed);
+        }
+    });
+    if (badIndex) {
+        std::cout << "ERROR::MODEL_IMPORTER::BAD_INDEX " << path << std::endl;
+        return false;
+    }
+
+    // materials: the libraries first, then every usemtl in file order; a chunk starts with the material the ones
+    // before it ended with
+    std::unordered_map<std::string, int> materialIndex;
+    const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    for (const ObjChunk &chunk: chunks) {
+        for (const std::string &library: chunk.libraries) {
+            loadObjMaterials(directory / library, model.materials, materialIndex, counters.bytes);
+        }
+    }
+    struct Run {
+        size_t firstTriangle;
+        int material;
+    };
+    std::vector<Run> runs{{0, -1}};
+    for (const ObjChunk &chunk: chunks) {
+        for (const auto &[triangle, name]: chunk.materials) {
+            auto [entry, added] = materialIndex.try_emplace(name, static_cast<int>(model.materials.size()));
+            if (added) {
+                model.materials.push_back({name, {}, {}});
+            }
+            const size_t first = chunk.cornerBase / 3 + triangle;
+            if (runs.back().firstTriangle == first) {
+                runs.back().material = entry->second;
+            } else {
+                runs.push_back({first, entry->second});
+            }
+        }
+    }
+    const size_t triangleCount = cornerCount / 3;
+    runs.push_back({triangleCount, -1});
+
+    // the triangles grouped by material, in file order within each, one part per material
+    std::vector<size_t> trianglesOf(model.materials.size() + 1, 0);
+    for (size_t r = 0; r + 1 < runs.size(); r++) {
+        trianglesOf[static_cast<size_t>(runs[r].material + 1)] += runs[r + 1].firstTriangle - runs[r].firstTriangle;
+    }
+    std::vector<size_t> partStart(trianglesOf.size(), 0);
+    for (size_t m = 0; m < trianglesOf.size(); m++) {
+        partStart[m] = m == 0 ? 0 : partStart[m - 1] + trianglesOf[m - 1];
+        if (trianglesOf[m] > 0) {
+            model.parts.push_back({static_cast<uint32_t>(partStart[m] * 3), static_cast<uint32_t>(trianglesOf[m] * 3),
+                                   static_cast<int>(m) - 1});
+        }
+    }
+    std::vector<uint32_t> order(triangleCount);
+    {
+        std::vector<size_t> cursor = partStart;
+        for (size_t r = 0; r + 1 < runs.size(); r++) {
+            size_t &at = cursor[static_cast<size_t>(runs[r].material + 1)];
+            for (size_t t = runs[r].firstTriangle; t < runs[r + 1].firstTriangle; t++) {
+                order[at++] = static_cast<uint32_t>(t);
+            }
+        }
+    }
+    chunks = {};
+
+    const std::vector<glm::vec3> madeUpNormals = missingNormals
+                                                     ? positionNormals(positions, corners)
+                                                     : std::vector<glm::vec3>();
+    std::vector<uint32_t> firstVertex(positionCount, NONE);
+    std::vector<uint32_t> nextVertex;
+    std::vector<VertexKey> keys;
+    std::vector<uint32_t> vertexPositions;
+    nextVertex.reserve(positionCount);
+    keys.reserve(positionCount);
+    vertexPositions.reserve(positionCount);
+    model.mesh.stride = STRIDE;
+    model.mesh.indices.resize(cornerCount);
+    for (size_t i = 0; i < cornerCount; i++) {
+        const int32_t *corner = &corners[(size_t(order[i / 3]) * 3 + i % 3) * 3];
+        const uint32_t position = static_cast<uint32_t>(corner[0]);
+        uint32_t vertex = firstVertex[position];
+        while (vertex != NONE && (keys[vertex].texCoord != corner[1] || keys[vertex].normal != corner[2])) {
+            vertex = nextVertex[vertex];
+        }
+        if (vertex == NONE) {
+            vertex = static_cast<uint32_t>(keys.size());
+            keys.push_back({corner[1], corner[2]});
+            vertexPositions.push_back(position);
+            nextVertex.push_back(firstVertex[position]);
+            firstVertex[position] = vertex;
+        }
+        model.mesh.indices[i] = vertex;
+    }
+    model.mesh.vertices.resize(keys.size() * STRIDE);
+    jobs.parallelFor(keys.size(), 4096, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            float *vertex = &model.mesh.vertices[v * STRIDE];
+            const size_t position = vertexPositions[v];
+            std::copy(&positions[position * 3], &positions[position * 3] + 3, vertex);
+            const VertexKey &key = keys[v];
+            if (key.normal >= 0) {
+                std::copy(&normals[key.normal * 3], &normals[key.normal * 3] + 3, vertex + 3);
+            } else {
+                const glm::vec3 &normal = madeUpNormals[position];
+                vertex[3] = normal.x;
+                vertex[4] = normal.y;
+                vertex[5] = normal.z;
+            }
+            vertex[6] = key.texCoord >= 0 ? texCoords[key.texCoord * 2] : 0.0f;
+            vertex[7] = key.texCoord >= 0 ? texCoords[key.texCoord * 2 + 1] : 0.0f;
+        }
+    });
+    counters.buildSeconds = secondsSince(start);
+    return true;
+}
+
+namespace {
+    constexpr uint32_t GLB_MAGIC = 0x46546c67; // "glTF"
+    constexpr uint32_t GLB_JSON = 0x4e4f534a;
+    constexpr uint32_t GLB_BIN = 0x004e4942;
+
+    enum ComponentType {
+        Byte = 5120, UnsignedByte = 5121, Short = 5122, UnsignedShort = 5123, UnsignedInt = 5125, Float = 5126
+    };
+
+    // a count, offset or index; anything that is not a number from 0 up reads as out of range
+    size_t toSize(const JsonValue &value, double fallback = -1.0) {
+        const double number = value.number(fallback);
+        return number >= 0.0 && number < 9e15 ? static_cast<size_t>(number) : std::numeric_limits<size_t>::max();
+    }
+
+    int componentSize(int type) {
+        switch (type) {
+            case Byte:
+            case UnsignedByte:
+                return 1;
+            case Short:
+            case UnsignedShort:
+                return 2;
+            case UnsignedInt:
+            case Float:
+                return 4;
+            default:
+                return 0;
+        }
+    }
+
+    int componentCount(const std::string &type) {
+        if (type == "SCALAR")
+            return 1;
+        if (type == "VEC2")
+            return 2;
+        if (type == "VEC3")
+            return 3;
+        if (type == "VEC4")
+            return 4;
+        return 0;
+    }
+
+    bool decodeBase64(std::string_view text, std::vector<char> &out) {
+        auto digit = [](char c) -> int {
+            if (c >= 'A' && c <= 'Z')
+                return c - 'A';
+            if (c >= 'a' && c <= 'z')
+                return c - 'a' + 26;
+            if (c >= '0' && c <= '9')
+                return c - '0' + 52;
+            if (c == '+')
+                return 62;
+            if (c == '/')
+                return 63;
+            return -1;
+        };
+        out.clear();
+        out.reserve(text.size() / 4 * 3);
+        uint32_t bits = 0;
+        int count = 0;
+        for (char c: text) {
+            if (c == '=')
+                break;
+            const int value = digit(c);
+            if (value < 0)
+                return false;
+            bits = bits << 6 | static_cast<uint32_t>(value);
+            if (++count == 4) {
+                out.push_back(static_cast<char>(bits >> 16));
+                out.push_back(static_cast<char>(bits >> 8));
+                out.push_back(static_cast<char>(bits));
+                bits = 0;
+                count = 0;
+            }
+        }
+        if (count == 2) {
+            out.push_back(static_cast<char>(bits >> 4));
+        } else if (count == 3) {
+            out.push_back(static_cast<char>(bits >> 10));
+            out.push_back(static_cast<char>(bits >> 2));
+        }
+        return count != 1;
+    }
+
+    // the elements of an accessor, wherever they are in their buffer
+    struct Accessor {
+        const unsigned char *data = nullptr;
+        size_t count = 0;
+        size_t stride = 0;
+        int type = 0;
+        int components = 0;
+        bool normalized = false;
+
+        // component c of element i as a float, normalized integers mapped to [0, 1] or [-1, 1]
+        float read(size_t i, int c) const {
+            const unsigned char *p = data + i * stride + c * componentSize(type);
+            switch (type) {
+                case Float: {
+                    float value;
+                    std::memcpy(&value, p, sizeof(value));
+                    return value;
+                }
+                case UnsignedByte:
+                    return normalized ? *p / 255.0f : *p;
+                case Byte: {
+                    const auto value = static_cast<int8_t>(*p);
+                    return normalized ? std::max(value / 127.0f, -1.0f) : value;
+                }
+                case UnsignedShort: {
+                    uint16_t value;
+                    std::memcpy(&value, p, sizeof(value));
+                    return normalized ? value / 65535.0f : value;
+                }
+                case Short: {
+                    int16_t value;
+                    std::memcpy(&value, p, sizeof(value));
+                    return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+                }
+                default:
+                    return static_cast<float>(index(i));
+            }
+        }
+
+        uint32_t index(size_t i) const {
+            const unsigned char *p = data + i * stride;
+            switch (type) {
+                case UnsignedByte:
+                    return *p;
+                case UnsignedShort: {
+                    uint16_t value;
+                    std::memcpy(&value, p, sizeof(value));
+                    return value;
+                }
+                default: {
+                    uint32_t value;
+                    std::memcpy(&value, p, sizeof(value));
+                    return value;
+                }
+            }
+        }
+    };
+
+    struct GltfDocument {
+        JsonValue json;
+        // the binary chunk of a .glb is read where it is in the file, the other buffers live in storage
+        std::vector<std::string_view> buffers;
+        std::vector<std::vector<char> > storage;
+    };
+
+    bool readAccessor(const GltfDocument &document, const JsonValue &index, Accessor &out, std::string &error) {
+        const JsonValue &accessor = document.json["accessors"][toSize(index)];
+        if (accessor.isNull()) {
+            error = "missing accessor";
+            return false;
+        }
+        if (accessor.has("sparse") || !accessor.has("bufferView")) {
+            error = "sparse accessors are not supported";
+            return false;
+        }
+        const JsonValue &view = document.json["bufferViews"][toSize(accessor["bufferView"])];
+        const size_t buffer = toSize(view["buffer"]);
+        if (view.isNull() || buffer >= document.buffers.size()) {
+            error = "missing buffer view";
+            return false;
+        }
+        out.type = static_cast<int>(accessor["componentType"].number());
+        out.components = componentCount(accessor["type"].string());
+        out.normalized = accessor["normalized"].boolean();
+        out.count = toSize(accessor["count"]);
+        const size_t elementSize = static_cast<size_t>(componentSize(out.type) * out.components);
+        out.stride = toSize(view["byteStride"], static_cast<double>(elementSize));
+        // every size here is below 2^53, so the sums cannot wrap around
+        const size_t viewOffset = toSize(view["byteOffset"], 0);
+        const size_t accessorOffset = toSize(accessor["byteOffset"], 0);
+        const size_t length = toSize(view["byteLength"]);
+        const std::string_view bytes = document.buffers[buffer];
+        if (elementSize == 0 || out.stride < elementSize || out.stride > 255 || length > bytes.size() ||
+            viewOffset > bytes.size() - length || accessorOffset > length || out.count == 0 ||
+            out.count - 1 > (length - accessorOffset - std::min(elementSize, length - accessorOffset)) / out.stride ||
+            accessorOffset + elementSize > length) {
+            error = "accessor out of bounds";
+            return false;
+        }
+        out.data = reinterpret_cast<const unsigned char *>(bytes.data()) + viewOffset + accessorOffset;
+        return true;
+    }
+
+    glm::mat4 nodeTransform(const JsonValue &node) {
+        const JsonValue &matrix = node["matrix"];
+        if (matrix.size() == 16) {
+            glm::mat4 m;
+            for (int i = 0; i < 16; i++) {
+                m[i / 4][i % 4] = static_cast<float>(matrix[static_cast<size_t>(i)].number());
+            }
+            return m;
+        }
+        const JsonValue &t = node["translation"], &r = node["rotation"], &s = node["scale"];
+        const glm::vec3 translation(t[0].number(), t[1].number(), t[2].number());
+        const glm::quat rotation(static_cast<float>(r[3].number(1.0)), static_cast<float>(r[0].number()),
+                                 static_cast<float>(r[1].number()), static_cast<float>(r[2].number()));
+        const glm::vec3 scale(s[0].number(1.0), s[1].number(1.0), s[2].number(1.0));
+        return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) *
+               glm::scale(glm::mat4(1.0f), scale);
+    }
+
+    // a triangle primitive placed in the world by its node
+    struct GltfPrimitive {
+        GltfPrimitive(const JsonValue *primitive, const glm::mat4 &transform, int material)
+            : primitive(primitive), transform(transform), material(material) {
+        }
+
+        const JsonValue *primitive;
+        glm::mat4 transform;
+        int material;
+        // decoded
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        std::string error;
+        size_t vertexBase = 0, indexBase = 0;
+    };
+
+    // every element loop is split over the jobs as well, so one large primitive does not end up on a single thread
+    void decodePrimitive(const GltfDocument &document, GltfPrimitive &out, JobSystem &jobs) {
+        const JsonValue &attributes = (*out.primitive)["attributes"];
+        Accessor positions, normals, texCoords, indices;
+        if (!readAccessor(document, attributes["POSITION"], positions, out.error))
+            return;
+        const bool hasNormals = attributes.has("NORMAL") &&
+                                readAccessor(document, attributes["NORMAL"], normals, out.error);
+        const bool hasTexCoords = attributes.has("TEXCOORD_0") &&
+                                  readAccessor(document, attributes["TEXCOORD_0"], texCoords, out.error);
+        out.error.clear();
+        const size_t count = positions.count;
+        if (positions.components != 3 || (hasNormals && (normals.components != 3 || normals.count != count)) ||
+            (hasTexCoords && (texCoords.components != 2 || texCoords.count != count))) {
+            out.error = "unexpected attribute types";
+            return;
+        }
+        if ((*out.primitive).has("indices")) {
+            if (!readAccessor(document, (*out.primitive)["indices"], indices, out.error))
+                return;
+            out.indices.resize(indices.count);
+            std::atomic<bool> outOfRange{false};
+            jobs.parallelFor(indices.count, 4096, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    out.indices[i] = indices.index(i);
+                    if (out.indices[i] >= count) {
+                        outOfRange.store(true, std::memory_order_relaxed);
+                    }
+                }
+            });
+            if (outOfRange.load(std::memory_order_relaxed)) {
+                out.error = "index out of range";
+                return;
+            }
+        } else {
+            out.indices.resize(count);
+            std::iota(out.indices.begin(), out.indices.end(), 0u);
+        }
+        out.indices.resize(out.indices.size() / 3 * 3);
+
+        const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(out.transform)));
+        auto setNormal = [&](size_t v, const glm::vec3 &sum) {
+            const float length = glm::length(sum);
+            const glm::vec3 normal = length > 0.0f ? sum / length : glm::vec3(0.0f, 1.0f, 0.0f);
+            out.vertices[v * STRIDE + 3] = normal.x;
+            out.vertices[v * STRIDE + 4] = normal.y;
+            out.vertices[v * STRIDE + 5] = normal.z;
+        };
+        out.vertices.resize(count * STRIDE);
+        jobs.parallelFor(count, 4096, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++) {
+                float *vertex = &out.vertices[v * STRIDE];
+                const glm::vec3 position = out.transform * glm::vec4(positions.read(v, 0), positions.read(v, 1),
+                                                                     positions.read(v, 2), 1.0f);
+                vertex[0] = position.x;
+                vertex[1] = position.y;
+                vertex[2] = position.z;
+                if (hasTexCoords) {
+                    // glTF puts the origin of texture space at the top left, OpenGL and OBJ at the bottom left
+                    vertex[6] = texCoords.read(v, 0);
+                    vertex[7] = 1.0f - texCoords.read(v, 1);
+                }
+                if (hasNormals) {
+                    setNormal(v, normalMatrix * glm::vec3(normals.read(v, 0), normals.read(v, 1), normals.read(v, 2)));
+                }
+            }
+        });
+        if (hasNormals)
+            return;
+
+        // the face normals are independent; only adding them up at the shared vertices stays on one thread
+        auto position = [&](unsigned int v) { return glm::make_vec3(&out.vertices[v * STRIDE]); };
+        std::vector<glm::vec3> faceNormals(out.indices.size() / 3);
+        jobs.parallelFor(faceNormals.size(), 4096, [&](size_t begin, size_t end) {
+            for (size_t f = begin; f < end; f++) {
+                const unsigned int a = out.indices[f * 3], b = out.indices[f * 3 + 1], c = out.indices[f * 3 + 2];
+                faceNormals[f] = glm::cross(position(b) - position(a), position(c) - position(a));
+            }
+        });
+        std::vector<glm::vec3> vertexNormals(count, glm::vec3(0.0f));
+        for (size_t f = 0; f < faceNormals.size(); f++) {
+            for (size_t corner = 0; corner < 3; corner++) {
+                vertexNormals[out.indices[f * 3 + corner]] += faceNormals[f];
+            }
+        }
+        jobs.parallelFor(count, 4096, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++) {
+                setNormal(v, vertexNormals[v]);
+            }
+        });
+    }
+
+    // the file behind a glTF image, empty for images embedded in a buffer
+    std::string gltfImage(const JsonValue &json, const JsonValue &textureInfo, const std::filesystem::path &directory) {
+        const JsonValue &texture = json["textures"][toSize(textureInfo["index"])];
+        const JsonValue &image = json["images"][toSize(texture["source"])];
+        const std::string &uri = image["uri"].string();
+        if (uri.empty() || uri.starts_with("data:"))
+            return {};
+        return (directory / uri).string();
+    }
+}
+
+bool ModelImporter::loadGltf(const std::string &path, ImportedModel &model) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<char> contents;
+    if (!readFile(path, contents)) {
+        std::cout << "ERROR::MODEL_IMPORTER::NOT_FOUND " << path << std::endl;
+        return false;
+    }
+    counters.bytes = contents.size();
+    const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+
+    // a .glb is a header and chunks: the JSON, then optionally the binary buffer
+    std::string_view json(contents.data(), contents.size());
+    std::string_view binary;
+    uint32_t header[3] = {};
+    if (contents.size() >= sizeof(header)) {
+        std::memcpy(header, contents.data(), sizeof(header));
+    }
+    if (header[0] == GLB_MAGIC) {
+        json = {};
+        size_t offset = sizeof(header);
+        while (offset + 8 <= contents.size() && offset + 8 <= header[2]) {
+            uint32_t chunk[2];
+            std::memcpy(chunk, contents.data() + offset, sizeof(chunk));
+            offset += sizeof(chunk);
+            if (offset + chunk[0] > contents.size())
+                break;
+            if (chunk[1] == GLB_JSON && json.empty()) {
+                json = std::string_view(contents.data() + offset, chunk[0]);
+            } else if (chunk[1] == GLB_BIN && binary.empty()) {
+                binary = std::string_view(contents.data() + offset, chunk[0]);
+            }
+            offset += (chunk[0] + 3) & ~size_t(3);
+        }
+        if (json.empty()) {
+            std::cout << "ERROR::MODEL_IMPORTER::BAD_GLB " << path << std::endl;
+            return false;
+        }
+    }
+    GltfDocument document;
+    std::string error;
+    if (!JsonValue::parse(json, document.json, error)) {
+        std::cout << "ERROR::MODEL_IMPORTER::BAD_JSON " << path << ": " << error << std::endl;
+        return false;
+    }
+    const JsonValue &buffers = document.json["buffers"];
+    document.buffers.resize(buffers.size());
+    document.storage.resize(buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++) {
+        const std::string &uri = buffers[i]["uri"].string();
+        std::vector<char> &storage = document.storage[i];
+        bool loaded;
+        if (uri.empty()) {
+            // the binary chunk of a .glb, which stays in contents
+            document.buffers[i] = binary;
+            loaded = i == 0;
+        } else if (uri.starts_with("data:")) {
+            const size_t comma = uri.find(";base64,");
+            loaded = comma != std::string::npos && decodeBase64(std::string_view(uri).substr(comma + 8), storage);
+            document.buffers[i] = std::string_view(storage.data(), storage.size());
+        } else {
+            loaded = readFile(directory / uri, storage);
+            counters.bytes += storage.size();
+            document.buffers[i] = std::string_view(storage.data(), storage.size());
+        }
+        if (!loaded || document.buffers[i].size() < toSize(buffers[i]["byteLength"])) {
+            std::cout << "ERROR::MODEL_IMPORTER::MISSING_BUFFER " << path << ": buffer " << i << std::endl;
+            return false;
+        }
+    }
+    counters.readSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    const JsonValue &materials = document.json["materials"];
+    for (size_t i = 0; i < materials.size(); i++) {
+        const JsonValue &material = materials[i];
+        const JsonValue &specular = material["extensions"]["KHR_materials_specular"]["specularColorTexture"];
+        model.materials.push_back({material["name"].string(),
+                                   gltfImage(document.json, material["pbrMetallicRoughness"]["baseColorTexture"],
+                                             directory),
+                                   gltfImage(document.json, specular, directory)});
+    }
+
+    // the scene's nodes, depth first, each with its place in the world; without a scene every mesh is taken as is
+    std::vector<GltfPrimitive> primitives;
+    size_t skipped = 0;
+    auto addMesh = [&](const JsonValue &mesh, const glm::mat4 &transform) {
+        const JsonValue &list = mesh["primitives"];
+        for (size_t p = 0; p < list.size(); p++) {
+            if (list[p]["mode"].number(4) != 4) {
+                skipped++;
+                continue;
+            }
+            const int material = static_cast<int>(list[p]["material"].number(-1));
+            primitives.emplace_back(&list[p], transform,
+                                    material < static_cast<int>(model.materials.size()) ? material : -1);
+        }
+    };
+    const JsonValue &nodes = document.json["nodes"];
+    const JsonValue &scene = document.json["scenes"][toSize(document.json["scene"], 0)];
+    if (scene.isNull()) {
+        const JsonValue &meshes = document.json["meshes"];
+        for (size_t m = 0; m < meshes.size(); m++) {
+            addMesh(meshes[m], glm::mat4(1.0f));
+        }
+    } else {
+        std::vector<std::pair<size_t, glm::mat4> > stack;
+        for (size_t i = 0; i < scene["nodes"].size(); i++) {
+            stack.emplace_back(toSize(scene["nodes"][i]), glm::mat4(1.0f));
+        }
+        // a broken file could make the hierarchy a cycle
+        size_t visits = 0;
+        while (!stack.empty() && visits++ <= nodes.size() * 4) {
+            const auto [index, parent] = stack.back();
+            stack.pop_back();
+            const JsonValue &node = nodes[index];
+            const glm::mat4 transform = parent * nodeTransform(node);
+            if (node.has("mesh")) {
+                addMesh(document.json["meshes"][toSize(node["mesh"])], transform);
+            }
+            for (size_t c = 0; c < node["children"].size(); c++) {
+                stack.emplace_back(toSize(node["children"][c]), transform);
+            }
+        }
+    }
+    if (skipped > 0) {
+        std::cout << "Skipped " << skipped << " primitives that are not triangle lists in " << path << std::endl;
+    }
+    jobs.parallelFor(primitives.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++) {
+            decodePrimitive(document, primitives[p], jobs);
+        }
+    });
+    counters.parseSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const GltfPrimitive &primitive: primitives) {
+        if (!primitive.error.empty()) {
+            std::cout << "ERROR::MODEL_IMPORTER::BAD_PRIMITIVE " << path << ": " << primitive.error << std::endl;
+            return false;
+        }
+    }
+    // grouped by material, one part each
+    std::stable_sort(primitives.begin(), primitives.end(), [](const GltfPrimitive &a, const GltfPrimitive &b) {
+        return a.material < b.material;
+    });
+    size_t vertexCount = 0, indexCount = 0;
+    for (GltfPrimitive &primitive: primitives) {
+        primitive.vertexBase = vertexCount;
+        primitive.indexBase = indexCount;
+        vertexCount += primitive.vertices.size() / STRIDE;
+        indexCount += primitive.indices.size();
+        if (model.parts.empty() || model.parts.back().material != primitive.material) {
+            model.parts.push_back({static_cast<uint32_t>(primitive.indexBase), 0, primitive.material});
+        }
+        model.parts.back().indexCount += static_cast<uint32_t>(primitive.indices.size());
+    }
+    if (indexCount == 0 || vertexCount >= NONE) {
+        std::cout << "ERROR::MODEL_IMPORTER::NO_TRIANGLES " << path << std::endl;
+        return false;
+    }
+    model.mesh.stride = STRIDE;
+    model.mesh.vertices.resize(vertexCount * STRIDE);
+    model.mesh.indices.resize(indexCount);
+    jobs.parallelFor(primitives.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++) {
+            const GltfPrimitive &primitive = primitives[p];
+            std::copy(primitive.vertices.begin(), primitive.vertices.end(),
+                      model.mesh.vertices.begin() + primitive.vertexBase * STRIDE);
+            const auto base = static_cast<unsigned int>(primitive.vertexBase);
+            std::transform(primitive.indices.begin(), primitive.indices.end(),
+                           model.mesh.indices.begin() + primitive.indexBase,
+                           [base](unsigned int index) { return index + base; });
+        }
+    });
+    counters.buildSeconds = secondsSince(start);
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef MODELIMPORTER_H
+#define MODELIMPORTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+#include "VertexUtility.h"
+
+// the textures of a material, as paths the TextureLoader can open; empty where the model has none
+struct ModelMaterial {
+    std::string name;
+    std::string diffuseTexture;
+    std::string specularTexture;
+};
+
+// a run of indices drawn with one material
+struct ModelPart {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    int material = -1; // into ImportedModel::materials, -1 for none
+};
+
+struct ImportedModel {
+    IndexedMesh mesh; // the float surface layout: position, normal, texture coordinates, stride 8
+    std::vector<ModelPart> parts; // one per material, covering all of mesh.indices
+    std::vector<ModelMaterial> materials;
+};
+
+// Reads Wavefront OBJ (with its MTL materials) and glTF 2.0 (.gltf with external or data URI buffers, and .glb) into
+// one indexed mesh in world space, ready for VertexUtility and the render queue's materials.
+// An OBJ file is cut into chunks at line starts that the job system parses side by side, each into arrays of its
+// own; prefix sums over the chunks' counts then give every chunk its place in the merged arrays and resolve
+// negative (relative) indices. The primitives of a glTF file are decoded in parallel the same way. Vertices are
+// shared between faces that use the same position, texture coordinate and normal; missing normals are made up by
+// averaging the normals of the faces around each position.
+// Only triangles are imported: polygons are split into fans, points and lines are skipped.
+class ModelImporter {
+public:
+    struct Stats {
+        size_t bytes = 0; // read from disk, the model file and its buffers
+        double readSeconds = 0.0;
+        double parseSeconds = 0.0;
+        double buildSeconds = 0.0; // merging, resolving and sharing the vertices
+
+        void print(std::ostream &out) const;
+    };
+
+    explicit ModelImporter(JobSystem &jobs) : jobs(jobs) {}
+
+    // whether load() takes the file, by its extension
+    static bool canLoad(const std::string &path);
+
+    // picks the format by extension: .obj, .gltf or .glb. Reports and returns false on failure.
+    bool load(const std::string &path, ImportedModel &model);
+
+    const Stats &stats() const { return counters; }
+
+    // reorder the triangles of every part for the vertex cache, then all vertices for fetch
+    static void optimize(ImportedModel &model);
+
+    // parse a float at text, as strtof would but without locale or allocation; returns the character after it, or
+    // text when there is no number there
+    static const char *parseFloat(const char *text, const char *end, float &value);
+
+private:
+    JobSystem &jobs;
+    Stats counters;
+
+    bool loadObj(const std::string &path, ImportedModel &model);
+
+    bool loadGltf(const std::string &path, ImportedModel &model);
+};
+
+#endif //MODELIMPORTER_H
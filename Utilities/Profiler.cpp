@@ -0,0 +1,220 @@
+#include "Profiler.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <glad/glad.h>
+
+namespace {
+    struct TraceEvent {
+        const char *name;
+        uint64_t begin; // ns on the profiler clock
+        uint64_t end;
+        uint32_t depth;
+        uint32_t thread; // 0 is the GPU timeline
+    };
+
+    // Single producer (the owning thread), single consumer (the GL thread in endFrame).
+    // The producer publishes with a release store of head, the consumer hands slots back with a release store of
+    // tail. A producer that is CAPACITY events ahead drops and counts its new events rather than overwrite slots the
+    // consumer may still be copying.
+    struct ThreadRing {
+        static constexpr size_t CAPACITY = 1 << 14;
+
+        std::array<TraceEvent, CAPACITY> events;
+        std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        uint32_t thread = 0;
+        uint32_t depth = 0;
+    };
+
+    struct GpuScope {
+        const char *name;
+        unsigned int beginQuery;
+        unsigned int endQuery;
+        uint32_t depth;
+    };
+
+    // the GL_TIMESTAMP queries of one frame; reused FRAME_LATENCY frames later
+    struct GpuFramePool {
+        std::vector<unsigned int> queries;
+        size_t used = 0;
+        std::vector<GpuScope> scopes;
+    };
+
+    std::atomic<bool> cpuEnabled{false};
+    bool gpuEnabled = false;
+    int64_t gpuClockOffset = 0; // GL_TIMESTAMP - profiler clock
+
+    std::mutex ringsMutex;
+    std::vector<std::unique_ptr<ThreadRing> > rings;
+    uint64_t droppedEvents = 0;
+
+    std::array<GpuFramePool, Profiler::FRAME_LATENCY> gpuPools;
+    unsigned int gpuFrame = 0;
+    uint32_t gpuDepth = 0;
+
+    std::vector<TraceEvent> collected;
+
+    ThreadRing &threadRing() {
+        thread_local ThreadRing *ring = [] {
+            auto owned = std::make_unique<ThreadRing>();
+            std::lock_guard lock(ringsMutex);
+            owned->thread = static_cast<uint32_t>(rings.size() + 1);
+            rings.push_back(std::move(owned));
+            return rings.back().get();
+        }();
+        return *ring;
+    }
+
+    void drainRings() {
+        std::lock_guard lock(ringsMutex);
+        for (auto &ring: rings) {
+            const uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            for (; tail < head; tail++) {
+                collected.push_back(ring->events[tail % ThreadRing::CAPACITY]);
+            }
+            ring->tail.store(tail, std::memory_order_release);
+            droppedEvents += ring->dropped.exchange(0, std::memory_order_relaxed);
+        }
+    }
+
+    unsigned int nextQuery(GpuFramePool &pool) {
+        if (pool.used == pool.queries.size()) {
+            unsigned int query;
+            glGenQueries(1, &query);
+            pool.queries.push_back(query);
+        }
+        return pool.queries[pool.used++];
+    }
+
+    // read back a pool; with wait == false scopes whose result is not there yet are dropped
+    void resolvePool(GpuFramePool &pool, bool wait) {
+        for (const GpuScope &scope: pool.scopes) {
+            int available = 1;
+            if (!wait) {
+                glGetQueryObjectiv(scope.endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            }
+            if (!available) {
+                droppedEvents++;
+                continue;
+            }
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(scope.beginQuery, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(scope.endQuery, GL_QUERY_RESULT, &end);
+            collected.push_back(TraceEvent{
+                scope.name, static_cast<uint64_t>(begin - gpuClockOffset), static_cast<uint64_t>(end - gpuClockOffset),
+                scope.depth, 0
+            });
+        }
+        pool.scopes.clear();
+        pool.used = 0;
+    }
+}
+
+void Profiler::enable(bool gpu) {
+    now(); // start the clock
+    if (gpu) {
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        gpuClockOffset = gpuNow - static_cast<int64_t>(now());
+        gpuEnabled = true;
+    }
+    cpuEnabled.store(true, std::memory_order_release);
+}
+
+bool Profiler::enabled() {
+    return cpuEnabled.load(std::memory_order_relaxed);
+}
+
+uint64_t Profiler::now() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint32_t &Profiler::threadDepth() {
+    return threadRing().depth;
+}
+
+void Profiler::recordCpu(const char *name, uint64_t begin, uint64_t end, uint32_t depth) {
+    ThreadRing &ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    // the acquire pairs with the consumer's release, so its copy of the slot is complete before it is reused
+    if (head - ring.tail.load(std::memory_order_acquire) >= ThreadRing::CAPACITY) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ring.events[head % ThreadRing::CAPACITY] = TraceEvent{name, begin, end, depth, ring.thread};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::beginFrame() {
+    if (!gpuEnabled)
+        return;
+    // this pool was filled FRAME_LATENCY frames ago, its results are (almost always) available by now
+    gpuFrame++;
+    GpuFramePool &pool = gpuPools[gpuFrame % FRAME_LATENCY];
+    resolvePool(pool, false);
+}
+
+void Profiler::endFrame() {
+    if (!enabled())
+        return;
+    drainRings();
+}
+
+int Profiler::beginGpu(const char *name) {
+    if (!gpuEnabled)
+        return -1;
+    GpuFramePool &pool = gpuPools[gpuFrame % FRAME_LATENCY];
+    unsigned int query = nextQuery(pool);
+    glQueryCounter(query, GL_TIMESTAMP);
+    pool.scopes.push_back(GpuScope{name, query, 0, gpuDepth++});
+    return static_cast<int>(pool.scopes.size() - 1);
+}
+
+void Profiler::endGpu(int scope) {
+    GpuFramePool &pool = gpuPools[gpuFrame % FRAME_LATENCY];
+    unsigned int query = nextQuery(pool);
+    glQueryCounter(query, GL_TIMESTAMP);
+    pool.scopes[scope].endQuery = query;
+    gpuDepth--;
+}
+
+bool Profiler::writeChromeTrace(const std::string &path) {
+    drainRings();
+    if (gpuEnabled) {
+        for (GpuFramePool &pool: gpuPools) {
+            resolvePool(pool, true);
+        }
+    }
+
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open " << path << " for writing\n";
+        return false;
+    }
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << R"({"name":"thread_name","ph":"M","pid":1,"tid":0,"args":{"name":"GPU"}})";
+    for (const TraceEvent &event: collected) {
+        // Chrome trace timestamps are in microseconds
+        file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+                << ",\"ts\":" << event.begin / 1000.0 << ",\"dur\":" << (event.end - event.begin) / 1000.0
+                << ",\"args\":{\"depth\":" << event.depth << "}}";
+    }
+    file << "\n]}\n";
+    if (droppedEvents > 0) {
+        std::cout << "Profiler dropped " << droppedEvents << " events" << std::endl;
+    }
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,98 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <string>
+
+// Hierarchical frame profiler.
+// CPU scopes are RAII objects that append to a lock-free ring owned by the recording thread; the GL thread
+// drains all rings once per frame. GPU scopes bracket GL work with GL_TIMESTAMP queries taken from per-frame
+// pools and are read back FRAME_LATENCY frames later, so reading them never stalls the pipeline.
+// Everything is exported as a Chrome trace (chrome://tracing, Perfetto).
+class Profiler {
+public:
+    static constexpr unsigned int FRAME_LATENCY = 3;
+
+    // cpu scopes work from any thread; gpu scopes additionally need a current GL context
+    static void enable(bool gpu);
+
+    static bool enabled();
+
+    // nanoseconds since the profiler clock started
+    static uint64_t now();
+
+    // GL thread, once per frame: beginFrame recycles the oldest GPU query pool, endFrame collects the CPU rings.
+    // Scopes still open at endFrame (e.g. a whole-frame scope) are counted in the frame they were opened in.
+    static void beginFrame();
+
+    static void endFrame();
+
+    // waits for the outstanding GPU queries and writes everything recorded so far
+    static bool writeChromeTrace(const std::string &path);
+
+    // used by the scope objects below; names must be string literals (they are stored as pointers)
+    static void recordCpu(const char *name, uint64_t begin, uint64_t end, uint32_t depth);
+
+    static uint32_t &threadDepth();
+
+    static int beginGpu(const char *name);
+
+    static void endGpu(int scope);
+};
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char *name) : name(name), active(Profiler::enabled()) {
+        if (active) {
+            depth = Profiler::threadDepth()++;
+            begin = Profiler::now();
+        }
+    }
+
+    ~ProfileScope() {
+        if (active) {
+            Profiler::threadDepth()--;
+            Profiler::recordCpu(name, begin, Profiler::now(), depth);
+        }
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *name;
+    bool active;
+    uint64_t begin = 0;
+    uint32_t depth = 0;
+};
+
+class GpuProfileScope {
+public:
+    explicit GpuProfileScope(const char *name) : scope(Profiler::enabled() ? Profiler::beginGpu(name) : -1) {
+    }
+
+    ~GpuProfileScope() {
+        if (scope >= 0) {
+            Profiler::endGpu(scope);
+        }
+    }
+
+    GpuProfileScope(const GpuProfileScope &) = delete;
+
+    GpuProfileScope &operator=(const GpuProfileScope &) = delete;
+
+private:
+    int scope;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// time the rest of the enclosing block on the CPU
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+// time the rest of the enclosing block on the CPU and the GL work it issues on the GPU
+#define PROFILE_GL_SCOPE(name) \
+    PROFILE_SCOPE(name); \
+    GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+
+#endif //PROFILER_H
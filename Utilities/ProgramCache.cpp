@@ -0,0 +1,144 @@
+#include "ProgramCache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+
+namespace {
+    constexpr uint32_t MAGIC = 0x42504c47; // "GLPB"
+
+    std::string cacheDirectory = "shader_cache";
+    ProgramCache::Stats cacheStats;
+
+    // FNV-1a, 64 bit
+    uint64_t hashBytes(uint64_t hash, std::string_view bytes) {
+        for (char c: bytes) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        // separator, so ("ab", "c") and ("a", "bc") hash differently
+        hash ^= 0xff;
+        hash *= 1099511628211ull;
+        return hash;
+    }
+
+    std::string driverString() {
+        std::string driver;
+        for (GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const GLubyte *value = glGetString(name);
+            driver += value ? reinterpret_cast<const char *>(value) : "";
+            driver += '\n';
+        }
+        return driver;
+    }
+
+    std::filesystem::path entryPath(uint64_t key) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+        return std::filesystem::path(cacheDirectory) / name;
+    }
+
+    bool supported() {
+        if (!GLAD_GL_ARB_get_program_binary)
+            return false;
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+}
+
+void ProgramCache::setDirectory(const std::string &directory) {
+    cacheDirectory = directory;
+}
+
+bool ProgramCache::enabled() {
+    static const bool available = supported();
+    return available && !cacheDirectory.empty();
+}
+
+uint64_t ProgramCache::key(std::initializer_list<std::string_view> sources) {
+    static const std::string driver = driverString();
+    uint64_t hash = hashBytes(14695981039346656037ull, driver);
+    for (std::string_view source: sources) {
+        hash = hashBytes(hash, source);
+    }
+    return hash;
+}
+
+bool ProgramCache::load(uint64_t key, unsigned int program) {
+    if (!enabled())
+        return false;
+    std::ifstream file(entryPath(key), std::ios::binary);
+    if (!file) {
+        cacheStats.misses++;
+        return false;
+    }
+
+    uint32_t magic = 0;
+    uint32_t format = 0;
+    file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char *>(&format), sizeof(format));
+    if (!file || magic != MAGIC) {
+        cacheStats.rejected++;
+        return false;
+    }
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty()) {
+        cacheStats.rejected++;
+        return false;
+    }
+
+    glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+    int success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        cacheStats.rejected++;
+        return false;
+    }
+    cacheStats.hits++;
+    return true;
+}
+
+void ProgramCache::store(uint64_t key, unsigned int program) {
+    if (!enabled())
+        return;
+    int linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+        return;
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    // write to a temporary name first so a crash never leaves a truncated entry behind
+    std::filesystem::path path = entryPath(key);
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        uint32_t magic = MAGIC;
+        uint32_t binaryFormat = format;
+        file.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+        file.write(reinterpret_cast<const char *>(&binaryFormat), sizeof(binaryFormat));
+        file.write(binary.data(), length);
+        if (!file) {
+            std::cout << "ERROR::SHADER::CACHE_WRITE_FAILED " << temporary << std::endl;
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+}
+
+const ProgramCache::Stats &ProgramCache::stats() {
+    return cacheStats;
+}
@@ -0,0 +1,38 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// On-disk cache of linked program binaries (ARB_get_program_binary).
+// Entries are keyed by a hash of everything that affects the binary: the final shader sources (defines included)
+// and the driver's vendor/renderer/version strings, so a driver update simply misses instead of loading a blob
+// the driver might reject. A rejected or unreadable blob is treated as a miss as well.
+class ProgramCache {
+public:
+    struct Stats {
+        unsigned int hits = 0;
+        unsigned int misses = 0;
+        unsigned int rejected = 0;
+    };
+
+    // empty disables the cache; the directory is created on the first store
+    static void setDirectory(const std::string &directory);
+
+    static bool enabled();
+
+    // GL thread, with a context current (the driver strings are part of the key)
+    static uint64_t key(std::initializer_list<std::string_view> sources);
+
+    // create `program` from a cached binary; false on a miss or when the driver rejects the blob
+    static bool load(uint64_t key, unsigned int program);
+
+    // write the binary of a successfully linked program
+    static void store(uint64_t key, unsigned int program);
+
+    static const Stats &stats();
+};
+
+#endif //PROGRAMCACHE_H
@@ -0,0 +1,120 @@
+#include "RenderBackend.h"
+
+#include <bit>
+#include <cstring>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLStateCache.h"
+#include "GLStats.h"
+
+namespace {
+    unsigned int floatCount(RenderQueue::UniformKind kind) {
+        switch (kind) {
+            case RenderQueue::UniformKind::Vec2:
+                return 2;
+            case RenderQueue::UniformKind::Vec3:
+                return 3;
+            case RenderQueue::UniformKind::Mat3:
+                return 9;
+            case RenderQueue::UniformKind::Mat4:
+                return 16;
+            default:
+                return 1;
+        }
+    }
+}
+
+void RenderBackend::useProgram(const Shader &shader) {
+    shader.use();
+    // a hot reload keeps the Shader but swaps the program object
+    if (program == &shader && programID == shader.ID)
+        return;
+    program = &shader;
+    programID = shader.ID;
+    programUniforms = &uniformValues[&shader];
+    if (programUniforms->generation != shader.generation()) {
+        // a new program starts out with its default values
+        programUniforms->generation = shader.generation();
+        programUniforms->known.assign(programUniforms->known.size(), 0);
+    }
+}
+
+void RenderBackend::bindVertexArray(unsigned int array) {
+    glState.bindVertexArray(array);
+}
+
+void RenderBackend::bindTexture(int unit, GLenum target, unsigned int texture) {
+    glState.bindTexture(unit, target, texture);
+}
+
+void RenderBackend::setUniform(const RenderQueue::Uniform &uniform, const float *value) {
+    const UniformHandle &handle = uniform.handle;
+    if (!handle.valid() || !program)
+        return;
+    const auto location = static_cast<size_t>(handle.location);
+    if (location >= programUniforms->known.size()) {
+        programUniforms->known.resize(location + 1, 0);
+        programUniforms->values.resize((location + 1) * 16);
+    }
+    float *cached = &programUniforms->values[location * 16];
+    const size_t bytes = floatCount(uniform.kind) * sizeof(float);
+    if (programUniforms->known[location] && std::memcmp(cached, value, bytes) == 0) {
+        ++counters.uniforms.skipped;
+        return;
+    }
+    std::memcpy(cached, value, bytes);
+    programUniforms->known[location] = 1;
+    ++counters.uniforms.issued;
+
+    switch (uniform.kind) {
+        case RenderQueue::UniformKind::Int:
+            program->setInt(handle, std::bit_cast<int>(value[0]));
+            break;
+        case RenderQueue::UniformKind::Float:
+            program->setFloat(handle, value[0]);
+            break;
+        case RenderQueue::UniformKind::Vec2:
+            program->setVec2(handle, glm::make_vec2(value));
+            break;
+        case RenderQueue::UniformKind::Vec3:
+            program->setVec3(handle, glm::make_vec3(value));
+            break;
+        case RenderQueue::UniformKind::Mat3:
+            program->setMat3(handle, glm::make_mat3(value));
+            break;
+        case RenderQueue::UniformKind::Mat4:
+            program->setMat4(handle, glm::make_mat4(value));
+            break;
+    }
+}
+
+void RenderBackend::draw(GLenum mode, int first, int count, int instances, GLenum indexType) {
+    if (indexType != GL_NONE) {
+        const size_t indexSize = indexType == GL_UNSIGNED_BYTE ? 1 : indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+        const auto *offset = reinterpret_cast<const void *>(static_cast<size_t>(first) * indexSize);
+        if (instances > 0) {
+            glDrawElementsInstanced(mode, count, indexType, offset, instances);
+        } else {
+            glDrawElements(mode, count, indexType, offset);
+        }
+    } else if (instances > 0) {
+        glDrawArraysInstanced(mode, first, count, instances);
+    } else {
+        glDrawArrays(mode, first, count);
+    }
+    ++glStats.drawCalls;
+    ++counters.draws;
+}
+
+void RenderBackend::Stats::print(std::ostream &out) const {
+    if (frames == 0)
+        return;
+    auto counter = [&](const char *what, const Counter &counter) {
+        out << ", " << what << " " << static_cast<double>(counter.issued) / frames << " issued / "
+            << static_cast<double>(counter.skipped) / frames << " skipped";
+    };
+    out << "Render queue per frame: " << static_cast<double>(draws) / frames << " draws";
+    counter("uniforms", uniforms);
+    out << ", sort " << sortSeconds * 1000.0 / frames << " ms" << std::endl;
+}
@@ -0,0 +1,62 @@
+#ifndef RENDERBACKEND_H
+#define RENDERBACKEND_H
+
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "RenderQueue.h"
+#include "Shader.h"
+
+// Replays render queue items with as few GL calls as possible. Bindings go through the GL state cache, which skips
+// the ones that are already in place; on top of that the backend remembers the uniform values of every program and
+// skips a glUniform* that would set what is already there. Uniform values live in the program objects and are kept
+// across frames, until a hot reload swaps the program.
+class RenderBackend {
+public:
+    struct Counter {
+        uint64_t issued = 0;
+        uint64_t skipped = 0;
+    };
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t draws = 0;
+        Counter uniforms;
+        double sortSeconds = 0.0;
+
+        void print(std::ostream &out) const;
+    };
+
+    void useProgram(const Shader &shader);
+
+    void bindVertexArray(unsigned int vertexArray);
+
+    void bindTexture(int unit, GLenum target, unsigned int texture);
+
+    // a value for the program of the last useProgram()
+    void setUniform(const RenderQueue::Uniform &uniform, const float *value);
+
+    void draw(GLenum mode, int first, int count, int instances, GLenum indexType = GL_NONE);
+
+    const Stats &stats() const { return counters; }
+
+    Stats &stats() { return counters; }
+
+private:
+    // the last value set at each location of one program
+    struct ProgramUniforms {
+        unsigned int generation = 0;
+        std::vector<float> values; // 16 floats per location
+        std::vector<uint8_t> known;
+    };
+
+    const Shader *program = nullptr;
+    unsigned int programID = 0;
+    ProgramUniforms *programUniforms = nullptr;
+    std::unordered_map<const Shader *, ProgramUniforms> uniformValues;
+    Stats counters;
+};
+
+#endif //RENDERBACKEND_H
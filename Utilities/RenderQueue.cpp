@@ -0,0 +1,176 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <optional>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Profiler.h"
+#include "RenderBackend.h"
+
+uint64_t RenderQueue::sortKey(uint8_t pass, uint16_t shader, uint16_t material, float depth) {
+    const auto quantized = static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * 16777215.0f);
+    return static_cast<uint64_t>(pass) << 56 | static_cast<uint64_t>(shader) << 40 |
+           static_cast<uint64_t>(material) << 24 | quantized;
+}
+
+void RenderQueue::setPass(uint8_t pass, const char *name, std::function<void()> begin) {
+    if (passes.size() <= pass) {
+        passes.resize(pass + 1);
+    }
+    passes[pass] = {name, std::move(begin)};
+}
+
+uint16_t RenderQueue::addMaterial(std::span<const TextureBinding> textures) {
+    Material material{};
+    if (textures.size() > MAX_MATERIAL_TEXTURES || materials.size() >= NO_MATERIAL) {
+        std::cout << "ERROR::RENDER_QUEUE::MATERIAL_TOO_LARGE " << textures.size() << std::endl;
+        return NO_MATERIAL;
+    }
+    std::copy(textures.begin(), textures.end(), material.textures);
+    material.count = static_cast<unsigned int>(textures.size());
+    materials.push_back(material);
+    return static_cast<uint16_t>(materials.size() - 1);
+}
+
+void RenderQueue::beginUniforms() {
+    rangeStart = static_cast<uint32_t>(uniforms.size());
+}
+
+void RenderQueue::addUniform(UniformHandle handle, UniformKind kind, const float *values, unsigned int count) {
+    uniforms.push_back({handle, kind, static_cast<uint32_t>(uniformData.size())});
+    uniformData.insert(uniformData.end(), values, values + count);
+}
+
+void RenderQueue::setInt(UniformHandle handle, int value) {
+    const auto bits = std::bit_cast<float>(value);
+    addUniform(handle, UniformKind::Int, &bits, 1);
+}
+
+void RenderQueue::setFloat(UniformHandle handle, float value) {
+    addUniform(handle, UniformKind::Float, &value, 1);
+}
+
+void RenderQueue::setVec2(UniformHandle handle, const glm::vec2 &value) {
+    addUniform(handle, UniformKind::Vec2, glm::value_ptr(value), 2);
+}
+
+void RenderQueue::setVec3(UniformHandle handle, const glm::vec3 &value) {
+    addUniform(handle, UniformKind::Vec3, glm::value_ptr(value), 3);
+}
+
+void RenderQueue::setMat3(UniformHandle handle, const glm::mat3 &value) {
+    addUniform(handle, UniformKind::Mat3, glm::value_ptr(value), 9);
+}
+
+void RenderQueue::setMat4(UniformHandle handle, const glm::mat4 &value) {
+    addUniform(handle, UniformKind::Mat4, glm::value_ptr(value), 16);
+}
+
+RenderQueue::UniformRange RenderQueue::endUniforms() {
+    return {rangeStart, static_cast<uint32_t>(uniforms.size()) - rangeStart};
+}
+
+void RenderQueue::submit(uint8_t pass, float depth, const Draw &draw) {
+    // the program name keeps the items of one program together; only its order among programs is arbitrary
+    const auto shader = static_cast<uint16_t>(draw.shader ? draw.shader->ID : 0);
+    items.push_back({sortKey(pass, shader, draw.material, depth), draw});
+}
+
+void RenderQueue::radixSort(std::vector<SortEntry> &entries, std::vector<SortEntry> &scratch) {
+    scratch.resize(entries.size());
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {};
+        for (const SortEntry &entry: entries) {
+            counts[(entry.key >> shift) & 0xff]++;
+        }
+        if (counts[(entries[0].key >> shift) & 0xff] == entries.size())
+            continue;
+        size_t offset = 0;
+        for (size_t &count: counts) {
+            const size_t bucket = count;
+            count = offset;
+            offset += bucket;
+        }
+        for (const SortEntry &entry: entries) {
+            scratch[counts[(entry.key >> shift) & 0xff]++] = entry;
+        }
+        entries.swap(scratch);
+    }
+}
+
+void RenderQueue::replay(RenderBackend &backend, const Item &item) const {
+    const Draw &draw = item.draw;
+    if (!draw.shader)
+        return;
+    backend.useProgram(*draw.shader);
+    for (const UniformRange &range: {draw.shared, draw.own}) {
+        for (uint32_t i = range.first; i < range.first + range.count; i++) {
+            backend.setUniform(uniforms[i], &uniformData[uniforms[i].offset]);
+        }
+    }
+    if (draw.material != NO_MATERIAL) {
+        const Material &material = materials[draw.material];
+        for (unsigned int i = 0; i < material.count; i++) {
+            backend.bindTexture(material.textures[i].unit, material.textures[i].target, material.textures[i].texture);
+        }
+    }
+    backend.bindVertexArray(draw.vertexArray);
+    backend.draw(draw.mode, draw.first, draw.count, draw.instances, draw.indexType);
+}
+
+void RenderQueue::execute(RenderBackend &backend) {
+    const auto start = std::chrono::steady_clock::now();
+    order.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        order[i] = {items[i].key, static_cast<uint32_t>(i)};
+    }
+    if (!order.empty()) {
+        radixSort(order, scratch);
+    }
+    RenderBackend::Stats &stats = backend.stats();
+    stats.sortSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // every registered pass gets its setup and its profiler scopes, items or not
+    std::optional<ProfileScope> passScope = std::nullopt;
+    // the GPU timer is kept as a raw Profiler scope: in a std::optional<GpuProfileScope> GCC cannot see that the
+    // scope is always set before the destructor reads it and warns at -O3
+    int passGpuScope = -1;
+    auto endGpuScope = [&]() {
+        if (passGpuScope >= 0) {
+            Profiler::endGpu(passGpuScope);
+            passGpuScope = -1;
+        }
+    };
+    size_t nextPass = 0;
+    auto beginPasses = [&](size_t last) {
+        for (; nextPass <= last && nextPass < passes.size(); nextPass++) {
+            if (!passes[nextPass].name)
+                continue;
+            endGpuScope();
+            passScope.reset();
+            passScope.emplace(passes[nextPass].name);
+            if (Profiler::enabled()) {
+                passGpuScope = Profiler::beginGpu(passes[nextPass].name);
+            }
+            if (passes[nextPass].begin) {
+                passes[nextPass].begin();
+            }
+        }
+    };
+    for (const SortEntry &entry: order) {
+        const Item &item = items[entry.item];
+        beginPasses(item.key >> 56);
+        replay(backend, item);
+    }
+    beginPasses(passes.size());
+    endGpuScope();
+    passScope.reset();
+
+    ++stats.frames;
+    items.clear();
+    uniforms.clear();
+    uniformData.clear();
+}
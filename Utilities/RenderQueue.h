@@ -0,0 +1,137 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "UniformTable.h"
+
+class RenderBackend;
+
+// The draws of one frame as a list of items, recorded in any order and replayed sorted. Each item has a 64 bit key:
+//   pass (8 bits) | shader (16) | material (16) | depth (24)
+// so the replay goes pass by pass, and within a pass groups the items of one program and then of one material,
+// front to back. Items refer to uniform values recorded in the queue; the backend skips every program, vertex array,
+// texture and uniform change that would not change anything.
+class RenderQueue {
+public:
+    static constexpr uint16_t NO_MATERIAL = 0xffff;
+    static constexpr unsigned int MAX_MATERIAL_TEXTURES = 4;
+
+    // a texture a material binds to a unit
+    struct TextureBinding {
+        int unit;
+        GLenum target;
+        unsigned int texture;
+    };
+
+    struct UniformRange {
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+
+    enum class UniformKind : uint8_t { Int, Float, Vec2, Vec3, Mat3, Mat4 };
+
+    // a recorded value; its floats (or int bits) are at offset in the queue's uniform data
+    struct Uniform {
+        UniformHandle handle;
+        UniformKind kind;
+        uint32_t offset;
+    };
+
+    struct Draw {
+        const Shader *shader = nullptr;
+        unsigned int vertexArray = 0;
+        uint16_t material = NO_MATERIAL;
+        GLenum mode = GL_TRIANGLES;
+        int first = 0;
+        int count = 0;
+        int instances = 0; // 0 draws without instancing
+        // the type of the vertex array's element buffer, first and count then count indices; GL_NONE draws arrays
+        GLenum indexType = GL_NONE;
+        // values for the item's program, e.g. the camera's shared by many items, and the item's own
+        UniformRange shared;
+        UniformRange own;
+    };
+
+    // 0 is nearest; depth is clamped to [0, 1]
+    static uint64_t sortKey(uint8_t pass, uint16_t shader, uint16_t material, float depth);
+
+    // name a pass for the profiler and give it a callback that sets up its render targets and fixed state. It runs
+    // before the pass's first item, or at its place in the pass order when the pass has no items this frame.
+    void setPass(uint8_t pass, const char *name, std::function<void()> begin = {});
+
+    // once at setup: the textures of a material, bound to their units for every item that uses it
+    uint16_t addMaterial(std::span<const TextureBinding> textures);
+
+    // uniform values are recorded between beginUniforms() and endUniforms(), which returns them as a range
+    void beginUniforms();
+
+    void setInt(UniformHandle handle, int value);
+
+    void setFloat(UniformHandle handle, float value);
+
+    void setVec2(UniformHandle handle, const glm::vec2 &value);
+
+    void setVec3(UniformHandle handle, const glm::vec3 &value);
+
+    void setMat3(UniformHandle handle, const glm::mat3 &value);
+
+    void setMat4(UniformHandle handle, const glm::mat4 &value);
+
+    UniformRange endUniforms();
+
+    void submit(uint8_t pass, float depth, const Draw &draw);
+
+    // GL thread: sort the items, replay them through the backend and empty the queue for the next frame
+    void execute(RenderBackend &backend);
+
+    size_t size() const { return items.size(); }
+
+private:
+    struct Item {
+        uint64_t key;
+        Draw draw;
+    };
+
+    struct SortEntry {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    struct Pass {
+        const char *name = nullptr;
+        std::function<void()> begin;
+    };
+
+    struct Material {
+        TextureBinding textures[MAX_MATERIAL_TEXTURES];
+        unsigned int count;
+    };
+
+    std::vector<Pass> passes;
+    std::vector<Material> materials;
+    std::vector<Item> items;
+    std::vector<Uniform> uniforms;
+    std::vector<float> uniformData;
+    uint32_t rangeStart = 0;
+    std::vector<SortEntry> order;
+    std::vector<SortEntry> scratch;
+
+    void addUniform(UniformHandle handle, UniformKind kind, const float *values, unsigned int count);
+
+    void replay(RenderBackend &backend, const Item &item) const;
+
+    // LSD radix sort on the keys, 8 bits per round; rounds in which every key has the same digit are skipped.
+    // Stable, so items with equal keys keep their submission order.
+    static void radixSort(std::vector<SortEntry> &entries, std::vector<SortEntry> &scratch);
+};
+
+#endif //RENDERQUEUE_H
@@ -3,101 +3,295 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-Shader::Shader(const char *vertexPath, const char *fragmentPath) {
+#include "GLStateCache.h"
+#include "GLStats.h"
+#include "ProgramCache.h"
+
+Shader::Shader(const char *vertexPath, const char *fragmentPath, bool deferred, const ShaderDefines &defines)
+    : vertexPath(vertexPath), fragmentPath(fragmentPath), defines(defines) {
     std::string vertexCode;
     std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
-    try {
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        vShaderFile.close();
-        fShaderFile.close();
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-    } catch (std::ifstream::failure e) {
+    if (!preprocess(vertexCode, fragmentCode, files)) {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESS" << std::endl;
-        std::cout << e.what() << std::endl;
+        std::cout << vertexPath << ", " << fragmentPath << std::endl;
+        // there is no program to finish or reflect
+        finished = true;
+        buildFailed = true;
         return;
     }
 
+    build(vertexCode, fragmentCode);
+
+    if (!deferred) {
+        finish();
+    }
+}
+
+bool Shader::preprocess(std::string &vertexCode, std::string &fragmentCode, std::vector<std::string> &files) const {
+    files.clear();
+    return ShaderPreprocessor::process(vertexPath, defines, vertexCode, files) &&
+           ShaderPreprocessor::process(fragmentPath, defines, fragmentCode, files);
+}
+
+void Shader::build(const std::string &vertexCode, const std::string &fragmentCode) {
+    ID = glCreateProgram();
+    finished = false;
+    buildFailed = false;
+    cacheKey = ProgramCache::key({vertexCode, fragmentCode});
+    if (!ProgramCache::load(cacheKey, ID)) {
+        submit(vertexCode, fragmentCode);
+    }
+}
+
+bool Shader::reload(const std::string &vertexCode, const std::string &fragmentCode, std::vector<std::string> files) {
+    finish();
+    const unsigned int previousID = ID;
+    const uint64_t previousKey = cacheKey;
+    const bool previousFailed = buildFailed;
+    UniformTable previousUniforms = std::move(uniforms);
+    // compile errors of the new sources have to be reported against the new file list
+    std::swap(this->files, files);
+
+    build(vertexCode, fragmentCode);
+    finish();
+
+    int success = GL_FALSE;
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (!success) {
+        glState.deleteProgram(ID);
+        ID = previousID;
+        cacheKey = previousKey;
+        buildFailed = previousFailed;
+        uniforms = std::move(previousUniforms);
+        std::swap(this->files, files);
+        return false;
+    }
+
+    // deleting the current program is fine, GL keeps it alive until the next glUseProgram
+    glState.deleteProgram(previousID);
+    ++revision;
+    return true;
+}
+
+void Shader::submit(const std::string &vertexCode, const std::string &fragmentCode) {
     const char *vShaderCode = vertexCode.c_str();
     const char *fShaderCode = fragmentCode.c_str();
 
-    unsigned int vertex, fragment;
     vertex = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex, 1, &vShaderCode, NULL);
     glCompileShader(vertex);
-    int success;
-    char infoLog[512];
-
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
 
     fragment = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragment, 1, &fShaderCode, NULL);
     glCompileShader(fragment);
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
 
-    ID = glCreateProgram();
     glAttachShader(ID, vertex);
     glAttachShader(ID, fragment);
+    // ask the driver to keep the binary around for the program cache
+    if (ProgramCache::enabled()) {
+        glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    // querying any status here would block on the compile, so that is left to finish()
     glLinkProgram(ID);
-    // print linking errors if any
-    glGetProgramiv(ID, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(ID, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+}
+
+bool Shader::ready() const {
+    if (finished || vertex == 0)
+        return true;
+    if (!GLAD_GL_KHR_parallel_shader_compile && !GLAD_GL_ARB_parallel_shader_compile)
+        return true;
+    int complete = GL_TRUE;
+    glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+void Shader::finish() {
+    if (finished)
+        return;
+    finished = true;
+
+    if (vertex != 0) {
+        int success;
+        char infoLog[512];
+
+        glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(vertex, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+            printSourceFiles();
+        }
+
+        glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(fragment, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+            printSourceFiles();
+        }
+
+        // print linking errors if any
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        buildFailed = !success;
+        if (!success) {
+            glGetProgramInfoLog(ID, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        }
+
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDetachShader(ID, vertex);
+        glDetachShader(ID, fragment);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        vertex = fragment = 0;
+
+        ProgramCache::store(cacheKey, ID);
+    }
+
+    reflectUniforms();
+}
+
+void Shader::printSourceFiles() const {
+    // the info logs only know source string numbers
+    for (size_t i = 0; i < files.size(); i++) {
+        std::cout << "  " << i << ": " << files[i] << std::endl;
+    }
+}
+
+void Shader::reflectUniforms() {
+    int count = 0;
+    int maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    uniforms.reserve(count);
+
+    std::string name(maxLength, '\0');
+    for (int i = 0; i < count; i++) {
+        int length = 0;
+        int size = 0;
+        GLenum type = GL_NONE;
+        glGetActiveUniform(ID, i, maxLength, &length, &size, &type, name.data());
+        std::string_view active(name.data(), length);
+
+        int location = glGetUniformLocation(ID, name.c_str());
+        ++glStats.uniformLookups;
+        // members of uniform blocks have no location
+        if (location < 0)
+            continue;
+        uniforms.insert(active, UniformHandle{location, type, size});
+
+        // arrays of basic types are reported once as "name[0]"; register the plain name and every element too
+        if (active.ends_with("[0]")) {
+            std::string base(active.substr(0, active.size() - 3));
+            uniforms.insert(base, UniformHandle{location, type, size});
+            for (int element = 1; element < size; element++) {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                int elementLocation = glGetUniformLocation(ID, elementName.c_str());
+                ++glStats.uniformLookups;
+                uniforms.insert(elementName, UniformHandle{elementLocation, type, size - element});
+            }
+        }
     }
+}
 
-    // delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+UniformHandle Shader::uniform(const std::string &name) const {
+    return uniforms.find(name);
+}
+
+void Shader::checkType([[maybe_unused]] UniformHandle handle, [[maybe_unused]] GLenum expected) const {
+#ifndef NDEBUG
+    // samplers are set with glUniform1i as well
+    bool sampler = handle.type == GL_SAMPLER_2D || handle.type == GL_SAMPLER_BUFFER ||
+                   handle.type == GL_UNSIGNED_INT_SAMPLER_BUFFER || handle.type == GL_INT_SAMPLER_BUFFER;
+    if (handle.valid() && handle.type != expected && !(expected == GL_INT && sampler)) {
+        std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH at location " << handle.location << std::endl;
+    }
+#endif
 }
 
 void Shader::use() const {
-    glUseProgram(ID);
+    glState.useProgram(ID);
 }
 
 void Shader::setBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int) value);
+    setBool(uniform(name), value);
 }
 
 void Shader::setInt(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    setInt(uniform(name), value);
 }
 
 void Shader::setFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    setFloat(uniform(name), value);
+}
+
+void Shader::setVec2(const std::string &name, const glm::vec2 &vec) const {
+    setVec2(uniform(name), vec);
+}
+
+void Shader::setMat3(const std::string &name, const glm::mat3 &mat) const {
+    setMat3(uniform(name), mat);
 }
 
 void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+    setMat4(uniform(name), mat);
 }
 
 void Shader::setVec3(const std::string &name, const glm::vec3 &vec) const {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(vec));
+    setVec3(uniform(name), vec);
 }
 
 void Shader::setVec3(const std::string &name, float x, float y, float z) const {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    setVec3(uniform(name), x, y, z);
+}
+
+void Shader::setBool(UniformHandle handle, bool value) const {
+    checkType(handle, GL_BOOL);
+    glUniform1i(handle.location, (int) value);
+    ++glStats.uniformUploads;
+}
+
+void Shader::setInt(UniformHandle handle, int value) const {
+    checkType(handle, GL_INT);
+    glUniform1i(handle.location, value);
+    ++glStats.uniformUploads;
+}
+
+void Shader::setFloat(UniformHandle handle, float value) const {
+    checkType(handle, GL_FLOAT);
+    glUniform1f(handle.location, value);
+    ++glStats.uniformUploads;
+}
+
+void Shader::setVec2(UniformHandle handle, const glm::vec2 &vec) const {
+    checkType(handle, GL_FLOAT_VEC2);
+    glUniform2fv(handle.location, 1, glm::value_ptr(vec));
+    ++glStats.uniformUploads;
+}
+
+void Shader::setMat3(UniformHandle handle, const glm::mat3 &mat) const {
+    checkType(handle, GL_FLOAT_MAT3);
+    glUniformMatrix3fv(handle.location, 1, GL_FALSE, glm::value_ptr(mat));
+    ++glStats.uniformUploads;
+}
+
+void Shader::setMat4(UniformHandle handle, const glm::mat4 &mat) const {
+    checkType(handle, GL_FLOAT_MAT4);
+    glUniformMatrix4fv(handle.location, 1, GL_FALSE, glm::value_ptr(mat));
+    ++glStats.uniformUploads;
+}
+
+void Shader::setVec3(UniformHandle handle, const glm::vec3 &vec) const {
+    checkType(handle, GL_FLOAT_VEC3);
+    glUniform3fv(handle.location, 1, glm::value_ptr(vec));
+    ++glStats.uniformUploads;
+}
+
+void Shader::setVec3(UniformHandle handle, float x, float y, float z) const {
+    checkType(handle, GL_FLOAT_VEC3);
+    glUniform3f(handle.location, x, y, z);
+    ++glStats.uniformUploads;
 }
 
 Shader::~Shader() {
-    glDeleteProgram(ID);
+    glState.deleteProgram(ID);
 }
 
@@ -1,26 +1,70 @@
 #ifndef SHADER_H
 #define SHADER_H
 #include <glad/glad.h> // include glad to get all the required OpenGL headers
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 #include "glm/fwd.hpp"
+#include "ShaderPreprocessor.h"
+#include "UniformTable.h"
 
 class Shader {
 public:
     // the program ID
-    unsigned int ID;
+    unsigned int ID = 0;
 
-    // constructor reads and builds the shader
-    Shader(const char *vertexPath, const char *fragmentPath);
+    // constructor reads, preprocesses and builds the shader. A deferred shader only submits the compile and link to
+    // the driver; call finish() (or let a ShaderLibrary do it) before using it, ideally once ready() says so.
+    Shader(const char *vertexPath, const char *fragmentPath, bool deferred = false,
+           const ShaderDefines &defines = {});
+
+    Shader(const Shader &) = delete;
+
+    Shader &operator=(const Shader &) = delete;
+
+    // true when finish() will not block: the driver's compile threads are done (KHR_parallel_shader_compile)
+    bool ready() const;
+
+    // check the compile and link results, store the binary in the program cache and reflect the uniforms
+    void finish();
 
     // use/activate the shader
     void use() const;
 
+    // read and preprocess both stages with this shader's defines; safe to call from any thread.
+    // files receives every file the sources were built from, main files included.
+    bool preprocess(std::string &vertexCode, std::string &fragmentCode, std::vector<std::string> &files) const;
+
+    // GL thread: rebuild the program from new preprocessed sources. The new program only replaces ID when it links;
+    // on failure the old one stays in place and false is returned. Handles resolved before a successful reload
+    // are stale.
+    bool reload(const std::string &vertexCode, const std::string &fragmentCode, std::vector<std::string> files);
+
+    // true when the sources could not be read or preprocessed, or the program did not link; ID is 0 in the first
+    // case. A successful reload clears it.
+    bool failed() const { return buildFailed; }
+
+    // bumped by every successful reload
+    unsigned int generation() const { return revision; }
+
+    const std::string &vertexSource() const { return vertexPath; }
+
+    const std::string &fragmentSource() const { return fragmentPath; }
+
+    // every file of the current program, indexed by GLSL source string number
+    const std::vector<std::string> &sourceFiles() const { return files; }
+
+    const ShaderDefines &permutation() const { return defines; }
+
+    // resolve a uniform once after linking; the handle stays valid for the lifetime of the program
+    UniformHandle uniform(const std::string &name) const;
+
     // utility uniform functions
     void setBool(const std::string &name, bool value) const;
 
@@ -28,12 +72,60 @@ public:
 
     void setFloat(const std::string &name, float value) const;
 
+    void setVec2(const std::string &name, const glm::vec2 &vec) const;
+
+    void setMat3(const std::string &name, const glm::mat3 &mat) const;
+
     void setMat4(const std::string &name, const glm::mat4 &mat) const;
 
     void setVec3(const std::string &name, const glm::vec3 &vec) const;
     void setVec3(const std::string &name, float x, float y, float z) const;
 
+    // handle based uniform functions, no string lookup on the hot path
+    void setBool(UniformHandle handle, bool value) const;
+
+    void setInt(UniformHandle handle, int value) const;
+
+    void setFloat(UniformHandle handle, float value) const;
+
+    void setVec2(UniformHandle handle, const glm::vec2 &vec) const;
+
+    void setMat3(UniformHandle handle, const glm::mat3 &mat) const;
+
+    void setMat4(UniformHandle handle, const glm::mat4 &mat) const;
+
+    void setVec3(UniformHandle handle, const glm::vec3 &vec) const;
+    void setVec3(UniformHandle handle, float x, float y, float z) const;
+
     ~Shader();
+
+private:
+    UniformTable uniforms;
+    std::string vertexPath;
+    std::string fragmentPath;
+    ShaderDefines defines;
+    std::vector<std::string> files;
+    unsigned int revision = 0;
+    // shader objects of a submitted build, 0 once finished or when the program came from the cache
+    unsigned int vertex = 0;
+    unsigned int fragment = 0;
+    uint64_t cacheKey = 0;
+    bool finished = false;
+    bool buildFailed = false;
+
+    // create the program object and either load it from the program cache or submit the compile and link
+    void build(const std::string &vertexCode, const std::string &fragmentCode);
+
+    // hand the sources to the driver without waiting for any result; only called when the program cache misses
+    void submit(const std::string &vertexCode, const std::string &fragmentCode);
+
+    void printSourceFiles() const;
+
+    // walk GL_ACTIVE_UNIFORMS once and fill the uniform table
+    void reflectUniforms();
+
+    // warn when a handle is used with a setter of the wrong type (debug builds only)
+    void checkType(UniformHandle handle, GLenum expected) const;
 };
 
 #endif //SHADER_H
@@ -0,0 +1,57 @@
+#include "ShaderLibrary.h"
+
+#include <iostream>
+#include <thread>
+
+ShaderLibrary::ShaderLibrary() {
+    // 0xFFFFFFFF means "implementation maximum"
+    if (GLAD_GL_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    } else if (GLAD_GL_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
+}
+
+Shader &ShaderLibrary::add(const std::string &name, const char *vertexPath, const char *fragmentPath,
+                           const ShaderDefines &defines) {
+    auto &shader = shaders[name];
+    if (shader) {
+        // replacing it would leave the references handed out for it dangling
+        std::cout << "ERROR::SHADER_LIBRARY::DUPLICATE " << name << std::endl;
+        return *shader;
+    }
+    shader = std::make_unique<Shader>(vertexPath, fragmentPath, true, defines);
+    pending.push_back(shader.get());
+    return *shader;
+}
+
+bool ShaderLibrary::poll() {
+    for (size_t i = 0; i < pending.size();) {
+        if (!pending[i]->ready()) {
+            i++;
+            continue;
+        }
+        pending[i]->finish();
+        pending[i] = pending.back();
+        pending.pop_back();
+    }
+    return pending.empty();
+}
+
+bool ShaderLibrary::finish() {
+    while (!poll()) {
+        std::this_thread::yield();
+    }
+    bool usable = true;
+    for (const auto &[name, shader]: shaders) {
+        if (shader->failed()) {
+            std::cout << "ERROR::SHADER_LIBRARY::BUILD_FAILED " << name << std::endl;
+            usable = false;
+        }
+    }
+    return usable;
+}
+
+Shader &ShaderLibrary::get(const std::string &name) const {
+    return *shaders.at(name);
+}
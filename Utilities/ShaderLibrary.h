@@ -0,0 +1,37 @@
+#ifndef SHADERLIBRARY_H
+#define SHADERLIBRARY_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Shader.h"
+
+// Builds a whole set of programs at once. Every add() only submits the compile and link, so with
+// KHR_parallel_shader_compile the driver's compiler threads work on all of them concurrently; finish()
+// then completes the programs in whatever order the driver is done with them.
+class ShaderLibrary {
+public:
+    // GL thread; lets the driver use as many compiler threads as it likes
+    ShaderLibrary();
+
+    // submit a program; the reference stays valid for the lifetime of the library. A name that is already taken
+    // is reported and the existing program returned
+    Shader &add(const std::string &name, const char *vertexPath, const char *fragmentPath,
+                const ShaderDefines &defines = {});
+
+    // non-blocking: finish the programs the driver is done with; true once all of them are usable
+    bool poll();
+
+    // block until every program is finished; reports the ones that failed to build and returns false if there were any
+    bool finish();
+
+    Shader &get(const std::string &name) const;
+
+private:
+    std::unordered_map<std::string, std::unique_ptr<Shader> > shaders;
+    std::vector<Shader *> pending;
+};
+
+#endif //SHADERLIBRARY_H
@@ -0,0 +1,165 @@
+#include "ShaderPreprocessor.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+namespace {
+    struct Expansion {
+        std::string &code;
+        std::vector<std::string> &files;
+        std::vector<std::string> stack; // files currently being expanded, to report include cycles
+        std::vector<std::string> included; // files already expanded into this stage
+    };
+
+    std::string lineDirective(int line, size_t file) {
+        return "#line " + std::to_string(line) + " " + std::to_string(file) + "\n";
+    }
+
+    std::string defineBlock(const ShaderDefines &defines) {
+        std::string block;
+        for (const auto &[name, value]: defines.entries()) {
+            block += "#define " + name + " " + value + "\n";
+        }
+        return block;
+    }
+
+    size_t fileNumber(std::vector<std::string> &files, const std::string &path) {
+        auto found = std::find(files.begin(), files.end(), path);
+        if (found != files.end())
+            return static_cast<size_t>(found - files.begin());
+        files.push_back(path);
+        return files.size() - 1;
+    }
+
+    bool expand(const std::string &path, const ShaderDefines *defines, Expansion &expansion) {
+        std::string source;
+        if (!ShaderPreprocessor::readFile(path, source)) {
+            std::cout << "ERROR::SHADER::PREPROCESSOR::FILE_NOT_FOUND " << path << std::endl;
+            return false;
+        }
+        const size_t number = fileNumber(expansion.files, path);
+        expansion.stack.push_back(path);
+        expansion.included.push_back(path);
+        std::string &code = expansion.code;
+        const size_t start = code.size();
+
+        // only the root file carries the #version line the defines have to follow
+        bool injected = defines == nullptr;
+        if (!defines) {
+            code += lineDirective(1, number);
+        }
+
+        std::istringstream lines(source);
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(lines, line)) {
+            ++lineNumber;
+            std::string_view directive(line);
+            size_t first = directive.find_first_not_of(" \t");
+            directive.remove_prefix(first == std::string_view::npos ? directive.size() : first);
+
+            if (directive.starts_with("#version")) {
+                if (defines && !injected) {
+                    code += line + "\n" + defineBlock(*defines) + lineDirective(lineNumber + 1, number);
+                    injected = true;
+                } else {
+                    // a #version in an included file would be an error after the first line; keep the line count
+                    code += "\n";
+                }
+                continue;
+            }
+
+            if (!directive.starts_with("#include")) {
+                code += line + "\n";
+                continue;
+            }
+
+            size_t open = directive.find_first_of("\"<", 8);
+            size_t close = open == std::string_view::npos ? open : directive.find_first_of("\">", open + 1);
+            if (close == std::string_view::npos) {
+                std::cout << "ERROR::SHADER::PREPROCESSOR::MALFORMED_INCLUDE " << path << ":" << lineNumber
+                          << std::endl;
+                return false;
+            }
+            std::string target = (std::filesystem::path(path).parent_path() /
+                                  std::string(directive.substr(open + 1, close - open - 1)))
+                    .lexically_normal().generic_string();
+
+            if (std::find(expansion.stack.begin(), expansion.stack.end(), target) != expansion.stack.end()) {
+                std::cout << "ERROR::SHADER::PREPROCESSOR::INCLUDE_CYCLE " << path << ":" << lineNumber << " -> "
+                          << target << std::endl;
+                return false;
+            }
+            if (std::find(expansion.included.begin(), expansion.included.end(), target) != expansion.included.end()) {
+                code += "\n";
+                continue;
+            }
+            if (!expand(target, nullptr, expansion))
+                return false;
+            code += lineDirective(lineNumber + 1, number);
+        }
+
+        // without a #version line the defines simply go first
+        if (!injected && !defines->empty()) {
+            code.insert(start, defineBlock(*defines) + lineDirective(1, number));
+        }
+        expansion.stack.pop_back();
+        return true;
+    }
+
+    // FNV-1a, 64 bit
+    uint64_t hashBytes(uint64_t hash, std::string_view bytes) {
+        for (char c: bytes) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        hash ^= 0xff;
+        hash *= 1099511628211ull;
+        return hash;
+    }
+}
+
+ShaderDefines &ShaderDefines::set(const std::string &name, const std::string &value) {
+    auto position = std::lower_bound(defines.begin(), defines.end(), name,
+                                     [](const auto &entry, const std::string &key) { return entry.first < key; });
+    if (position != defines.end() && position->first == name) {
+        position->second = value;
+    } else {
+        defines.insert(position, {name, value});
+    }
+    return *this;
+}
+
+ShaderDefines &ShaderDefines::set(const std::string &name, int value) {
+    return set(name, std::to_string(value));
+}
+
+uint64_t ShaderDefines::key() const {
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto &[name, value]: defines) {
+        hash = hashBytes(hash, name);
+        hash = hashBytes(hash, value);
+    }
+    return hash;
+}
+
+bool ShaderPreprocessor::process(const std::string &path, const ShaderDefines &defines, std::string &code,
+                                 std::vector<std::string> &files) {
+    code.clear();
+    Expansion expansion{code, files, {}, {}};
+    return expand(std::filesystem::path(path).lexically_normal().generic_string(), &defines, expansion);
+}
+
+bool ShaderPreprocessor::readFile(const std::string &path, std::string &code) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    std::stringstream stream;
+    stream << file.rdbuf();
+    code = stream.str();
+    return !file.bad();
+}
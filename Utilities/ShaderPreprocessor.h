@@ -0,0 +1,41 @@
+#ifndef SHADERPREPROCESSOR_H
+#define SHADERPREPROCESSOR_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Defines injected into a shader right after its #version line. Kept sorted by name, so two sets with the same
+// entries produce the same source text and the same permutation key whatever order they were set in.
+class ShaderDefines {
+public:
+    ShaderDefines &set(const std::string &name, const std::string &value = "1");
+
+    ShaderDefines &set(const std::string &name, int value);
+
+    // identifies the permutation; stable across runs
+    uint64_t key() const;
+
+    bool empty() const { return defines.empty(); }
+
+    const std::vector<std::pair<std::string, std::string> > &entries() const { return defines; }
+
+private:
+    std::vector<std::pair<std::string, std::string> > defines;
+};
+
+// Expands #include "file" (relative to the including file) and injects ShaderDefines. Every file is included at most
+// once per stage, so shared headers need no include guards. Each file gets a GLSL source string number through
+// #line, so compiler errors of the form "N:line(column)" point at files[N] and its real line.
+class ShaderPreprocessor {
+public:
+    // thread safe. files receives every file read, in source string number order; a file already in the list
+    // (e.g. from the other stage of the same program) keeps its number.
+    static bool process(const std::string &path, const ShaderDefines &defines, std::string &code,
+                        std::vector<std::string> &files);
+
+    static bool readFile(const std::string &path, std::string &code);
+};
+
+#endif //SHADERPREPROCESSOR_H
@@ -0,0 +1,23 @@
+#include "ShaderVariantCache.h"
+
+ShaderVariantCache::ShaderVariantCache(std::string vertexPath, std::string fragmentPath)
+    : vertexPath(std::move(vertexPath)), fragmentPath(std::move(fragmentPath)) {
+}
+
+Shader &ShaderVariantCache::variant(const ShaderDefines &defines) {
+    std::unique_ptr<Shader> &shader = variants[defines.key()];
+    if (!shader) {
+        shader = std::make_unique<Shader>(vertexPath.c_str(), fragmentPath.c_str(), true, defines);
+    }
+    return *shader;
+}
+
+void ShaderVariantCache::request(const ShaderDefines &defines) {
+    variant(defines);
+}
+
+Shader &ShaderVariantCache::get(const ShaderDefines &defines) {
+    Shader &shader = variant(defines);
+    shader.finish();
+    return shader;
+}
@@ -0,0 +1,40 @@
+#ifndef SHADERVARIANTCACHE_H
+#define SHADERVARIANTCACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "Shader.h"
+#include "ShaderPreprocessor.h"
+
+// All permutations of one vertex/fragment pair, e.g. the lighting shader specialized for a light count.
+// A variant is compiled the first time its defines are requested and memoized by their permutation key,
+// so switching back and forth between variants only ever compiles each of them once.
+class ShaderVariantCache {
+public:
+    ShaderVariantCache(std::string vertexPath, std::string fragmentPath);
+
+    ShaderVariantCache(const ShaderVariantCache &) = delete;
+
+    ShaderVariantCache &operator=(const ShaderVariantCache &) = delete;
+
+    // GL thread: submit the variant's compile and link without waiting, so the driver can build it alongside
+    // other programs; a later get() finishes it
+    void request(const ShaderDefines &defines);
+
+    // GL thread: the finished variant; the reference stays valid for the lifetime of the cache
+    Shader &get(const ShaderDefines &defines);
+
+    size_t size() const { return variants.size(); }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::unordered_map<uint64_t, std::unique_ptr<Shader> > variants;
+
+    Shader &variant(const ShaderDefines &defines);
+};
+
+#endif //SHADERVARIANTCACHE_H
@@ -0,0 +1,192 @@
+#include "ShaderWatcher.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // how often the watcher thread checks for shutdown
+    constexpr int POLL_INTERVAL_MS = 100;
+    // editors write a file in several steps; wait for this much quiet before reading it
+    constexpr int SETTLE_MS = 50;
+}
+
+ShaderWatcher::ShaderWatcher() {
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        std::cout << "ERROR::SHADER_WATCHER::INOTIFY_INIT_FAILED" << std::endl;
+        return;
+    }
+    thread = std::thread(&ShaderWatcher::run, this);
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher() {
+    stopping = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+#ifdef __linux__
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+std::string ShaderWatcher::normalize(const std::string &path) {
+    std::error_code error;
+    std::filesystem::path absolute = std::filesystem::weakly_canonical(path, error);
+    return error ? std::filesystem::path(path).lexically_normal().string() : absolute.string();
+}
+
+void ShaderWatcher::watch(Shader &shader) {
+    if (fd < 0)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    track(shader, shader.sourceFiles());
+}
+
+void ShaderWatcher::track(Shader &shader, const std::vector<std::string> &sources) {
+#ifdef __linux__
+    for (const std::string &source: sources) {
+        std::string file = normalize(source);
+        std::vector<Shader *> &users = files[file];
+        if (std::find(users.begin(), users.end(), &shader) != users.end())
+            continue;
+        users.push_back(&shader);
+
+        // watch the directory rather than the file: editors that save by renaming a temp file over the original
+        // would otherwise leave us watching a deleted inode
+        std::string directory = std::filesystem::path(file).parent_path().string();
+        int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0) {
+            std::cout << "ERROR::SHADER_WATCHER::WATCH_FAILED " << directory << std::endl;
+            continue;
+        }
+        directories[wd] = directory;
+    }
+#else
+    (void) shader;
+    (void) sources;
+#endif
+}
+
+void ShaderWatcher::run() {
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    std::unordered_set<Shader *> dirty;
+    pollfd descriptor{fd, POLLIN, 0};
+
+    while (!stopping) {
+        // while changes are coming in, keep collecting until the files have settled
+        int ready = poll(&descriptor, 1, dirty.empty() ? POLL_INTERVAL_MS : SETTLE_MS);
+        if (ready > 0) {
+            ssize_t length;
+            while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (char *p = buffer; p < buffer + length;) {
+                    const auto *event = reinterpret_cast<const inotify_event *>(p);
+                    p += sizeof(inotify_event) + event->len;
+                    auto directory = directories.find(event->wd);
+                    if (event->len == 0 || directory == directories.end())
+                        continue;
+                    auto users = files.find(normalize(directory->second + "/" + event->name));
+                    if (users != files.end()) {
+                        dirty.insert(users->second.begin(), users->second.end());
+                    }
+                }
+            }
+            continue;
+        }
+        if (ready < 0 || dirty.empty())
+            continue;
+
+        for (Shader *shader: dirty) {
+            Reload reload{shader, {}, {}, {}};
+            if (!prepare(reload))
+                continue;
+            std::lock_guard<std::mutex> lock(mutex);
+            // an edit may have added an #include
+            track(*shader, reload.files);
+            // a newer edit supersedes one the GL thread has not picked up yet
+            std::erase_if(reloads, [shader](const Reload &queued) { return queued.shader == shader; });
+            reloads.push_back(std::move(reload));
+        }
+        dirty.clear();
+    }
+#endif
+}
+
+bool ShaderWatcher::prepare(Reload &reload) {
+    if (!reload.shader->preprocess(reload.vertexCode, reload.fragmentCode, reload.files))
+        return false;
+    return validate(reload.shader->vertexSource(), reload.vertexCode) &&
+           validate(reload.shader->fragmentSource(), reload.fragmentCode);
+}
+
+bool ShaderWatcher::validate(const std::string &path, const std::string &code) {
+    size_t first = code.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos || code.compare(first, 8, "#version") != 0) {
+        std::cout << "ERROR::SHADER_WATCHER::MISSING_VERSION " << path << std::endl;
+        return false;
+    }
+
+    // unbalanced brackets almost always mean a half written file; skip comments so they do not count
+    int braces = 0;
+    int parentheses = 0;
+    for (size_t i = 0; i < code.size(); i++) {
+        if (code.compare(i, 2, "//") == 0) {
+            i = code.find('\n', i);
+            if (i == std::string::npos)
+                break;
+        } else if (code.compare(i, 2, "/*") == 0) {
+            i = code.find("*/", i + 2);
+            if (i == std::string::npos)
+                break;
+            i++;
+        } else if (code[i] == '{') {
+            braces++;
+        } else if (code[i] == '}') {
+            braces--;
+        } else if (code[i] == '(') {
+            parentheses++;
+        } else if (code[i] == ')') {
+            parentheses--;
+        }
+    }
+    if (braces != 0 || parentheses != 0) {
+        std::cout << "ERROR::SHADER_WATCHER::UNBALANCED_BRACKETS " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::vector<Shader *> ShaderWatcher::apply() {
+    std::vector<Reload> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (reloads.empty())
+            return {};
+        pending.swap(reloads);
+    }
+
+    std::vector<Shader *> reloaded;
+    for (Reload &reload: pending) {
+        if (reload.shader->reload(reload.vertexCode, reload.fragmentCode, std::move(reload.files))) {
+            std::cout << "Reloaded " << reload.shader->vertexSource() << ", " << reload.shader->fragmentSource()
+                      << std::endl;
+            reloaded.push_back(reload.shader);
+        } else {
+            std::cout << "ERROR::SHADER_WATCHER::RELOAD_FAILED, keeping the previous program" << std::endl;
+        }
+    }
+    return reloaded;
+}
@@ -0,0 +1,66 @@
+#ifndef SHADERWATCHER_H
+#define SHADERWATCHER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Shader.h"
+
+// Hot reload for shader sources. A background thread waits on inotify for writes to any file a watched program was
+// built from (#includes too), preprocesses and sanity checks the new sources off the GL thread, and queues them;
+// apply() then rebuilds the programs on the GL thread between two frames. A source that fails to compile or link leaves the running program untouched.
+// Only Linux has a watcher; elsewhere watch() is a no-op and apply() never reloads anything.
+class ShaderWatcher {
+public:
+    ShaderWatcher();
+
+    ~ShaderWatcher();
+
+    ShaderWatcher(const ShaderWatcher &) = delete;
+
+    ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+    // GL thread; the shader must outlive the watcher
+    void watch(Shader &shader);
+
+    // GL thread, at a frame boundary: rebuild every shader whose sources changed. Returns the shaders that now
+    // run a new program, so the caller can resolve their uniform handles and block bindings again.
+    std::vector<Shader *> apply();
+
+    bool active() const { return fd >= 0; }
+
+private:
+    struct Reload {
+        Shader *shader;
+        std::string vertexCode;
+        std::string fragmentCode;
+        std::vector<std::string> files;
+    };
+
+    int fd = -1;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+
+    std::mutex mutex;
+    std::unordered_map<int, std::string> directories; // inotify watch descriptor -> directory
+    std::unordered_map<std::string, std::vector<Shader *> > files; // normalized path -> shaders using it
+    std::vector<Reload> reloads;
+
+    void run();
+
+    // add inotify watches for the files of a shader; the caller holds the mutex
+    void track(Shader &shader, const std::vector<std::string> &sources);
+
+    // preprocess both stages and reject sources that are obviously incomplete, e.g. caught halfway through a save
+    static bool prepare(Reload &reload);
+
+    static bool validate(const std::string &path, const std::string &code);
+
+    static std::string normalize(const std::string &path);
+};
+
+#endif //SHADERWATCHER_H
@@ -0,0 +1,138 @@
+#include "StagingMemory.h"
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+    // below this size malloc is cheap enough, above it the block is unlikely to be reused
+    constexpr unsigned int MIN_CLASS = 16; // 64 KB
+    constexpr unsigned int MAX_CLASS = 28; // 256 MB
+    constexpr unsigned int UNPOOLED = 0;
+    constexpr size_t MAX_POOLED_BYTES = size_t(512) << 20;
+
+    // sits in front of every block; 16 bytes keeps the user pointer 16 byte aligned
+    struct alignas(16) BlockHeader {
+        size_t size; // requested size
+        unsigned int sizeClass;
+    };
+
+    std::mutex poolMutex;
+    std::array<std::vector<BlockHeader *>, MAX_CLASS + 1> freeLists;
+    size_t pooled = 0;
+
+    unsigned int classFor(size_t size) {
+        unsigned int sizeClass = MIN_CLASS;
+        while (sizeClass <= MAX_CLASS && (size_t(1) << sizeClass) < size)
+            sizeClass++;
+        return sizeClass <= MAX_CLASS ? sizeClass : UNPOOLED;
+    }
+
+    // the caller's memory that the next allocation of its size goes to, see setTarget()
+    struct Target {
+        void *memory = nullptr;
+        size_t size = 0;
+        bool taken = false;
+    };
+
+    thread_local Target target;
+
+    BlockHeader *header(void *block) {
+        return static_cast<BlockHeader *>(block) - 1;
+    }
+}
+
+void *StagingMemory::allocate(size_t size) {
+    if (target.memory && !target.taken && size == target.size) {
+        target.taken = true;
+        return target.memory;
+    }
+    if (size + sizeof(BlockHeader) < (size_t(1) << MIN_CLASS)) {
+        auto *small = static_cast<BlockHeader *>(std::malloc(size + sizeof(BlockHeader)));
+        if (small == nullptr)
+            return nullptr;
+        *small = BlockHeader{size, UNPOOLED};
+        return small + 1;
+    }
+
+    unsigned int sizeClass = classFor(size + sizeof(BlockHeader));
+    BlockHeader *block = nullptr;
+    if (sizeClass != UNPOOLED) {
+        std::lock_guard lock(poolMutex);
+        auto &list = freeLists[sizeClass];
+        if (!list.empty()) {
+            block = list.back();
+            list.pop_back();
+            pooled -= size_t(1) << sizeClass;
+        }
+    }
+    if (block == nullptr) {
+        size_t bytes = sizeClass != UNPOOLED ? size_t(1) << sizeClass : size + sizeof(BlockHeader);
+        block = static_cast<BlockHeader *>(std::malloc(bytes));
+        if (block == nullptr)
+            return nullptr;
+    }
+    *block = BlockHeader{size, sizeClass};
+    return block + 1;
+}
+
+void *StagingMemory::reallocate(void *block, size_t size) {
+    if (block == nullptr)
+        return allocate(size);
+    if (block == target.memory) {
+        // grown or shrunk: the data moves into a block of the pool and the target is free again
+        target.taken = true;
+        void *moved = allocate(size);
+        if (moved != nullptr) {
+            std::memcpy(moved, block, target.size < size ? target.size : size);
+        }
+        target.taken = moved == nullptr;
+        return moved;
+    }
+    BlockHeader *old = header(block);
+    if (old->sizeClass != UNPOOLED && size + sizeof(BlockHeader) <= (size_t(1) << old->sizeClass)) {
+        old->size = size;
+        return block;
+    }
+    void *grown = allocate(size);
+    if (grown == nullptr)
+        return nullptr;
+    std::memcpy(grown, block, old->size < size ? old->size : size);
+    release(block);
+    return grown;
+}
+
+void StagingMemory::release(void *block) {
+    if (block == nullptr)
+        return;
+    if (block == target.memory) {
+        target.taken = false;
+        return;
+    }
+    BlockHeader *released = header(block);
+    if (released->sizeClass != UNPOOLED) {
+        std::lock_guard lock(poolMutex);
+        size_t bytes = size_t(1) << released->sizeClass;
+        if (pooled + bytes <= MAX_POOLED_BYTES) {
+            freeLists[released->sizeClass].push_back(released);
+            pooled += bytes;
+            return;
+        }
+    }
+    std::free(released);
+}
+
+void StagingMemory::setTarget(void *memory, size_t size) {
+    target = Target{memory, size, false};
+}
+
+void StagingMemory::clearTarget() {
+    target = Target();
+}
+
+size_t StagingMemory::pooledBytes() {
+    std::lock_guard lock(poolMutex);
+    return pooled;
+}
@@ -0,0 +1,29 @@
+#ifndef STAGINGMEMORY_H
+#define STAGINGMEMORY_H
+
+#include <cstddef>
+
+// Pooled allocator for large short-lived staging blocks (decoded images and decoder scratch memory).
+// Blocks are rounded up to power-of-two size classes and recycled through per-class free lists instead of
+// going back to malloc, so decoding hundreds of same-sized textures stops churning the heap.
+// Thread safe: blocks are typically allocated on a decode worker and released on the GL thread.
+class StagingMemory {
+public:
+    static void *allocate(size_t size);
+
+    static void *reallocate(void *block, size_t size);
+
+    static void release(void *block);
+
+    // On this thread, hand out target, memory the caller owns (a PBO slot), for the next allocation of exactly size
+    // bytes, so a decoder writes its result straight there. The target is never pooled or freed; if the decoder
+    // frees it, a later allocation of that size may take it again. clearTarget() before the target is used elsewhere.
+    static void setTarget(void *target, size_t size);
+
+    static void clearTarget();
+
+    // bytes currently parked in the free lists
+    static size_t pooledBytes();
+};
+
+#endif //STAGINGMEMORY_H
@@ -0,0 +1,148 @@
+#include "TextureLoader.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "../Libs/image/stb_image.h"
+#include "GLStateCache.h"
+#include "Profiler.h"
+#include "StagingMemory.h"
+
+TextureLoader::TextureLoader(unsigned int threads) : streamer(std::make_unique<TextureStreamer>()),
+                                                     workers(std::make_unique<ThreadPool>(threads)) {
+}
+
+TextureLoader::~TextureLoader() {
+    // joining the workers drains the queue (waiting for slots would never end, so stop that first);
+    // then release whatever was decoded but never uploaded
+    streamer->shutdown();
+    workers.reset();
+    std::lock_guard lock(decodedMutex);
+    for (DecodedImage &image: decoded) {
+        stbi_image_free(image.pixels);
+    }
+}
+
+unsigned int TextureLoader::load(const std::string &path, bool flipVertically) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    // mid grey stands in until the real image arrives
+    const unsigned char placeholder[4] = {128, 128, 128, 255};
+    glState.bindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    outstanding++;
+    workers->submit([this, textureID, path, flipVertically] {
+        PROFILE_SCOPE("decode texture");
+        stbi_set_flip_vertically_on_load_thread(flipVertically);
+        DecodedImage image{textureID, path, -1, nullptr, 0, 0, 0};
+        // the header gives the size of the result, so the decoder's output allocation can be a slot: the pixels
+        // land in GL memory without a copy
+        int width, height, components;
+        size_t bytes = 0;
+        if (stbi_info(path.c_str(), &width, &height, &components)) {
+            bytes = static_cast<size_t>(width) * height * components;
+        }
+        if (bytes > 0 && bytes <= streamer->slotSize()) {
+            image.slot = streamer->acquire();
+            if (image.slot >= 0) {
+                StagingMemory::setTarget(streamer->memory(image.slot), bytes);
+            }
+        }
+        image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+        StagingMemory::clearTarget();
+
+        if (image.slot >= 0 && image.pixels == streamer->memory(image.slot)) {
+            image.pixels = nullptr;
+        } else if (image.pixels) {
+            // decoded elsewhere, e.g. when the format converts at the end: copy into a slot if it fits
+            bytes = static_cast<size_t>(image.width) * image.height * image.components;
+            if (image.slot < 0 && bytes <= streamer->slotSize()) {
+                image.slot = streamer->acquire();
+            }
+            if (image.slot >= 0 && bytes <= streamer->slotSize()) {
+                std::memcpy(streamer->memory(image.slot), image.pixels, bytes);
+                stbi_image_free(image.pixels);
+                image.pixels = nullptr;
+            } else if (image.slot >= 0) {
+                streamer->giveBack(image.slot);
+                image.slot = -1;
+            }
+        } else if (image.slot >= 0) {
+            streamer->giveBack(image.slot);
+            image.slot = -1;
+        }
+        {
+            std::lock_guard lock(decodedMutex);
+            decoded.push_back(image);
+        }
+        decodedReady.notify_one();
+    });
+    return textureID;
+}
+
+void TextureLoader::update(size_t budgetBytes) {
+    streamer->recycle();
+    std::vector<DecodedImage> ready;
+    {
+        std::lock_guard lock(decodedMutex);
+        size_t bytes = 0;
+        size_t count = 0;
+        while (count < decoded.size() && (count == 0 || bytes < budgetBytes)) {
+            const DecodedImage &image = decoded[count++];
+            bytes += static_cast<size_t>(image.width) * image.height * image.components;
+        }
+        ready.assign(decoded.begin(), decoded.begin() + count);
+        decoded.erase(decoded.begin(), decoded.begin() + count);
+    }
+    for (const DecodedImage &image: ready) {
+        upload(image);
+    }
+}
+
+void TextureLoader::finish() {
+    while (outstanding > 0) {
+        update(static_cast<size_t>(-1));
+        // workers may be waiting for slots that only update() recycles, so never block for long
+        std::unique_lock lock(decodedMutex);
+        decodedReady.wait_for(lock, std::chrono::milliseconds(1), [this] { return !decoded.empty(); });
+    }
+}
+
+void TextureLoader::upload(const DecodedImage &image) {
+    PROFILE_SCOPE("upload texture");
+    outstanding--;
+    if (image.slot < 0 && !image.pixels) {
+        std::cout << "Texture failed to load at path: " << image.path << std::endl;
+        return;
+    }
+
+    GLenum format = GL_RGB;
+    if (image.components == 1)
+        format = GL_RED;
+    else if (image.components == 3)
+        format = GL_RGB;
+    else if (image.components == 4)
+        format = GL_RGBA;
+
+    glState.bindTexture(GL_TEXTURE_2D, image.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (image.slot >= 0) {
+        streamer->upload(image.slot, format, image.width, image.height);
+    } else {
+        streamer->upload(image.pixels, format, image.width, image.height);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+    stbi_image_free(image.pixels);
+}
@@ -0,0 +1,64 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+// Texture loading service. load() hands out a texture name right away, backed by a 1x1 placeholder;
+// a thread pool decodes the file with stb_image into pooled staging memory and copies the pixels straight into
+// a TextureStreamer PBO slot. update() on the GL thread then uploads finished images from those slots within a
+// per-frame byte budget, so a burst of loads never causes a long frame.
+class TextureLoader {
+public:
+    static constexpr size_t DEFAULT_UPLOAD_BUDGET = 16 << 20;
+
+    explicit TextureLoader(unsigned int threads = std::thread::hardware_concurrency());
+
+    ~TextureLoader();
+
+    TextureLoader(const TextureLoader &) = delete;
+
+    TextureLoader &operator=(const TextureLoader &) = delete;
+
+    // GL thread only
+    unsigned int load(const std::string &path, bool flipVertically = false);
+
+    // GL thread, once per frame: upload decoded images until budgetBytes is used up (at least one per call)
+    void update(size_t budgetBytes = DEFAULT_UPLOAD_BUDGET);
+
+    // GL thread: block until every requested texture has been decoded and uploaded
+    void finish();
+
+    // textures still showing their placeholder
+    unsigned int pending() const { return outstanding; }
+
+    const TextureStreamer::Stats &uploadStats() const { return streamer->stats(); }
+
+private:
+    struct DecodedImage {
+        unsigned int texture;
+        std::string path;
+        int slot; // streamer slot holding the pixels, or -1
+        unsigned char *pixels; // owned, released with stbi_image_free; only set when slot is -1
+        int width;
+        int height;
+        int components;
+    };
+
+    std::mutex decodedMutex;
+    std::condition_variable decodedReady;
+    std::vector<DecodedImage> decoded;
+    unsigned int outstanding = 0;
+    std::unique_ptr<TextureStreamer> streamer;
+    std::unique_ptr<ThreadPool> workers;
+
+    void upload(const DecodedImage &image);
+};
+
+#endif //TEXTURELOADER_H
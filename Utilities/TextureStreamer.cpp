@@ -0,0 +1,151 @@
+#include "TextureStreamer.h"
+
+#include <chrono>
+
+#include "GLStateCache.h"
+
+static uint64_t imageBytes(GLenum format, int width, int height) {
+    unsigned int components = format == GL_RED ? 1 : format == GL_RGB ? 3 : 4;
+    return static_cast<uint64_t>(width) * height * components;
+}
+
+TextureStreamer::TextureStreamer(unsigned int slotCount, size_t slotSize) : slotBytes(slotSize) {
+    slots.resize(slotCount);
+    persistentMapping = GLAD_GL_ARB_buffer_storage;
+    if (persistentMapping) {
+        // decoders write their output straight into the slots and some read it back (PNG filters use the row
+        // above, flipping swaps rows), so the mapping has to be readable
+        const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotCount * slotSize, nullptr, flags);
+        auto *base = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotCount * slotSize,
+                                                                   flags));
+        for (unsigned int i = 0; i < slotCount; i++) {
+            slots[i] = Slot{buffer, i * slotSize, base + i * slotSize, nullptr};
+        }
+    } else {
+        for (unsigned int i = 0; i < slotCount; i++) {
+            unsigned int buffer;
+            glGenBuffers(1, &buffer);
+            glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, GL_STREAM_DRAW);
+            slots[i] = Slot{buffer, 0, nullptr, nullptr};
+        }
+    }
+    glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    for (unsigned int i = 0; i < slotCount; i++) {
+        release(static_cast<int>(i));
+    }
+}
+
+TextureStreamer::~TextureStreamer() {
+    for (const Slot &slot: slots) {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (!persistentMapping && slot.memory) {
+            glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.PBO);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        if (!persistentMapping || slot.offset == 0)
+            glState.deleteBuffers(1, &slot.PBO);
+    }
+    glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// GL thread: make the slot writable again and put it on the free list
+void TextureStreamer::release(int slot) {
+    Slot &s = slots[slot];
+    if (!persistentMapping) {
+        glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, s.PBO);
+        // orphan the old storage instead of GL_MAP_INVALIDATE_BUFFER_BIT, which GL does not allow on a readable
+        // mapping
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, slotBytes, nullptr, GL_STREAM_DRAW);
+        s.memory = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotBytes,
+                                                                 GL_MAP_READ_BIT | GL_MAP_WRITE_BIT));
+        glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    {
+        std::lock_guard lock(freeMutex);
+        freeSlots.push_back(slot);
+    }
+    freeAvailable.notify_one();
+}
+
+void TextureStreamer::giveBack(int slot) {
+    {
+        std::lock_guard lock(freeMutex);
+        freeSlots.push_front(slot);
+    }
+    freeAvailable.notify_one();
+}
+
+int TextureStreamer::acquire() {
+    std::unique_lock lock(freeMutex);
+    freeAvailable.wait(lock, [this] { return stopping || !freeSlots.empty(); });
+    if (stopping)
+        return -1;
+    int slot = freeSlots.front();
+    freeSlots.pop_front();
+    return slot;
+}
+
+void TextureStreamer::shutdown() {
+    {
+        std::lock_guard lock(freeMutex);
+        stopping = true;
+    }
+    freeAvailable.notify_all();
+}
+
+void TextureStreamer::upload(int slot, GLenum format, int width, int height) {
+    auto start = std::chrono::steady_clock::now();
+    Slot &s = slots[slot];
+    glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, s.PBO);
+    if (!persistentMapping) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        s.memory = nullptr;
+    }
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, (void *) s.offset);
+    glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    inFlight.push_back(slot);
+
+    counters.textures++;
+    counters.streamedBytes += imageBytes(format, width, height);
+    counters.uploadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TextureStreamer::upload(const unsigned char *pixels, GLenum format, int width, int height) {
+    auto start = std::chrono::steady_clock::now();
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+
+    counters.textures++;
+    counters.clientBytes += imageBytes(format, width, height);
+    counters.uploadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TextureStreamer::recycle() {
+    for (size_t i = 0; i < inFlight.size();) {
+        Slot &s = slots[inFlight[i]];
+        if (glClientWaitSync(s.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            i++;
+            continue;
+        }
+        glDeleteSync(s.fence);
+        s.fence = nullptr;
+        release(inFlight[i]);
+        inFlight[i] = inFlight.back();
+        inFlight.pop_back();
+    }
+}
+
+void TextureStreamer::Stats::print(std::ostream &out) const {
+    if (textures == 0)
+        return;
+    double megabytes = (streamedBytes + clientBytes) / (1024.0 * 1024.0);
+    out << "Texture uploads: " << textures << " textures, " << megabytes << " MB ("
+        << streamedBytes / (1024.0 * 1024.0) << " MB through PBOs), "
+        << (uploadSeconds > 0.0 ? megabytes / uploadSeconds : 0.0) << " MB/s issue rate" << std::endl;
+}
@@ -0,0 +1,89 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Ring of pixel unpack buffer slots that decoder threads decode into directly. Slots are mapped readable as well
+// as writable, since decoders read back what they wrote.
+// With ARB_buffer_storage the slots are carved from one persistently mapped buffer; on plain GL 3.3 every slot
+// is its own PBO that the GL thread orphans and maps while the slot is free and unmaps before the upload.
+// After an upload the slot is fenced and only handed out again once the GPU has consumed it.
+class TextureStreamer {
+public:
+    struct Stats {
+        uint64_t textures = 0;
+        uint64_t streamedBytes = 0; // sourced from a PBO slot
+        uint64_t clientBytes = 0; // sourced from client memory (image larger than a slot, or shutting down)
+        double uploadSeconds = 0.0; // GL thread time spent issuing the uploads
+
+        void print(std::ostream &out) const;
+    };
+
+    // GL thread
+    explicit TextureStreamer(unsigned int slotCount = 8, size_t slotSize = size_t(4) << 20);
+
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer &) = delete;
+
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    size_t slotSize() const { return slotBytes; }
+
+    bool persistent() const { return persistentMapping; }
+
+    // any thread: wait for a free slot and return it, or -1 once shutdown() has been called
+    int acquire();
+
+    // any thread: return an acquired slot that was never uploaded, still mapped
+    void giveBack(int slot);
+
+    // write pointer of an acquired slot
+    unsigned char *memory(int slot) const { return slots[slot].memory; }
+
+    // any thread: make acquire() stop waiting so worker threads can be joined
+    void shutdown();
+
+    // GL thread: upload level 0 of the bound GL_TEXTURE_2D from an acquired slot, then fence the slot
+    void upload(int slot, GLenum format, int width, int height);
+
+    // GL thread: upload level 0 of the bound GL_TEXTURE_2D from client memory
+    void upload(const unsigned char *pixels, GLenum format, int width, int height);
+
+    // GL thread: hand slots whose fence has signalled back to acquire()
+    void recycle();
+
+    const Stats &stats() const { return counters; }
+
+private:
+    struct Slot {
+        unsigned int PBO; // the shared buffer when persistent
+        size_t offset;
+        unsigned char *memory; // null while a 3.3 slot is unmapped
+        GLsync fence;
+    };
+
+    bool persistentMapping = false;
+    size_t slotBytes;
+    std::vector<Slot> slots;
+    std::vector<int> inFlight; // GL thread only
+
+    std::mutex freeMutex;
+    std::condition_variable freeAvailable;
+    std::deque<int> freeSlots;
+    bool stopping = false;
+
+    Stats counters;
+
+    void release(int slot);
+};
+
+#endif //TEXTURESTREAMER_H
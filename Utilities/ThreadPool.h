@@ -0,0 +1,38 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling tasks from a shared FIFO queue.
+// Meant for coarse background work like file IO and decoding, not for fine grained frame tasks.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threads = std::thread::hardware_concurrency());
+
+    // finishes the tasks already queued, then joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void run();
+};
+
+#endif //THREADPOOL_H
@@ -0,0 +1,260 @@
+#include "TransformStore.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <glm/simd/matrix.h>
+
+#include "Profiler.h"
+
+namespace {
+    // below this many transforms the parallel update costs more than it saves
+    constexpr size_t PARALLEL_MIN = 4096;
+    // batches of 4 per job when building local matrices, and transforms per job when chaining
+    constexpr size_t BATCH_GRAIN = 256;
+    constexpr size_t CHAIN_GRAIN = 1024;
+}
+
+void TransformStore::reserve(size_t transforms) {
+    size_t padded = (transforms + 3) / 4 * 4;
+    for (std::vector<float> *lane: {&positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW,
+                                    &scaleX, &scaleY, &scaleZ}) {
+        lane->reserve(padded);
+    }
+    parents.reserve(transforms);
+    depths.reserve(transforms);
+    dirty.reserve(transforms);
+    world.reserve(transforms);
+}
+
+TransformStore::Handle TransformStore::create(const glm::vec3 &position, const glm::quat &rotation,
+                                              const glm::vec3 &scale, Handle parent) {
+    const auto transform = static_cast<Handle>(parents.size());
+    if (parent != NO_PARENT && parent >= transform) {
+        std::cout << "ERROR::TRANSFORM_STORE::PARENT_NOT_CREATED " << parent << std::endl;
+        parent = NO_PARENT;
+    }
+    if (transform % 4 == 0) {
+        for (std::vector<float> *lane: {&positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ}) {
+            lane->resize(transform + 4, 0.0f);
+        }
+        for (std::vector<float> *lane: {&rotationW, &scaleX, &scaleY, &scaleZ}) {
+            lane->resize(transform + 4, 1.0f);
+        }
+    }
+    parents.push_back(parent);
+    depths.push_back(parent == NO_PARENT ? 0 : depths[parent] + 1);
+    dirty.push_back(1);
+    world.emplace_back(1.0f);
+    setPosition(transform, position);
+    setRotation(transform, rotation);
+    setScale(transform, scale);
+    return transform;
+}
+
+void TransformStore::setPosition(Handle transform, const glm::vec3 &position) {
+    positionX[transform] = position.x;
+    positionY[transform] = position.y;
+    positionZ[transform] = position.z;
+    dirty[transform] = 1;
+}
+
+void TransformStore::setRotation(Handle transform, const glm::quat &rotation) {
+    rotationX[transform] = rotation.x;
+    rotationY[transform] = rotation.y;
+    rotationZ[transform] = rotation.z;
+    rotationW[transform] = rotation.w;
+    dirty[transform] = 1;
+}
+
+void TransformStore::setScale(Handle transform, const glm::vec3 &scale) {
+    scaleX[transform] = scale.x;
+    scaleY[transform] = scale.y;
+    scaleZ[transform] = scale.z;
+    dirty[transform] = 1;
+}
+
+glm::vec3 TransformStore::position(Handle transform) const {
+    return {positionX[transform], positionY[transform], positionZ[transform]};
+}
+
+glm::quat TransformStore::rotation(Handle transform) const {
+    return {rotationW[transform], rotationX[transform], rotationY[transform], rotationZ[transform]};
+}
+
+glm::vec3 TransformStore::scale(Handle transform) const {
+    return {scaleX[transform], scaleY[transform], scaleZ[transform]};
+}
+
+// The rotation matrix is glm::mat3_cast's, term for term, so the result matches
+// glm::translate(position) * glm::mat4_cast(rotation) * glm::scale(scale) exactly.
+void TransformStore::localMatrices(size_t first, glm::mat4 local[4]) const {
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    glm_vec4 x = _mm_loadu_ps(&rotationX[first]);
+    glm_vec4 y = _mm_loadu_ps(&rotationY[first]);
+    glm_vec4 z = _mm_loadu_ps(&rotationZ[first]);
+    glm_vec4 w = _mm_loadu_ps(&rotationW[first]);
+    glm_vec4 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    glm_vec4 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    glm_vec4 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+    const glm_vec4 one = _mm_set1_ps(1.0f);
+    const glm_vec4 two = _mm_set1_ps(2.0f);
+    const glm_vec4 sx = _mm_loadu_ps(&scaleX[first]);
+    const glm_vec4 sy = _mm_loadu_ps(&scaleY[first]);
+    const glm_vec4 sz = _mm_loadu_ps(&scaleZ[first]);
+
+    // one row per matrix element, one lane per transform; a 4x4 transpose turns four rows into a column of each
+    glm_vec4 columns[4][4] = {
+        {
+            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx),
+            _mm_setzero_ps()
+        },
+        {
+            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy),
+            _mm_setzero_ps()
+        },
+        {
+            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz),
+            _mm_setzero_ps()
+        },
+        {_mm_loadu_ps(&positionX[first]), _mm_loadu_ps(&positionY[first]), _mm_loadu_ps(&positionZ[first]), one}
+    };
+    for (int column = 0; column < 4; column++) {
+        glm_vec4 *rows = columns[column];
+        _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+        for (int lane = 0; lane < 4; lane++) {
+            _mm_store_ps(&local[lane][column][0], rows[lane]);
+        }
+    }
+#else
+    for (size_t lane = 0; lane < 4; lane++) {
+        Handle transform = static_cast<Handle>(first + lane);
+        glm::mat4 rotationScale = glm::mat4_cast(rotation(transform));
+        local[lane] = glm::mat4(rotationScale[0] * scaleX[transform], rotationScale[1] * scaleY[transform],
+                                rotationScale[2] * scaleZ[transform], glm::vec4(position(transform), 1.0f));
+    }
+#endif
+}
+
+void TransformStore::chain(size_t transform, const glm::mat4 &local) {
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    glm_mat4_mul(reinterpret_cast<const glm_vec4 *>(&world[parents[transform]]),
+                 reinterpret_cast<const glm_vec4 *>(&local), reinterpret_cast<glm_vec4 *>(&world[transform]));
+#else
+    world[transform] = world[parents[transform]] * local;
+#endif
+}
+
+size_t TransformStore::update(JobSystem *jobs) {
+    PROFILE_SCOPE("transform update");
+    const auto start = std::chrono::steady_clock::now();
+    const size_t count = parents.size();
+    changedList.clear();
+
+    if (jobs && jobs->threadCount() > 1 && count >= PARALLEL_MIN) {
+        updateParallel(*jobs);
+    } else {
+        // a moved parent moves its children; parents come first, so one pass carries the flag down the hierarchy
+        for (size_t i = 0; i < count; i++) {
+            if (!dirty[i] && parents[i] != NO_PARENT && dirty[parents[i]]) {
+                dirty[i] = 1;
+            }
+        }
+
+        alignas(16) glm::mat4 local[4];
+        for (size_t first = 0; first < count; first += 4) {
+            const size_t end = std::min(first + 4, count);
+            bool any = false;
+            for (size_t i = first; i < end; i++) {
+                any |= dirty[i] != 0;
+            }
+            if (!any)
+                continue;
+
+            localMatrices(first, local);
+            // in index order: a parent in the same batch is done before its children
+            for (size_t i = first; i < end; i++) {
+                if (!dirty[i])
+                    continue;
+                dirty[i] = 0;
+                changedList.push_back(static_cast<Handle>(i));
+                if (parents[i] == NO_PARENT) {
+                    world[i] = local[i - first];
+                } else {
+                    chain(i, local[i - first]);
+                }
+            }
+        }
+    }
+
+    ++counters.updates;
+    counters.recomputed += changedList.size();
+    counters.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return changedList.size();
+}
+
+void TransformStore::updateParallel(JobSystem &jobs) {
+    const size_t count = parents.size();
+    // serial and cheap: carry the dirty flags down, list the changes and sort the children by depth
+    for (std::vector<Handle> &level: levels) {
+        level.clear();
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!dirty[i] && parents[i] != NO_PARENT && dirty[parents[i]]) {
+            dirty[i] = 1;
+        }
+        if (!dirty[i])
+            continue;
+        changedList.push_back(static_cast<Handle>(i));
+        if (depths[i] > 0) {
+            if (levels.size() < depths[i]) {
+                levels.resize(depths[i]);
+            }
+            levels[depths[i] - 1].push_back(static_cast<Handle>(i));
+        }
+    }
+
+    // every local matrix on its own; a root's is its world matrix, the others wait in world for their parent
+    jobs.parallelFor((count + 3) / 4, BATCH_GRAIN, [this, count](size_t begin, size_t end) {
+        alignas(16) glm::mat4 local[4];
+        for (size_t first = begin * 4; first < std::min(end * 4, count); first += 4) {
+            const size_t last = std::min(first + 4, count);
+            bool any = false;
+            for (size_t i = first; i < last; i++) {
+                any |= dirty[i] != 0;
+            }
+            if (!any)
+                continue;
+            localMatrices(first, local);
+            for (size_t i = first; i < last; i++) {
+                if (dirty[i]) {
+                    dirty[i] = 0;
+                    world[i] = local[i - first];
+                }
+            }
+        }
+    });
+
+    // one level after the other, so every parent is final before its children read it
+    for (const std::vector<Handle> &level: levels) {
+        jobs.parallelFor(level.size(), CHAIN_GRAIN, [this, &level](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                alignas(16) const glm::mat4 local = world[level[k]];
+                chain(level[k], local);
+            }
+        });
+    }
+}
+
+void TransformStore::Stats::print(std::ostream &out) const {
+    if (updates == 0)
+        return;
+    out << "Transforms: " << static_cast<double>(recomputed) / updates << " world matrices recomputed per update, "
+        << seconds * 1000.0 / updates << " ms per update" << std::endl;
+}
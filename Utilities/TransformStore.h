@@ -0,0 +1,88 @@
+#ifndef TRANSFORMSTORE_H
+#define TRANSFORMSTORE_H
+
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "JobSystem.h"
+
+// Position, rotation and scale of many objects as SoA arrays, with cached world matrices. The setters only mark a
+// transform dirty; update() recomputes the dirty transforms and everything below them in the hierarchy, building the
+// local matrices four at a time with SSE and chaining them to their parents with glm's SIMD mat4 product. A parent is
+// always created before its children, so one forward pass over the arrays reaches every parent first. With a job
+// system the local matrices are built in parallel, then the hierarchy is chained one depth level at a time.
+class TransformStore {
+public:
+    using Handle = uint32_t;
+    static constexpr Handle NO_PARENT = 0xffffffffu;
+
+    struct Stats {
+        uint64_t updates = 0;
+        uint64_t recomputed = 0; // world matrices, summed over all updates
+        double seconds = 0.0;
+
+        void print(std::ostream &out) const;
+    };
+
+    void reserve(size_t transforms);
+
+    // the new transform is dirty, its world matrix is valid after the next update()
+    Handle create(const glm::vec3 &position, const glm::quat &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                  const glm::vec3 &scale = glm::vec3(1.0f), Handle parent = NO_PARENT);
+
+    void setPosition(Handle transform, const glm::vec3 &position);
+
+    void setRotation(Handle transform, const glm::quat &rotation);
+
+    void setScale(Handle transform, const glm::vec3 &scale);
+
+    glm::vec3 position(Handle transform) const;
+
+    glm::quat rotation(Handle transform) const;
+
+    glm::vec3 scale(Handle transform) const;
+
+    Handle parent(Handle transform) const { return parents[transform]; }
+
+    // recompute the world matrices of dirty transforms and their descendants; returns how many were recomputed.
+    // jobs spreads the work over its threads; the results are the same either way
+    size_t update(JobSystem *jobs = nullptr);
+
+    // world matrices by handle; the span stays valid until the next create()
+    std::span<const glm::mat4> worldMatrices() const { return world; }
+
+    // transforms recomputed by the last update(), ascending
+    std::span<const Handle> changed() const { return changedList; }
+
+    size_t size() const { return parents.size(); }
+
+    const Stats &stats() const { return counters; }
+
+private:
+    // padded to a multiple of 4 with identity transforms, so the SIMD kernel always reads whole batches
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+    std::vector<Handle> parents;
+    std::vector<uint32_t> depths; // 0 for roots
+    std::vector<uint8_t> dirty;
+    std::vector<glm::mat4> world;
+    std::vector<Handle> changedList;
+    std::vector<std::vector<Handle> > levels; // parallel update: dirty transforms at depth 1, 2, ...
+    Stats counters;
+
+    // translation * rotation * scale of the four transforms starting at first
+    void localMatrices(size_t first, glm::mat4 local[4]) const;
+
+    // world = parent's world * local; local must be 16 byte aligned
+    void chain(size_t transform, const glm::mat4 &local);
+
+    void updateParallel(JobSystem &jobs);
+};
+
+#endif //TRANSFORMSTORE_H
@@ -0,0 +1,55 @@
+#include "TransformUtility.h"
+
+#include <glm/simd/geometric.h>
+
+// For a 3x3 matrix with columns a, b, c the inverse transpose has the columns
+// (b x c, c x a, a x b) / det, where det = a . (b x c). Three cross products and a dot
+// replace the full 4x4 inverse the shader used to do per vertex.
+
+glm::mat3 TransformUtility::NormalMatrix(const glm::mat4 &model) {
+    glm::vec3 a(model[0]), b(model[1]), c(model[2]);
+    glm::vec3 bc = glm::cross(b, c);
+    float invDet = 1.0f / glm::dot(a, bc);
+    return glm::mat3(bc * invDet, glm::cross(c, a) * invDet, glm::cross(a, b) * invDet);
+}
+
+void TransformUtility::NormalMatrices(std::span<const glm::mat4> models, std::span<glm::mat3> normals) {
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    for (size_t i = 0; i < models.size(); i++) {
+        const float *m = &models[i][0][0];
+        glm_vec4 a = _mm_loadu_ps(m);
+        glm_vec4 b = _mm_loadu_ps(m + 4);
+        glm_vec4 c = _mm_loadu_ps(m + 8);
+
+        glm_vec4 bc = glm_vec4_cross(b, c);
+        glm_vec4 ca = glm_vec4_cross(c, a);
+        glm_vec4 ab = glm_vec4_cross(a, b);
+        glm_vec4 invDet = _mm_div_ps(_mm_set1_ps(1.0f), glm_vec4_dot(a, bc));
+
+        // mat3 columns are packed at a 3 float stride: each 4 wide store spills one lane into the next
+        // column, which the following store overwrites. The last column is written without the spill.
+        float *n = &normals[i][0][0];
+        _mm_storeu_ps(n, _mm_mul_ps(bc, invDet));
+        _mm_storeu_ps(n + 3, _mm_mul_ps(ca, invDet));
+        glm_vec4 last = _mm_mul_ps(ab, invDet);
+        _mm_storel_pi(reinterpret_cast<__m64 *>(n + 6), last);
+        _mm_store_ss(n + 8, _mm_movehl_ps(last, last));
+    }
+#else
+    for (size_t i = 0; i < models.size(); i++) {
+        normals[i] = NormalMatrix(models[i]);
+    }
+#endif
+}
+
+void TransformUtility::BoundingBoxes(std::span<const glm::mat4> models, const glm::vec3 &localHalfSize,
+                                     std::span<glm::vec3> centers, std::span<glm::vec3> halfSizes) {
+    for (size_t i = 0; i < models.size(); i++) {
+        const glm::mat4 &model = models[i];
+        centers[i] = glm::vec3(model[3]);
+        // each world axis gets the extent of the box projected onto it
+        halfSizes[i] = glm::abs(glm::vec3(model[0])) * localHalfSize.x +
+                       glm::abs(glm::vec3(model[1])) * localHalfSize.y +
+                       glm::abs(glm::vec3(model[2])) * localHalfSize.z;
+    }
+}
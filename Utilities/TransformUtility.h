@@ -0,0 +1,21 @@
+#ifndef TRANSFORMUTILITY_H
+#define TRANSFORMUTILITY_H
+
+#include <span>
+#include <glm/glm.hpp>
+
+class TransformUtility {
+public:
+    // inverse transpose of the upper 3x3 of a model matrix, used to bring normals into world space
+    static glm::mat3 NormalMatrix(const glm::mat4 &model);
+
+    // batch version of NormalMatrix; normals must be at least as large as models
+    static void NormalMatrices(std::span<const glm::mat4> models, std::span<glm::mat3> normals);
+
+    // world space bounding boxes, as center and half size, of a box of the given half size around each model's origin;
+    // centers and halfSizes must be at least as large as models
+    static void BoundingBoxes(std::span<const glm::mat4> models, const glm::vec3 &localHalfSize,
+                              std::span<glm::vec3> centers, std::span<glm::vec3> halfSizes);
+};
+
+#endif //TRANSFORMUTILITY_H
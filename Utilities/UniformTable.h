@@ -0,0 +1,97 @@
+#ifndef UNIFORMTABLE_H
+#define UNIFORMTABLE_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A resolved uniform location. Resolve it once through Shader::uniform and reuse it every frame,
+// so the per-frame path never goes back to the driver with a string lookup.
+struct UniformHandle {
+    int location = -1;
+    GLenum type = GL_NONE;
+    int count = 0;
+
+    bool valid() const { return location >= 0; }
+};
+
+// Flat open-addressing hash table (linear probing) from uniform name to handle.
+// Filled once at link time from GL_ACTIVE_UNIFORMS, never modified afterwards.
+class UniformTable {
+public:
+    void reserve(size_t count) {
+        size_t capacity = 16;
+        while (capacity < count * 2)
+            capacity <<= 1;
+        slots.assign(capacity, Slot{});
+        size = 0;
+    }
+
+    void insert(std::string_view name, const UniformHandle &handle) {
+        if (slots.empty() || (size + 1) * 2 > slots.size())
+            grow();
+        size_t mask = slots.size() - 1;
+        uint32_t hash = hashName(name);
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot &slot = slots[i];
+            if (!slot.used) {
+                slot = Slot{std::string(name), handle, hash, true};
+                ++size;
+                return;
+            }
+            if (slot.hash == hash && slot.name == name) {
+                slot.handle = handle;
+                return;
+            }
+        }
+    }
+
+    UniformHandle find(std::string_view name) const {
+        if (slots.empty())
+            return {};
+        size_t mask = slots.size() - 1;
+        uint32_t hash = hashName(name);
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot &slot = slots[i];
+            if (!slot.used)
+                return {};
+            if (slot.hash == hash && slot.name == name)
+                return slot.handle;
+        }
+    }
+
+    size_t count() const { return size; }
+
+private:
+    struct Slot {
+        std::string name;
+        UniformHandle handle;
+        uint32_t hash = 0;
+        bool used = false;
+    };
+
+    // FNV-1a, good enough for the few hundred short names a program exposes
+    static uint32_t hashName(std::string_view name) {
+        uint32_t hash = 2166136261u;
+        for (char c: name) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    void grow() {
+        std::vector<Slot> old = std::move(slots);
+        reserve(old.empty() ? 8 : old.size());
+        for (Slot &slot: old)
+            if (slot.used)
+                insert(slot.name, slot.handle);
+    }
+
+    std::vector<Slot> slots;
+    size_t size = 0;
+};
+
+#endif //UNIFORMTABLE_H
@@ -0,0 +1,143 @@
+#include "UploadRing.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "GLStateCache.h"
+
+UploadRing::UploadRing(size_t frameSize) : regionSize(frameSize) {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment > 0) {
+        uniformOffsetAlignment = static_cast<size_t>(alignment);
+    }
+    if (GLAD_GL_ARB_texture_buffer_range) {
+        alignment = 0;
+        glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        if (alignment > 0) {
+            textureBufferOffsetAlignment = static_cast<size_t>(alignment);
+        }
+    }
+
+    glGenBuffers(1, &ring);
+    // a target no draw reads from, the buffer is bound wherever it is used
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, ring);
+    const size_t size = regionSize * FRAMES;
+    persistentMapping = GLAD_GL_ARB_buffer_storage;
+    if (persistentMapping) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(size), nullptr, flags);
+        persistentMemory = static_cast<unsigned char *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0,
+                                                                         static_cast<GLsizeiptr>(size), flags));
+        if (!persistentMemory) {
+            std::cout << "ERROR::UPLOAD_RING::MAP_FAILED" << std::endl;
+        }
+    } else {
+        glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_STREAM_DRAW);
+    }
+}
+
+UploadRing::~UploadRing() {
+    for (GLsync fence: fences) {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    if (persistentMemory || mapped) {
+        glState.bindBuffer(GL_COPY_WRITE_BUFFER, ring);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    glState.deleteBuffers(1, &ring);
+}
+
+void UploadRing::beginFrame() {
+    if (inFrame) {
+        endFrame();
+    }
+    region = static_cast<unsigned int>(counters.frames % FRAMES);
+    head = 0;
+    inFrame = true;
+    GLsync &fence = fences[region];
+    if (!fence)
+        return;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        const auto start = std::chrono::steady_clock::now();
+        ++counters.waits;
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        } while (status == GL_TIMEOUT_EXPIRED);
+        counters.waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    if (status == GL_WAIT_FAILED) {
+        std::cout << "ERROR::UPLOAD_RING::FENCE_WAIT_FAILED" << std::endl;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+UploadRing::Allocation UploadRing::allocate(size_t bytes, size_t alignment) {
+    const size_t start = regionStart();
+    const size_t offset = (start + head + alignment - 1) / alignment * alignment;
+    if (offset + bytes > start + regionSize) {
+        ++counters.overflows;
+        return {};
+    }
+    Allocation allocation{offset, nullptr};
+    if (persistentMapping) {
+        if (!persistentMemory)
+            return {};
+        allocation.memory = persistentMemory + offset;
+    } else {
+        if (!mapped) {
+            // nothing in flight reads this part of the region: the fence of its last frame has signalled
+            glState.bindBuffer(GL_COPY_WRITE_BUFFER, ring);
+            const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+            mapped = static_cast<unsigned char *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(offset),
+                                                                   static_cast<GLsizeiptr>(start + regionSize - offset),
+                                                                   access));
+            mappedBegin = offset;
+            if (!mapped) {
+                std::cout << "ERROR::UPLOAD_RING::MAP_FAILED" << std::endl;
+                return {};
+            }
+        }
+        allocation.memory = mapped + (offset - mappedBegin);
+    }
+    head = offset + bytes - start;
+    ++counters.allocations;
+    counters.bytes += bytes;
+    return allocation;
+}
+
+UploadRing::Allocation UploadRing::upload(const void *data, size_t bytes, size_t alignment) {
+    Allocation allocation = allocate(bytes, alignment);
+    if (allocation.valid()) {
+        std::memcpy(allocation.memory, data, bytes);
+    }
+    return allocation;
+}
+
+void UploadRing::flush() {
+    if (!mapped)
+        return;
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, ring);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    mapped = nullptr;
+}
+
+void UploadRing::endFrame() {
+    if (!inFrame)
+        return;
+    flush();
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++counters.frames;
+    inFrame = false;
+}
+
+void UploadRing::Stats::print(std::ostream &out) const {
+    if (frames == 0)
+        return;
+    out << "Upload ring per frame: " << static_cast<double>(allocations) / frames << " allocations, "
+        << static_cast<double>(bytes) / frames / 1024.0 << " KiB, " << overflows << " overflows, " << waits
+        << " fence waits (" << waitSeconds * 1000.0 << " ms)" << std::endl;
+}
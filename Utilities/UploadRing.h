@@ -0,0 +1,95 @@
+#ifndef UPLOADRING_H
+#define UPLOADRING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include <glad/glad.h>
+
+// One big buffer for the data that changes every frame: uniform blocks, instance data, texture buffer contents and
+// streamed vertices. It is cut into FRAMES regions used in turn; each frame bump allocates from its region, writes
+// straight into mapped memory and fences the region when its draws are issued, so three frames later the region is
+// reused once that fence has signalled. A frame's data thus costs one memcpy and no buffer allocation.
+// With ARB_buffer_storage the buffer is mapped persistently and coherently once; on plain GL 3.3 the free part of the
+// region is mapped unsynchronized when needed and unmapped by flush(), which the fences make safe.
+// GL thread only.
+class UploadRing {
+public:
+    static constexpr unsigned int FRAMES = 3;
+
+    // where an allocation lives in buffer(); memory is null when the frame's region is full
+    struct Allocation {
+        size_t offset = 0;
+        unsigned char *memory = nullptr;
+
+        bool valid() const { return memory != nullptr; }
+    };
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;
+        uint64_t overflows = 0; // allocations that did not fit
+        uint64_t waits = 0; // frames whose region the GPU was still reading
+        double waitSeconds = 0.0;
+
+        void print(std::ostream &out) const;
+    };
+
+    explicit UploadRing(size_t frameSize = size_t(4) << 20);
+
+    ~UploadRing();
+
+    UploadRing(const UploadRing &) = delete;
+
+    UploadRing &operator=(const UploadRing &) = delete;
+
+    unsigned int buffer() const { return ring; }
+
+    bool persistent() const { return persistentMapping; }
+
+    size_t frameSize() const { return regionSize; }
+
+    // offset alignments the driver demands for glBindBufferRange(GL_UNIFORM_BUFFER) and glTexBufferRange
+    size_t uniformAlignment() const { return uniformOffsetAlignment; }
+
+    size_t textureBufferAlignment() const { return textureBufferOffsetAlignment; }
+
+    // start the next region, after waiting for the GPU to finish the frame that used it last
+    void beginFrame();
+
+    // bytes at an offset that is a multiple of alignment; the memory may be written until flush()
+    Allocation allocate(size_t bytes, size_t alignment = 16);
+
+    // allocate and copy
+    Allocation upload(const void *data, size_t bytes, size_t alignment = 16);
+
+    // before the draws that read this frame's allocations; later allocations of the frame map again
+    void flush();
+
+    // after the frame's last draw: fence the region
+    void endFrame();
+
+    const Stats &stats() const { return counters; }
+
+private:
+    unsigned int ring = 0;
+    bool persistentMapping = false;
+    size_t regionSize;
+    size_t uniformOffsetAlignment = 256;
+    size_t textureBufferOffsetAlignment = 256;
+    unsigned char *persistentMemory = nullptr;
+    GLsync fences[FRAMES] = {};
+    unsigned int region = 0;
+    size_t head = 0; // within the region
+    bool inFrame = false;
+    // GL 3.3: the mapped part of the region
+    unsigned char *mapped = nullptr;
+    size_t mappedBegin = 0;
+    Stats counters;
+
+    size_t regionStart() const { return region * regionSize; }
+};
+
+#endif //UPLOADRING_H
@@ -74,5 +74,12 @@ glm::vec3 pointLightColors[] = {
  glm::vec3(0.1f, 0.1f, 0.1f),
  glm::vec3(0.3f, 0.1f, 0.1f)
 };
+// linear (x) and quadratic (y) attenuation terms of the point lights
+glm::vec2 pointLightAttenuation[] = {
+ glm::vec2(0.14f, 0.07f),
+ glm::vec2(0.14f, 0.07f),
+ glm::vec2(0.22f, 0.20f),
+ glm::vec2(0.14f, 0.07f)
+};
 
 #endif //VERTEXDATA_H
@@ -0,0 +1,82 @@
+#include "VertexLayout.h"
+
+namespace {
+    struct FormatInfo {
+        GLint components;
+        GLenum type;
+        GLboolean normalized;
+        unsigned int size;
+    };
+
+    FormatInfo formatInfo(VertexFormat format) {
+        switch (format) {
+            case VertexFormat::Float2:
+                return {2, GL_FLOAT, GL_FALSE, 8};
+            case VertexFormat::Float3:
+                return {3, GL_FLOAT, GL_FALSE, 12};
+            case VertexFormat::Half2:
+                return {2, GL_HALF_FLOAT, GL_FALSE, 4};
+            case VertexFormat::Half3:
+                return {3, GL_HALF_FLOAT, GL_FALSE, 6};
+            case VertexFormat::Snorm16x2:
+                return {2, GL_SHORT, GL_TRUE, 4};
+            case VertexFormat::Snorm16x3:
+                return {3, GL_SHORT, GL_TRUE, 6};
+            case VertexFormat::Unorm16x2:
+                return {2, GL_UNSIGNED_SHORT, GL_TRUE, 4};
+            case VertexFormat::Snorm10x3:
+                // packed formats are always fetched with 4 components; a vec3 input ignores w
+                return {4, GL_INT_2_10_10_10_REV, GL_TRUE, 4};
+        }
+        return {0, GL_NONE, GL_FALSE, 0};
+    }
+}
+
+VertexLayout &VertexLayout::add(unsigned int location, VertexFormat format) {
+    declared.push_back({location, format, vertexSize});
+    vertexSize = (vertexSize + size(format) + 3) & ~3u;
+    return *this;
+}
+
+const VertexLayout::Attribute *VertexLayout::find(unsigned int location) const {
+    for (const Attribute &attribute: declared) {
+        if (attribute.location == location)
+            return &attribute;
+    }
+    return nullptr;
+}
+
+void VertexLayout::apply(size_t bufferOffset, uint32_t locations) const {
+    for (const Attribute &attribute: declared) {
+        if (attribute.location >= 32 || !(locations >> attribute.location & 1u))
+            continue;
+        const FormatInfo info = formatInfo(attribute.format);
+        glVertexAttribPointer(attribute.location, info.components, info.type, info.normalized,
+                              static_cast<GLsizei>(vertexSize),
+                              reinterpret_cast<const void *>(bufferOffset + attribute.offset));
+        glEnableVertexAttribArray(attribute.location);
+    }
+}
+
+void VertexLayout::addDefines(ShaderDefines &defines) const {
+    const Attribute *position = find(POSITION_LOCATION);
+    if (position && position->format == VertexFormat::Snorm16x3) {
+        defines.set("QUANTIZED_POSITIONS");
+    }
+    const Attribute *normal = find(NORMAL_LOCATION);
+    if (normal && normal->format == VertexFormat::Snorm16x2) {
+        defines.set("OCTAHEDRAL_NORMALS");
+    }
+}
+
+VertexLayout VertexLayout::floatSurface() {
+    VertexLayout layout;
+    layout.add(POSITION_LOCATION, VertexFormat::Float3)
+            .add(NORMAL_LOCATION, VertexFormat::Float3)
+            .add(TEXCOORD_LOCATION, VertexFormat::Float2);
+    return layout;
+}
+
+unsigned int VertexLayout::size(VertexFormat format) {
+    return formatInfo(format).size;
+}
@@ -0,0 +1,69 @@
+#ifndef VERTEXLAYOUT_H
+#define VERTEXLAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "ShaderPreprocessor.h"
+
+// how one attribute is stored; GL turns the normalized integer and half float formats into floats on fetch
+enum class VertexFormat : uint8_t {
+    Float2,
+    Float3,
+    Half2,
+    Half3,
+    Snorm16x2,
+    Snorm16x3,
+    Unorm16x2,
+    Snorm10x3, // GL_INT_2_10_10_10_REV, the 2 bit w is padding
+};
+
+// The interleaved attributes of a vertex buffer, declared once and applied to any vertex array that reads it, so the
+// glVertexAttribPointer calls always agree with how the vertices were written. Every attribute starts at a multiple
+// of 4 bytes, as the vertex fetch of most GPUs wants it.
+// The locations are those of the surface shaders: position, normal and texture coordinates.
+class VertexLayout {
+public:
+    static constexpr unsigned int POSITION_LOCATION = 0;
+    static constexpr unsigned int NORMAL_LOCATION = 1;
+    static constexpr unsigned int TEXCOORD_LOCATION = 2;
+
+    struct Attribute {
+        unsigned int location;
+        VertexFormat format;
+        unsigned int offset; // bytes from the start of the vertex
+    };
+
+    // append an attribute after the ones already declared
+    VertexLayout &add(unsigned int location, VertexFormat format);
+
+    unsigned int stride() const { return vertexSize; }
+
+    std::span<const Attribute> attributes() const { return declared; }
+
+    // the attribute at location, null if there is none
+    const Attribute *find(unsigned int location) const;
+
+    // GL thread: point the attributes of the bound vertex array at the bound GL_ARRAY_BUFFER, whose vertices start at
+    // bufferOffset. locations is a bit mask, e.g. a depth only pass needs just the position.
+    void apply(size_t bufferOffset = 0, uint32_t locations = ~0u) const;
+
+    // what vertex.glsl needs to decode these attributes: QUANTIZED_POSITIONS and OCTAHEDRAL_NORMALS
+    void addDefines(ShaderDefines &defines) const;
+
+    // 3 floats position, normal and 2 floats texture coordinates: the layout of every mesh in the source
+    static VertexLayout floatSurface();
+
+    // bytes the format takes in a vertex, before padding
+    static unsigned int size(VertexFormat format);
+
+private:
+    std::vector<Attribute> declared;
+    unsigned int vertexSize = 0;
+};
+
+#endif //VERTEXLAYOUT_H
@@ -4,9 +4,18 @@
 
 #include "VertexUtility.h"
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <cstring>
 #include <span>
 
 #include "glad/glad.h"
+#include <glm/gtc/packing.hpp>
+
+#include "GLStateCache.h"
 
 
 TriangleBuffers VertexUtility::CreateTriangleWithTexture(const std::span<const float> &vertices,
@@ -16,25 +25,15 @@ TriangleBuffers VertexUtility::CreateTriangleWithTexture(const std::span<const f
     glGenVertexArrays(1, &buffers.VAO);
     glGenBuffers(1, &buffers.VBO);
     glGenBuffers(1, &buffers.EBO);
-    glBindVertexArray(buffers.VAO);
+    glState.bindVertexArray(buffers.VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(0);
-
-    // color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    // texture coord attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    VertexLayout::floatSurface().apply();
     return buffers;
 }
 
@@ -42,15 +41,451 @@ TriangleBuffersWithoutEBO VertexUtility::CreateTriangleWithTexture(const std::sp
     TriangleBuffersWithoutEBO buffers{};
     glGenVertexArrays(1, &buffers.VAO);
     glGenBuffers(1, &buffers.VBO);
-    glBindVertexArray(buffers.VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+    glState.bindVertexArray(buffers.VAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(0);
+    VertexLayout()
+            .add(VertexLayout::POSITION_LOCATION, VertexFormat::Float3)
+            .add(1, VertexFormat::Float2) // the textured shaders without lighting read them at location 1
+            .apply();
+    return buffers;
+}
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) (3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+TriangleBuffers VertexUtility::CreateMesh(const QuantizedMesh &mesh) {
+    return CreateMesh(mesh.vertices, mesh.indices, mesh.layout);
+}
 
+TriangleBuffers VertexUtility::CreateMesh(std::span<const unsigned char> vertices,
+                                          std::span<const unsigned int> indices, const VertexLayout &layout) {
+    TriangleBuffers buffers{};
+    glGenVertexArrays(1, &buffers.VAO);
+    glGenBuffers(1, &buffers.VBO);
+    glGenBuffers(1, &buffers.EBO);
+    glState.bindVertexArray(buffers.VAO);
+
+    glState.bindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertices.size()), vertices.data(), GL_STATIC_DRAW);
+
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size_bytes()), indices.data(),
+                 GL_STATIC_DRAW);
+
+    layout.apply();
     return buffers;
 }
+
+namespace {
+    // the scoring of Forsyth's article: recently used vertices score high, the three of the last triangle a little
+    // less so that strips do not just go back and forth, and vertices with few triangles left get a boost
+    constexpr unsigned int FORSYTH_CACHE_SIZE = 32;
+    constexpr unsigned int FORSYTH_MAX_VALENCE = 32;
+
+    struct ScoreTables {
+        float cache[FORSYTH_CACHE_SIZE];
+        float valence[FORSYTH_MAX_VALENCE + 1];
+
+        ScoreTables() {
+            for (unsigned int i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+                cache[i] = i < 3
+                               ? 0.75f
+                               : std::pow(1.0f - static_cast<float>(i - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+            }
+            valence[0] = 0.0f;
+            for (unsigned int i = 1; i <= FORSYTH_MAX_VALENCE; i++) {
+                valence[i] = 2.0f / std::sqrt(static_cast<float>(i));
+            }
+        }
+    };
+
+    const ScoreTables scoreTables;
+
+    float vertexScore(int cachePosition, unsigned int liveTriangles) {
+        if (liveTriangles == 0)
+            return -1.0f;
+        float score = cachePosition >= 0 ? scoreTables.cache[cachePosition] : 0.0f;
+        return score + scoreTables.valence[std::min(liveTriangles, FORSYTH_MAX_VALENCE)];
+    }
+
+    uint32_t floatBits(float value) {
+        // -0 and 0 compare equal, so they have to hash the same
+        return value == 0.0f ? 0u : std::bit_cast<uint32_t>(value);
+    }
+
+    uint32_t hashVertex(const float *vertex, unsigned int stride) {
+        uint32_t hash = 2166136261u;
+        for (unsigned int i = 0; i < stride; i++) {
+            hash = (hash ^ floatBits(vertex[i])) * 16777619u;
+        }
+        return hash ^ (hash >> 15);
+    }
+
+    bool sameVertex(const float *a, const float *b, unsigned int stride) {
+        for (unsigned int i = 0; i < stride; i++) {
+            if (a[i] != b[i])
+                return false;
+        }
+        return true;
+    }
+}
+
+IndexedMesh VertexUtility::WeldVertices(std::span<const float> vertices, unsigned int stride) {
+    IndexedMesh mesh;
+    mesh.stride = stride;
+    if (stride == 0 || vertices.size() % stride != 0) {
+        std::cout << "ERROR::VERTEX_UTILITY::BAD_STRIDE " << stride << " for " << vertices.size() << " floats"
+                  << std::endl;
+        return mesh;
+    }
+    const size_t count = vertices.size() / stride;
+    // open addressing, at most half full
+    const size_t buckets = std::bit_ceil(std::max<size_t>(count * 2, 16));
+    std::vector<unsigned int> table(buckets, ~0u);
+    mesh.indices.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        const float *vertex = &vertices[i * stride];
+        size_t bucket = hashVertex(vertex, stride) & (buckets - 1);
+        while (table[bucket] != ~0u && !sameVertex(&mesh.vertices[table[bucket] * stride], vertex, stride)) {
+            bucket = (bucket + 1) & (buckets - 1);
+        }
+        if (table[bucket] == ~0u) {
+            table[bucket] = static_cast<unsigned int>(mesh.vertexCount());
+            mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + stride);
+        }
+        mesh.indices.push_back(table[bucket]);
+    }
+    return mesh;
+}
+
+void VertexUtility::OptimizeVertexCache(std::span<unsigned int> indices, size_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // the triangles of every vertex; the live ones are kept at the front of each list
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        liveTriangles[indices[i]]++;
+    }
+    std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+    }
+    std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+    {
+        std::vector<size_t> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                vertexTriangles[cursor[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+            }
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        score[v] = vertexScore(-1, liveTriangles[v]);
+    }
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    size_t best = 0;
+    float bestScore = -1.0f;
+    for (size_t t = 0; t < triangleCount; t++) {
+        const float value = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+        if (value > bestScore) {
+            bestScore = value;
+            best = t;
+        }
+    }
+
+    const std::vector<unsigned int> source(indices.begin(), indices.begin() + triangleCount * 3);
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+    size_t scanFrom = 0;
+    for (size_t out = 0; out < triangleCount; out++) {
+        if (best == SIZE_MAX) {
+            // a dead end: nothing in the cache has triangles left, carry on with the next one in input order
+            while (emitted[scanFrom]) {
+                scanFrom++;
+            }
+            best = scanFrom;
+        }
+        const unsigned int *triangle = &source[best * 3];
+        std::copy(triangle, triangle + 3, &indices[out * 3]);
+        emitted[best] = 1;
+
+        // the triangle's vertices go to the front of the cache, the rest moves back
+        nextCache.assign(triangle, triangle + 3);
+        for (unsigned int v: cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                nextCache.push_back(v);
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            const unsigned int v = triangle[k];
+            unsigned int *list = &vertexTriangles[firstTriangle[v]];
+            unsigned int *end = list + liveTriangles[v];
+            *std::find(list, end, static_cast<unsigned int>(best)) = end[-1];
+            liveTriangles[v]--;
+        }
+        for (size_t i = FORSYTH_CACHE_SIZE; i < nextCache.size(); i++) {
+            cachePosition[nextCache[i]] = -1;
+            score[nextCache[i]] = vertexScore(-1, liveTriangles[nextCache[i]]);
+        }
+        nextCache.resize(std::min<size_t>(nextCache.size(), FORSYTH_CACHE_SIZE));
+        for (size_t i = 0; i < nextCache.size(); i++) {
+            cachePosition[nextCache[i]] = static_cast<int>(i);
+            score[nextCache[i]] = vertexScore(static_cast<int>(i), liveTriangles[nextCache[i]]);
+        }
+        cache.swap(nextCache);
+
+        // only the triangles of cached vertices changed score, and the next one is picked among them
+        best = SIZE_MAX;
+        bestScore = -1.0f;
+        for (unsigned int v: cache) {
+            for (size_t i = firstTriangle[v]; i < firstTriangle[v] + liveTriangles[v]; i++) {
+                const unsigned int t = vertexTriangles[i];
+                const float value = score[source[t * 3]] + score[source[t * 3 + 1]] + score[source[t * 3 + 2]];
+                if (value > bestScore) {
+                    bestScore = value;
+                    best = t;
+                }
+            }
+        }
+    }
+}
+
+void VertexUtility::OptimizeVertexFetch(IndexedMesh &mesh) {
+    const unsigned int stride = mesh.stride;
+    std::vector<unsigned int> remap(mesh.vertexCount(), ~0u);
+    std::vector<float> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (unsigned int &index: mesh.indices) {
+        if (remap[index] == ~0u) {
+            remap[index] = static_cast<unsigned int>(vertices.size() / stride);
+            vertices.insert(vertices.end(), &mesh.vertices[index * stride], &mesh.vertices[index * stride] + stride);
+        }
+        index = remap[index];
+    }
+    mesh.vertices.swap(vertices);
+}
+
+VertexCacheStats VertexUtility::AnalyzeVertexCache(std::span<const unsigned int> indices, size_t vertexCount,
+                                                   unsigned int cacheSize) {
+    VertexCacheStats stats;
+    stats.triangles = indices.size() / 3;
+    // a vertex is cached while fewer than cacheSize misses happened since its own
+    std::vector<size_t> missedAt(vertexCount, 0);
+    for (unsigned int index: indices) {
+        if (missedAt[index] == 0) {
+            stats.vertices++;
+        }
+        if (missedAt[index] == 0 || stats.transforms - missedAt[index] >= cacheSize) {
+            missedAt[index] = ++stats.transforms;
+        }
+    }
+    return stats;
+}
+
+IndexedMesh VertexUtility::OptimizeMesh(std::span<const float> vertices, unsigned int stride) {
+    IndexedMesh mesh = WeldVertices(vertices, stride);
+    OptimizeVertexCache(mesh.indices, mesh.vertexCount());
+    OptimizeVertexFetch(mesh);
+    return mesh;
+}
+
+namespace {
+    // GL's decoding of normalized integers: the largest magnitude maps to 1, the most negative value clamps to -1
+    int16_t snorm16(float value) {
+        return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    float fromSnorm16(int16_t value) {
+        return std::max(value / 32767.0f, -1.0f);
+    }
+
+    uint32_t snorm10(float value) {
+        return static_cast<uint32_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 511.0f)) & 0x3ffu;
+    }
+
+    float fromSnorm10(uint32_t bits) {
+        // sign extend the 10 bits
+        const int value = static_cast<int>(bits << 22) >> 22;
+        return std::max(value / 511.0f, -1.0f);
+    }
+
+    float roundTripHalf(float value) {
+        return glm::unpackHalf1x16(glm::packHalf1x16(value));
+    }
+
+    // the unit normal projected onto the octahedron |x| + |y| + |z| = 1, the lower half folded over the upper one
+    glm::vec2 octahedralEncode(const glm::vec3 &normal) {
+        const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (length == 0.0f)
+            return glm::vec2(0.0f);
+        const glm::vec3 n = normal / length;
+        if (n.z >= 0.0f)
+            return {n.x, n.y};
+        return {(1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f)};
+    }
+
+    // the same as decodeNormal in vertex.glsl
+    glm::vec3 octahedralDecode(const glm::vec2 &encoded) {
+        glm::vec3 n(encoded, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+        const float t = std::max(-n.z, 0.0f);
+        n.x += n.x >= 0.0f ? -t : t;
+        n.y += n.y >= 0.0f ? -t : t;
+        return glm::normalize(n);
+    }
+
+    // atan2 rather than acos, which cannot resolve angles below about 1e-3 in float
+    float angleBetween(const glm::vec3 &a, const glm::vec3 &b) {
+        return std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b));
+    }
+
+    VertexFormat positionFormat(VertexEncoding::Position encoding) {
+        switch (encoding) {
+            case VertexEncoding::Position::Half:
+                return VertexFormat::Half3;
+            case VertexEncoding::Position::Snorm16:
+                return VertexFormat::Snorm16x3;
+            default:
+                return VertexFormat::Float3;
+        }
+    }
+
+    VertexFormat normalFormat(VertexEncoding::Normal encoding) {
+        switch (encoding) {
+            case VertexEncoding::Normal::Octahedral16:
+                return VertexFormat::Snorm16x2;
+            case VertexEncoding::Normal::Snorm10:
+                return VertexFormat::Snorm10x3;
+            default:
+                return VertexFormat::Float3;
+        }
+    }
+
+    VertexFormat texCoordFormat(VertexEncoding::TexCoord encoding) {
+        switch (encoding) {
+            case VertexEncoding::TexCoord::Half:
+                return VertexFormat::Half2;
+            case VertexEncoding::TexCoord::Unorm16:
+                return VertexFormat::Unorm16x2;
+            default:
+                return VertexFormat::Float2;
+        }
+    }
+
+    template<typename T>
+    void store(unsigned char *vertex, unsigned int offset, const T &value) {
+        std::memcpy(vertex + offset, &value, sizeof(T));
+    }
+}
+
+QuantizedMesh VertexUtility::QuantizeMesh(const IndexedMesh &mesh, const VertexEncoding &encoding) {
+    constexpr unsigned int STRIDE = 8;
+    QuantizedMesh packed;
+    if (mesh.stride != STRIDE) {
+        std::cout << "ERROR::VERTEX_UTILITY::NOT_A_SURFACE_MESH stride " << mesh.stride << ", expected " << STRIDE
+                  << std::endl;
+        return packed;
+    }
+    const size_t count = mesh.vertexCount();
+    auto position = [&](size_t v) { return glm::vec3(mesh.vertices[v * STRIDE], mesh.vertices[v * STRIDE + 1],
+                                                      mesh.vertices[v * STRIDE + 2]); };
+    auto normal = [&](size_t v) { return glm::vec3(mesh.vertices[v * STRIDE + 3], mesh.vertices[v * STRIDE + 4],
+                                                    mesh.vertices[v * STRIDE + 5]); };
+    auto texCoord = [&](size_t v) { return glm::vec2(mesh.vertices[v * STRIDE + 6], mesh.vertices[v * STRIDE + 7]); };
+
+    VertexEncoding::TexCoord texCoordEncoding = encoding.texCoord;
+    if (texCoordEncoding == VertexEncoding::TexCoord::Unorm16) {
+        for (size_t v = 0; v < count; v++) {
+            const glm::vec2 uv = texCoord(v);
+            if (uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f) {
+                texCoordEncoding = VertexEncoding::TexCoord::Half;
+                break;
+            }
+        }
+    }
+    if (count > 0) {
+        packed.boundsMin = packed.boundsMax = position(0);
+        for (size_t v = 1; v < count; v++) {
+            packed.boundsMin = glm::min(packed.boundsMin, position(v));
+            packed.boundsMax = glm::max(packed.boundsMax, position(v));
+        }
+    }
+    if (encoding.position == VertexEncoding::Position::Snorm16) {
+        packed.positionOffset = (packed.boundsMin + packed.boundsMax) * 0.5f;
+        packed.positionScale = (packed.boundsMax - packed.boundsMin) * 0.5f;
+    }
+
+    using Position = VertexEncoding::Position;
+    using Normal = VertexEncoding::Normal;
+    using TexCoord = VertexEncoding::TexCoord;
+    packed.layout.add(VertexLayout::POSITION_LOCATION, positionFormat(encoding.position))
+            .add(VertexLayout::NORMAL_LOCATION, normalFormat(encoding.normal))
+            .add(VertexLayout::TEXCOORD_LOCATION, texCoordFormat(texCoordEncoding));
+    const std::span<const VertexLayout::Attribute> attributes = packed.layout.attributes();
+    const unsigned int positionOffset = attributes[0].offset;
+    const unsigned int normalOffset = attributes[1].offset;
+    const unsigned int texCoordOffset = attributes[2].offset;
+
+    const unsigned int stride = packed.layout.stride();
+    packed.vertices.assign(count * stride, 0);
+    packed.indices = mesh.indices;
+    for (size_t v = 0; v < count; v++) {
+        unsigned char *vertex = &packed.vertices[v * stride];
+
+        const glm::vec3 p = position(v);
+        glm::vec3 decoded;
+        if (encoding.position == Position::Float) {
+            const float values[3] = {p.x, p.y, p.z};
+            store(vertex, positionOffset, values);
+            decoded = p;
+        } else if (encoding.position == Position::Half) {
+            for (int axis = 0; axis < 3; axis++) {
+                store(vertex, positionOffset + axis * 2, glm::packHalf1x16(p[axis]));
+                decoded[axis] = roundTripHalf(p[axis]);
+            }
+        } else {
+            for (int axis = 0; axis < 3; axis++) {
+                const float scale = packed.positionScale[axis];
+                const int16_t q = snorm16(scale > 0.0f ? (p[axis] - packed.positionOffset[axis]) / scale : 0.0f);
+                store(vertex, positionOffset + axis * 2, q);
+                decoded[axis] = packed.positionOffset[axis] + scale * fromSnorm16(q);
+            }
+        }
+        packed.maxPositionError = std::max(packed.maxPositionError, glm::length(decoded - p));
+
+        const glm::vec3 n = normal(v);
+        if (encoding.normal == Normal::Float) {
+            const float values[3] = {n.x, n.y, n.z};
+            store(vertex, normalOffset, values);
+        } else if (encoding.normal == Normal::Octahedral16) {
+            const glm::vec2 e = octahedralEncode(n);
+            const int16_t q[2] = {snorm16(e.x), snorm16(e.y)};
+            store(vertex, normalOffset, q);
+            const glm::vec3 back = octahedralDecode(glm::vec2(fromSnorm16(q[0]), fromSnorm16(q[1])));
+            packed.maxNormalError = std::max(packed.maxNormalError, angleBetween(n, back));
+        } else {
+            const uint32_t bits = snorm10(n.x) | snorm10(n.y) << 10 | snorm10(n.z) << 20;
+            store(vertex, normalOffset, bits);
+            const glm::vec3 back(fromSnorm10(bits), fromSnorm10(bits >> 10), fromSnorm10(bits >> 20));
+            packed.maxNormalError = std::max(packed.maxNormalError, angleBetween(n, back));
+        }
+
+        const glm::vec2 uv = texCoord(v);
+        if (texCoordEncoding == TexCoord::Float) {
+            const float values[2] = {uv.x, uv.y};
+            store(vertex, texCoordOffset, values);
+        } else if (texCoordEncoding == TexCoord::Half) {
+            store(vertex, texCoordOffset, glm::packHalf2x16(uv));
+        } else {
+            const uint16_t q[2] = {static_cast<uint16_t>(std::lround(uv.x * 65535.0f)),
+                                   static_cast<uint16_t>(std::lround(uv.y * 65535.0f))};
+            store(vertex, texCoordOffset, q);
+        }
+    }
+    return packed;
+}
@@ -4,7 +4,14 @@
 
 #ifndef VERTEXUTILITY_H
 #define VERTEXUTILITY_H
+#include <cstddef>
+#include <cstdint>
 #include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "VertexLayout.h"
 
 struct TriangleBuffers {
     unsigned int VAO;
@@ -17,12 +24,115 @@ struct TriangleBuffersWithoutEBO {
     unsigned int VBO;
 };
 
+// an indexed triangle list of interleaved vertices, stride floats each
+struct IndexedMesh {
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    unsigned int stride = 0;
+
+    size_t vertexCount() const { return stride == 0 ? 0 : vertices.size() / stride; }
+};
+
+// how an index buffer uses a FIFO post-transform vertex cache
+struct VertexCacheStats {
+    size_t triangles = 0;
+    size_t vertices = 0; // distinct vertices referenced
+    size_t transforms = 0; // cache misses, i.e. vertex shader runs
+
+    // average cache miss ratio: transforms per triangle, 3 without any reuse and about 0.5 on a large regular grid
+    float ACMR() const { return triangles == 0 ? 0.0f : static_cast<float>(transforms) / triangles; }
+
+    // average transform to vertex ratio: 1 when every vertex is transformed exactly once
+    float ATVR() const { return vertices == 0 ? 0.0f : static_cast<float>(transforms) / vertices; }
+};
+
+// how QuantizeMesh stores each attribute of a surface vertex
+struct VertexEncoding {
+    enum class Position : uint8_t {
+        Float,
+        Half, // exact for small integers and halves, about 3 significant digits further out
+        Snorm16, // 16 bits per axis across the mesh bounds, decoded in vertex.glsl
+    };
+    enum class Normal : uint8_t {
+        Float,
+        Octahedral16, // folded onto an octahedron, two snorm16; decoded in vertex.glsl
+        Snorm10, // 10_10_10_2, read as is
+    };
+    enum class TexCoord : uint8_t {
+        Float,
+        Half,
+        Unorm16, // for coordinates within [0, 1]; others are stored as half floats
+    };
+
+    Position position = Position::Float;
+    Normal normal = Normal::Float;
+    TexCoord texCoord = TexCoord::Float;
+
+    // 32 bytes a vertex
+    static VertexEncoding full() { return {}; }
+
+    // 16 bytes a vertex that the shaders read without decoding: half positions, 10_10_10_2 normals, unorm16 UVs
+    static VertexEncoding compact() { return {Position::Half, Normal::Snorm10, TexCoord::Unorm16}; }
+
+    // 16 bytes a vertex with even precision over the whole mesh: snorm16 positions, octahedral normals, unorm16 UVs
+    static VertexEncoding quantized() { return {Position::Snorm16, Normal::Octahedral16, TexCoord::Unorm16}; }
+};
+
+// the vertices of an indexed mesh packed as layout says
+struct QuantizedMesh {
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned int> indices;
+    VertexLayout layout;
+    // of the positions, before packing
+    glm::vec3 boundsMin{0.0f};
+    glm::vec3 boundsMax{0.0f};
+    // with snorm16 positions the shader computes positionOffset + positionScale * attribute
+    glm::vec3 positionOffset{0.0f};
+    glm::vec3 positionScale{1.0f};
+    // the largest error of the decoded attributes, in mesh units and radians
+    float maxPositionError = 0.0f;
+    float maxNormalError = 0.0f;
+
+    size_t vertexCount() const { return layout.stride() == 0 ? 0 : vertices.size() / layout.stride(); }
+};
+
 class VertexUtility {
 public:
     static TriangleBuffers CreateTriangleWithTexture(const std::span<const float> &vertices,
                                                      const std::span<const unsigned int> &indices);
 
+    // 3 floats position and 2 floats texture coordinates
     static TriangleBuffersWithoutEBO CreateTriangleWithTexture(const std::span<const float> &vertices);
+
+    // vertex array, vertex and index buffer of a packed mesh, its attributes set up from the mesh's layout
+    static TriangleBuffers CreateMesh(const QuantizedMesh &mesh);
+
+    // the same from vertices and indices anywhere in memory, e.g. a mapped file, which GL copies from directly
+    static TriangleBuffers CreateMesh(std::span<const unsigned char> vertices, std::span<const unsigned int> indices,
+                                      const VertexLayout &layout);
+
+    // Turn an unindexed triangle list into an indexed one: vertices with equal attributes (-0 equals 0) are merged
+    // through a hash table, in order of first appearance.
+    static IndexedMesh WeldVertices(std::span<const float> vertices, unsigned int stride);
+
+    // Reorder the triangles so that consecutive ones share vertices that are still in the post-transform cache,
+    // greedily emitting the best scoring triangle next (Tom Forsyth's linear-speed vertex cache optimisation).
+    static void OptimizeVertexCache(std::span<unsigned int> indices, size_t vertexCount);
+
+    // Renumber the vertices in the order the indices first use them, so the vertex fetch walks memory forward;
+    // unreferenced vertices are dropped.
+    static void OptimizeVertexFetch(IndexedMesh &mesh);
+
+    // simulate a FIFO cache of cacheSize vertices
+    static VertexCacheStats AnalyzeVertexCache(std::span<const unsigned int> indices, size_t vertexCount,
+                                               unsigned int cacheSize = 16);
+
+    // weld, then reorder for the vertex cache and then for fetch
+    static IndexedMesh OptimizeMesh(std::span<const float> vertices, unsigned int stride);
+
+    // Pack the vertices of a mesh in the float surface layout (position, normal, texture coordinates; stride 8) in
+    // the formats encoding asks for, and measure what the packing lost.
+    static QuantizedMesh QuantizeMesh(const IndexedMesh &mesh, const VertexEncoding &encoding);
 };
 
 
@@ -1,10 +1,52 @@
 #include <glad/glad.h>
+#ifdef HAVE_GLFW
 #include <GLFW/glfw3.h>
+#else
+struct GLFWwindow; // windowed mode is compiled out, render_loop only ever sees nullptr
+#endif
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
-#include "Libs/image/stb_image.h"
+#include "Utilities/Benchmark.h"
+#include "Utilities/BVH.h"
 #include "Utilities/Camera.h"
+#include "Utilities/FrustumCuller.h"
+#include "Utilities/GBuffer.h"
+#include "Utilities/GLStateCache.h"
+#include "Utilities/GLStats.h"
+#ifdef HAVE_EGL
+#include "Utilities/HeadlessContext.h"
+#endif
+#include "Utilities/InstanceBuffer.h"
+#include "Utilities/JobSystem.h"
+#include "Utilities/LightBlock.h"
+#include "Utilities/LightClusters.h"
+#include "Utilities/MeshFile.h"
+#include "Utilities/ModelImporter.h"
+#include "Utilities/Profiler.h"
+#include "Utilities/RenderBackend.h"
+#include "Utilities/RenderQueue.h"
+#include "Utilities/ProgramCache.h"
 #include "Utilities/Shader.h"
+#include "Utilities/ShaderLibrary.h"
+#include "Utilities/ShaderVariantCache.h"
+#include "Utilities/ShaderWatcher.h"
+#include "Utilities/TextureLoader.h"
+#include "Utilities/TransformStore.h"
+#include "Utilities/TransformUtility.h"
+#include "Utilities/UploadRing.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -25,10 +67,72 @@ Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
 float lastX = SCR_WIDTH / 2, lastY = SCR_HEIGHT / 2;
 
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
+bool flashlight = true;
+// set by a click, answered by the render loop with a ray along the view direction
+bool pickRequested = false;
+
+// how the containers are lit
+enum class Pipeline {
+    Forward, // every fragment loops over all point lights, NR_POINT_LIGHTS is compiled in
+    Clustered, // point lights binned into view space clusters on the CPU, fragments only visit their cluster's lights
+    Deferred // the containers go into a G-buffer, one fullscreen pass lights it using the clustered light lists
+};
+
+// how objects outside the view are skipped
+enum class Culling {
+    None,
+    Flat, // every bounding volume is tested, 4 or 8 at a time
+    BVH // the containers' hierarchy is walked, whole subtrees are skipped or accepted at once
+};
+
+// render queue passes, in the order they run
+enum DrawPass : uint8_t {
+    ContainerPass, // forward shaded containers, or the G-buffer geometry pass
+    LightPass, // deferred only
+    LampPass
+};
+
+// command line options
+struct Options {
+    unsigned int cubes = 10; // containers in the scene, the first 10 are the classic cubePositions
+    bool instanced = true; // one instanced draw per cube type instead of one draw per cube
+    bool headless = false; // render offscreen through EGL instead of into a window
+    unsigned int frames = 0; // stop after this many frames, 0 runs until the window closes
+    unsigned int width = SCR_WIDTH;
+    unsigned int height = SCR_HEIGHT;
+    std::string output; // headless only: write the last frame to this PPM file
+    std::string trace; // write a Chrome trace of the CPU and GPU profiler scopes to this file
+    std::string shaderCache = "shader_cache"; // program binary cache directory, empty disables it
+    bool watchShaders = false; // reload edited shaders while running; always on with a window
+    Pipeline pipeline = Pipeline::Forward;
+    unsigned int pointLights = 4; // the first 4 are the classic lamps; forward takes up to MAX_POINT_LIGHTS
+    bool flashlight = true; // initial state, F toggles it in a window
+    Culling culling = Culling::BVH;
+    bool animate = false; // spin the containers, which moves their transforms, bounds and instances every frame
+    unsigned int workers = JobSystem::defaultWorkers(); // job threads besides the GL thread
+    std::string benchmark; // run this CPU benchmark instead of rendering
+    bool validateGLState = false; // check the GL state cache against glGet* on every skipped call and every frame
+    VertexEncoding vertexEncoding = VertexEncoding::compact(); // how the cube's vertices are stored
+    std::string mesh; // draw the containers and lamps with this mesh or model file instead of the built-in cube
+    std::string convertSource; // write this mesh to convertOutput instead of rendering
+    std::string convertOutput;
+    bool invalid = false; // some value could not be parsed, the run stops with a usage error
+};
+
+Options options;
+
+// seconds since startup, independent of the window system
+float currentTime() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
 void processInput(GLFWwindow *window);
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
@@ -37,206 +141,860 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 
-unsigned int loadTexture(char const *path, bool invert);
+// uniform handles of diffuse_map_fs.glsl that live outside the "Lights" block, resolved once after linking
+struct LightingUniforms {
+    UniformHandle model, normalMatrix, view, projection, viewPos, shininess;
+    UniformHandle clusterTileScale, clusterDepthScale; // clustered and deferred only
+    UniformHandle inverseViewProjection; // deferred light pass only
+    UniformHandle positionOffset, positionScale; // snorm16 positions only
+};
+
+LightingUniforms resolveLightingUniforms(const Shader &shader) {
+    LightingUniforms u;
+    u.model = shader.uniform("model");
+    u.normalMatrix = shader.uniform("normalMatrix");
+    u.view = shader.uniform("view");
+    u.projection = shader.uniform("projection");
+    u.viewPos = shader.uniform("viewPos");
+    u.shininess = shader.uniform("material.shininess");
+    u.clusterTileScale = shader.uniform("clusterTileScale");
+    u.clusterDepthScale = shader.uniform("clusterDepthScale");
+    u.inverseViewProjection = shader.uniform("inverseViewProjection");
+    u.positionOffset = shader.uniform("positionOffset");
+    u.positionScale = shader.uniform("positionScale");
+    return u;
+}
+
+// half size of the volume the procedurally placed objects are scattered in; keeps the density roughly constant,
+// the volume grows with the cube count
+float sceneExtent(unsigned int cubes) {
+    return 15.0f * std::cbrt(std::max(1.0f, cubes / 10.0f));
+}
+
+// every container is turned about the same axis, by its own angle
+const glm::vec3 CUBE_AXIS = glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f));
+
+// transforms of the containers, handle i for container i; anything past the hand placed cubePositions is scattered
+// around them. Returns the angles (degrees) the containers are turned by.
+std::vector<float> buildCubeTransforms(TransformStore &transforms, unsigned int count) {
+    std::vector<float> angles;
+    angles.reserve(count);
+    transforms.reserve(count);
+    for (unsigned int i = 0; i < count && i < 10; i++) {
+        angles.push_back(20.0f * i);
+        transforms.create(cubePositions[i], glm::angleAxis(glm::radians(angles.back()), CUBE_AXIS));
+    }
+
+    float extent = sceneExtent(count);
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+    for (unsigned int i = static_cast<unsigned int>(angles.size()); i < count; i++) {
+        glm::vec3 cubePosition(position(rng), position(rng), position(rng) - extent);
+        angles.push_back(angle(rng));
+        transforms.create(cubePosition, glm::angleAxis(glm::radians(angles.back()), CUBE_AXIS));
+    }
+    return angles;
+}
+
+// the classic 4 lamps first, any further lights get a random color and are scattered like the cubes
+std::vector<PointLight> buildPointLights(unsigned int count, float extent) {
+    std::vector<PointLight> lights;
+    lights.reserve(count);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> channel(0.2f, 1.0f);
+    for (unsigned int i = 0; i < count; i++) {
+        PointLight light{};
+        glm::vec3 color;
+        light.constant = 1.0f;
+        if (i < 4) {
+            light.position = pointLightPositions[i];
+            color = pointLightColors[i];
+            light.linear = pointLightAttenuation[i].x;
+            light.quadratic = pointLightAttenuation[i].y;
+        } else {
+            light.position = glm::vec3(position(rng), position(rng), position(rng) - extent);
+            color = glm::vec3(channel(rng), channel(rng), channel(rng));
+            // short range (about 5 units), so that a crowd of lights stays local
+            light.linear = 0.7f;
+            light.quadratic = 1.8f;
+        }
+        light.ambient = color * 0.1f;
+        light.diffuse = color;
+        light.specular = color;
+        lights.push_back(light);
+    }
+    return lights;
+}
+
+std::vector<glm::mat4> buildLampModels(const std::vector<PointLight> &lights) {
+    std::vector<glm::mat4> models;
+    for (const PointLight &light: lights) {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), light.position);
+        models.push_back(glm::scale(model, glm::vec3(0.2f))); // Make it a smaller cube
+    }
+    return models;
+}
+
+// the lighting shader is specialized for the scene: no loop over lights that do not exist. vertexDefines are those
+// of the meshes it draws.
+ShaderDefines lightingDefines(const ShaderDefines &vertexDefines, bool spotLight) {
+    ShaderDefines defines = vertexDefines;
+    if (options.pipeline != Pipeline::Forward) {
+        LightClusters::addDefines(defines);
+    } else {
+        defines.set("NR_POINT_LIGHTS", static_cast<int>(options.pointLights));
+    }
+    defines.set("SPOT_LIGHT", spotLight ? 1 : 0);
+    return defines;
+}
+
+// the built-in cube: 36 separate vertices welded into an index buffer in vertex cache order and packed
+QuantizedMesh cubeSurfaceMesh() {
+    const IndexedMesh indexed = VertexUtility::OptimizeMesh(vertices, 8);
+    QuantizedMesh mesh = VertexUtility::QuantizeMesh(indexed, options.vertexEncoding);
+    const size_t vertexCount = std::size(vertices) / 8;
+    std::vector<unsigned int> unindexed(vertexCount);
+    std::iota(unindexed.begin(), unindexed.end(), 0u);
+    const VertexCacheStats before = VertexUtility::AnalyzeVertexCache(unindexed, vertexCount);
+    const VertexCacheStats after = VertexUtility::AnalyzeVertexCache(mesh.indices, mesh.vertexCount());
+    std::cout << "Cube mesh: " << vertexCount << " vertices welded to " << mesh.vertexCount() << ", ACMR "
+              << before.ACMR() << " -> " << after.ACMR() << ", ATVR " << before.ATVR() << " -> " << after.ATVR()
+              << ", " << 8 * sizeof(float) << " -> " << mesh.layout.stride() << " bytes a vertex (error "
+              << mesh.maxPositionError << ", " << mesh.maxNormalError << " rad)" << std::endl;
+    return mesh;
+}
+
+// an OBJ or glTF model, its triangles reordered for the vertex cache and fetch
+bool importModel(const std::string &path, JobSystem &jobs, ImportedModel &model) {
+    ModelImporter importer(jobs);
+    if (!importer.load(path, model))
+        return false;
+    std::cout << "Imported " << path << ": " << model.mesh.vertexCount() << " vertices, "
+              << model.mesh.indices.size() / 3 << " triangles, " << model.parts.size() << " parts, ";
+    importer.stats().print(std::cout);
+    const float optimizeStart = currentTime();
+    ModelImporter::optimize(model);
+    std::cout << "Optimized " << path << " for the vertex cache and fetch in "
+              << (currentTime() - optimizeStart) * 1000.0f << " ms" << std::endl;
+    return true;
+}
+
+// the offline half of mesh loading: pack a mesh with the chosen vertex format into a file --mesh maps
+bool convertMesh(const std::string &source, const std::string &output) {
+    QuantizedMesh mesh;
+    if (ModelImporter::canLoad(source)) {
+        JobSystem jobs(options.workers);
+        ImportedModel model;
+        if (!importModel(source, jobs, model))
+            return false;
+        // a mesh file is one draw; the parts stay in material order but their materials are dropped
+        if (model.parts.size() > 1) {
+            std::cout << "Mesh files hold no materials: the " << model.parts.size() << " parts of " << source
+                      << " are written as one" << std::endl;
+        }
+        mesh = VertexUtility::QuantizeMesh(model.mesh, options.vertexEncoding);
+    } else if (source == "cube") {
+        mesh = cubeSurfaceMesh();
+    } else {
+        std::cerr << "Unknown mesh source: " << source << ", expected cube, .obj, .gltf or .glb\n";
+        return false;
+    }
+    if (!MeshFile::write(output, mesh))
+        return false;
+    std::cout << "Wrote " << output << ": " << mesh.vertexCount() << " vertices, " << mesh.indices.size() / 3
+              << " triangles, " << mesh.layout.stride() << " bytes a vertex" << std::endl;
+    return true;
+}
 
 void render_loop(GLFWwindow *window) {
-    float currentFrame = glfwGetTime();
+    float currentFrame = currentTime();
     deltaTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
-    Shader lightingShader("../Shaders/diffuse/diffuse_map_vs.glsl",
-                          "../Shaders/diffuse/diffuse_map_fs.glsl");
-    Shader lightCubeShader("../Shaders/diffuse/diffuse_cube_vs.glsl",
-                           "../Shaders/diffuse/diffuse_cube_fs.glsl");
-
-    unsigned int VBO, cubeVAO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &VBO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glBindVertexArray(cubeVAO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    ProgramCache::setDirectory(options.shaderCache);
+    // the CPU side of every frame runs on these threads, the GL thread among them; model import uses them first
+    JobSystem jobs(options.workers);
+
+    // the containers and lamps are one mesh: an imported model, a mesh file drawn straight from its mapping, or the
+    // built-in cube. For a file cubeMesh only describes the vertices and indices, which stay in the mapping until
+    // they are uploaded.
+    const float meshStart = currentTime();
+    MeshFile meshFile;
+    QuantizedMesh cubeMesh;
+    // the runs of indices the containers are drawn in, one per material of a model
+    std::vector<ModelPart> cubeParts;
+    std::vector<ModelMaterial> modelMaterials;
+    if (!options.mesh.empty() && ModelImporter::canLoad(options.mesh)) {
+        ImportedModel model;
+        if (importModel(options.mesh, jobs, model)) {
+            cubeMesh = VertexUtility::QuantizeMesh(model.mesh, options.vertexEncoding);
+            cubeParts = std::move(model.parts);
+            modelMaterials = std::move(model.materials);
+        }
+    } else if (!options.mesh.empty() && meshFile.open(options.mesh)) {
+        cubeMesh.layout = meshFile.layout();
+        cubeMesh.boundsMin = meshFile.boundsMin();
+        cubeMesh.boundsMax = meshFile.boundsMax();
+        cubeMesh.positionOffset = meshFile.positionOffset();
+        cubeMesh.positionScale = meshFile.positionScale();
+    }
+    if (!meshFile.isOpen() && cubeMesh.indices.empty()) {
+        cubeMesh = cubeSurfaceMesh();
+    }
+    const float meshOpenSeconds = currentTime() - meshStart;
+    const int cubeIndexCount = static_cast<int>(meshFile.isOpen() ? meshFile.indices().size()
+                                                                  : cubeMesh.indices.size());
+    if (cubeParts.empty()) {
+        cubeParts.push_back({0, static_cast<uint32_t>(cubeIndexCount), -1});
+    }
+    // the box around the mesh origin that culling treats it as
+    const glm::vec3 cubeHalfSize = glm::max(glm::abs(cubeMesh.boundsMin), glm::abs(cubeMesh.boundsMax));
+    // the programs that draw the cube decode its vertices
+    ShaderDefines vertexDefines;
+    cubeMesh.layout.addDefines(vertexDefines);
+
+    const float shadersStart = currentTime();
+    // submit every program first so the driver can compile them side by side
+    ShaderLibrary shaderLibrary;
+    const char *surfaceVertexShader = options.instanced
+                                          ? "../Shaders/diffuse/diffuse_map_instanced_vs.glsl"
+                                          : "../Shaders/diffuse/diffuse_map_vs.glsl";
+    // forward and clustered light the containers while drawing them; deferred draws them into the G-buffer and
+    // lights that in a pass of its own
+    const bool deferred = options.pipeline == Pipeline::Deferred;
+    const char *lightingFragmentShader = "../Shaders/diffuse/diffuse_map_fs.glsl";
+    if (options.pipeline == Pipeline::Clustered) {
+        lightingFragmentShader = "../Shaders/diffuse/diffuse_map_clustered_fs.glsl";
+    } else if (deferred) {
+        lightingFragmentShader = "../Shaders/diffuse/deferred_light_fs.glsl";
+    }
+    ShaderVariantCache lightingVariants(deferred ? "../Shaders/diffuse/deferred_light_vs.glsl" : surfaceVertexShader,
+                                        lightingFragmentShader);
+    flashlight = options.flashlight;
+    lightingVariants.request(lightingDefines(vertexDefines, flashlight));
+    Shader *gbufferShader = deferred
+                                ? &shaderLibrary.add("gbuffer", surfaceVertexShader,
+                                                     "../Shaders/diffuse/gbuffer_fs.glsl", vertexDefines)
+                                : nullptr;
+    Shader &lightCubeShader = shaderLibrary.add("lamp",
+                                                options.instanced
+                                                    ? "../Shaders/diffuse/diffuse_cube_instanced_vs.glsl"
+                                                    : "../Shaders/diffuse/diffuse_cube_vs.glsl",
+                                                "../Shaders/diffuse/diffuse_cube_fs.glsl", vertexDefines);
+    shaderLibrary.finish();
+    bool lightingFlashlight = flashlight;
+    Shader *lightingShader = &lightingVariants.get(lightingDefines(vertexDefines, lightingFlashlight));
+    // the program that draws the containers
+    Shader *surfaceShader = deferred ? gbufferShader : lightingShader;
+    std::cout << "Shaders ready in " << (currentTime() - shadersStart) * 1000.0f << " ms (program cache: "
+              << ProgramCache::stats().hits << " hits, " << ProgramCache::stats().misses << " misses, "
+              << ProgramCache::stats().rejected << " rejected)" << std::endl;
+
+    const float uploadStart = currentTime();
+    const TriangleBuffers cubeBuffers = meshFile.isOpen() ? meshFile.upload() : VertexUtility::CreateMesh(cubeMesh);
+    if (meshFile.isOpen()) {
+        std::cout << "Mesh " << options.mesh << ": " << meshFile.header().vertexCount << " vertices, "
+                  << cubeIndexCount / 3 << " triangles, " << meshFile.header().vertexStride << " bytes a vertex, "
+                  << (meshFile.vertices().size_bytes() + meshFile.indices().size_bytes()) / 1024.0 << " KiB mapped"
+                  << " and uploaded in " << (meshOpenSeconds + currentTime() - uploadStart) * 1000.0f << " ms"
+                  << std::endl;
+        // GL has its own copy now
+        meshFile.close();
+    }
+    unsigned int VBO = cubeBuffers.VBO, cubeVAO = cubeBuffers.VAO;
 
     // second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
     unsigned int lightCubeVAO;
     glGenVertexArrays(1, &lightCubeVAO);
-    glBindVertexArray(lightCubeVAO);
+    glState.bindVertexArray(lightCubeVAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // note that we update the lamp's position attribute's stride to reflect the updated buffer data
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(0);
+    glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
+    // the lamp only needs the position attribute of the cube's layout
+    cubeMesh.layout.apply(0, 1u << VertexLayout::POSITION_LOCATION);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeBuffers.EBO);
 
+    TransformStore cubeTransforms;
+    const std::vector<float> cubeAngles = buildCubeTransforms(cubeTransforms, options.cubes);
+    cubeTransforms.update(&jobs);
+    const std::span<const glm::mat4> cubeModels = cubeTransforms.worldMatrices();
+    const std::vector<PointLight> pointLights = buildPointLights(options.pointLights, sceneExtent(options.cubes));
+    const std::vector<glm::mat4> lampModels = buildLampModels(pointLights);
+    std::vector<glm::mat3> cubeNormalMatrices(cubeModels.size());
+    TransformUtility::NormalMatrices(cubeModels, cubeNormalMatrices);
+    InstanceBuffer cubeInstances;
+    InstanceBuffer lampInstances;
+    if (options.instanced) {
+        cubeInstances.attach(cubeVAO);
+        cubeInstances.upload(cubeModels, cubeNormalMatrices);
+        lampInstances.attach(lightCubeVAO);
+        lampInstances.upload(lampModels);
+    }
 
-    uint diffuseMap = loadTexture("../Images/container2.png", false);
-    uint specularMap = loadTexture("../Images/container2_specular.png", false);
+    // bounding volumes for frustum culling, from the bounds of the mesh
+    FrustumCuller cubeCuller;
+    FrustumCuller lampCuller;
+    BVH cubeBVH;
+    std::vector<BVH::Bounds> cubeBounds(cubeModels.size());
+    {
+        std::vector<glm::vec3> centers(cubeModels.size());
+        std::vector<glm::vec3> halfSizes(cubeModels.size());
+        TransformUtility::BoundingBoxes(cubeModels, cubeHalfSize, centers, halfSizes);
+        cubeCuller.setBoxes(centers, halfSizes);
+        // the hierarchy also answers picking rays, so it is built whatever the culling mode
+        for (size_t i = 0; i < cubeBounds.size(); i++) {
+            cubeBounds[i] = {centers[i] - halfSizes[i], centers[i] + halfSizes[i]};
+        }
+        cubeBVH.build(cubeBounds);
 
-    lightingShader.use();
-    lightingShader.setInt("material.diffuse", 0);
-    lightingShader.setInt("material.specular", 1);
+        // the lamps are small and never rotate, so their bounding spheres are about as tight as boxes
+        centers.resize(lampModels.size());
+        halfSizes.resize(lampModels.size());
+        TransformUtility::BoundingBoxes(lampModels, cubeHalfSize, centers, halfSizes);
+        std::vector<float> radii(lampModels.size());
+        for (size_t i = 0; i < radii.size(); i++) {
+            radii[i] = glm::length(halfSizes[i]);
+        }
+        lampCuller.setSpheres(centers, radii);
+    }
+    // what gets drawn this frame, and which objects the instance buffers hold; everything to begin with
+    std::vector<uint32_t> visibleCubes(cubeModels.size());
+    std::iota(visibleCubes.begin(), visibleCubes.end(), 0u);
+    std::vector<uint32_t> visibleLamps(lampModels.size());
+    std::iota(visibleLamps.begin(), visibleLamps.end(), 0u);
+    std::vector<uint32_t> uploadedCubes = visibleCubes;
+    std::vector<uint32_t> uploadedLamps = visibleLamps;
+    // instance data of the visible objects, gathered by the frame jobs when it has to be uploaded again
+    std::vector<glm::mat4> cubeInstanceModels;
+    std::vector<glm::mat3> cubeInstanceNormalMatrices;
+    std::vector<glm::mat4> lampInstanceModels;
+    // animated containers stream their instances every frame, so the first frame has to gather them as well
+    bool cubeInstancesStale = options.animate;
+
+    // bring everything derived from the container transforms up to date with the ones that just changed
+    auto moveCubes = [&](std::span<const TransformStore::Handle> changed) {
+        const bool all = changed.size() == cubeModels.size();
+        jobs.parallelFor(changed.size(), 1024, [&](size_t begin, size_t end) {
+            // when everything moved, changed[k] == k
+            if (all) {
+                TransformUtility::NormalMatrices(cubeModels.subspan(begin, end - begin),
+                                                 std::span(cubeNormalMatrices).subspan(begin, end - begin));
+            }
+            for (size_t k = begin; k < end; k++) {
+                const TransformStore::Handle i = changed[k];
+                if (!all) {
+                    cubeNormalMatrices[i] = TransformUtility::NormalMatrix(cubeModels[i]);
+                }
+                glm::vec3 center, halfSize;
+                TransformUtility::BoundingBoxes(cubeModels.subspan(i, 1), cubeHalfSize, {&center, 1},
+                                                {&halfSize, 1});
+                cubeCuller.setBox(i, center, halfSize);
+                cubeBounds[i] = {center - halfSize, center + halfSize};
+            }
+        });
+        // the tree is one structure and is updated on a single thread; past a few moves one pass over all of it is
+        // cheaper than walking up from every leaf
+        if (changed.size() > cubeBounds.size() / 8) {
+            cubeBVH.refit(cubeBounds);
+        } else {
+            for (TransformStore::Handle i: changed) {
+                cubeBVH.move(i, cubeBounds[i]);
+            }
+        }
+        cubeInstancesStale = true;
+    };
+
+    TextureLoader textures;
+    unsigned int diffuseMap = textures.load("../Images/container2.png");
+    unsigned int specularMap = textures.load("../Images/container2_specular.png");
+    // the textures of the model's materials, the container's where a material has none. Imported texture
+    // coordinates have their origin at the bottom left, so the images are flipped.
+    std::unordered_map<std::string, unsigned int> modelTextureNames;
+    auto modelTexture = [&](const std::string &path, unsigned int fallback) {
+        if (path.empty() || !std::filesystem::exists(path))
+            return fallback;
+        auto [entry, added] = modelTextureNames.try_emplace(path, 0);
+        if (added) {
+            entry->second = textures.load(path, true);
+        }
+        return entry->second;
+    };
+    std::vector<std::pair<unsigned int, unsigned int> > modelTextures;
+    for (const ModelMaterial &material: modelMaterials) {
+        modelTextures.emplace_back(modelTexture(material.diffuseTexture, diffuseMap),
+                                   modelTexture(material.specularTexture, specularMap));
+    }
+    // batch runs must not depend on how fast the decoders are, so they wait for the real textures
+    if (!window) {
+        textures.finish();
+    }
+
+    std::unique_ptr<ShaderWatcher> shaderWatcher;
+    if (window || options.watchShaders) {
+        shaderWatcher = std::make_unique<ShaderWatcher>();
+    }
+
+    // everything tied to a program object; runs again whenever the variant changes or a hot reload swaps the program.
+    // Forward and clustered have one program that is both the surface and the lighting shader.
+    LightingUniforms surface;
+    const Shader *boundSurface = nullptr;
+    unsigned int boundSurfaceGeneration = 0;
+    auto setupSurfaceShader = [&]() {
+        surfaceShader->use();
+        surfaceShader->setInt("material.diffuse", 0);
+        surfaceShader->setInt("material.specular", 1);
+        surface = resolveLightingUniforms(*surfaceShader);
+        if (shaderWatcher) {
+            shaderWatcher->watch(*surfaceShader);
+        }
+        boundSurface = surfaceShader;
+        boundSurfaceGeneration = surfaceShader->generation();
+    };
+    LightingUniforms lighting;
+    const Shader *boundLighting = nullptr;
+    unsigned int boundGeneration = 0;
+    auto setupLightingShader = [&]() {
+        lightingShader->use();
+        if (options.pipeline != Pipeline::Forward) {
+            lightingShader->setInt("pointLightData", LightClusters::LIGHT_DATA_UNIT);
+            lightingShader->setInt("clusterGrid", LightClusters::GRID_UNIT);
+            lightingShader->setInt("clusterLights", LightClusters::INDEX_UNIT);
+        }
+        if (deferred) {
+            lightingShader->setInt("gAlbedoSpecular", GBuffer::ALBEDO_SPECULAR_UNIT);
+            lightingShader->setInt("gNormalShininess", GBuffer::NORMAL_SHININESS_UNIT);
+            lightingShader->setInt("gDepth", GBuffer::DEPTH_UNIT);
+        }
+        lighting = resolveLightingUniforms(*lightingShader);
+        LightBlock::bind(lightingShader->ID);
+        if (shaderWatcher) {
+            shaderWatcher->watch(*lightingShader);
+        }
+        boundLighting = lightingShader;
+        boundGeneration = lightingShader->generation();
+    };
+    setupSurfaceShader();
+    setupLightingShader();
+
+    // the data that changes every frame: the light block and animated instances
+    UploadRing uploadRing;
+    LightBlock lights;
+
+    DirLight dirLight{};
+    dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    dirLight.ambient = glm::vec3(0.0f);
+    dirLight.diffuse = glm::vec3(0.05f);
+    dirLight.specular = glm::vec3(0.2f);
+    lights.setDirLight(dirLight);
+
+    std::unique_ptr<LightClusters> clusters;
+    if (options.pipeline != Pipeline::Forward) {
+        clusters = std::make_unique<LightClusters>(jobs);
+        clusters->setLights(pointLights);
+    } else {
+        for (unsigned int i = 0; i < pointLights.size(); i++) {
+            lights.setPointLight(i, pointLights[i]);
+        }
+    }
+
+    // created while the output framebuffer is bound, which is where the light pass ends up
+    std::unique_ptr<GBuffer> gbuffer;
+    if (deferred) {
+        gbuffer = std::make_unique<GBuffer>(options.width, options.height);
+    }
 
-    while (!glfwWindowShouldClose(window)) {
-        float currentFrame = static_cast<float>(glfwGetTime());
+    // every draw goes through the queue; the passes set up their render targets themselves
+    RenderQueue renderQueue;
+    RenderBackend renderBackend;
+    renderQueue.setPass(ContainerPass, "draw containers", [&]() {
+        if (gbuffer) {
+            gbuffer->beginGeometry();
+        }
+    });
+    if (deferred) {
+        renderQueue.setPass(LightPass, "light pass", [&]() {
+            gbuffer->beginLighting();
+            // every covered pixel is lit exactly once, in any order
+            glState.disable(GL_DEPTH_TEST);
+        });
+    }
+    renderQueue.setPass(LampPass, "draw lamps", [&]() {
+        if (gbuffer) {
+            glState.enable(GL_DEPTH_TEST);
+            // the lamps are drawn forward on top and need the scene's depth
+            gbuffer->resolveDepth();
+        }
+    });
+    const RenderQueue::TextureBinding containerTextures[] = {
+        {0, GL_TEXTURE_2D, diffuseMap},
+        {1, GL_TEXTURE_2D, specularMap}
+    };
+    const uint16_t containerMaterial = renderQueue.addMaterial(containerTextures);
+    std::vector<uint16_t> partMaterials;
+    for (const ModelPart &part: cubeParts) {
+        if (part.material < 0) {
+            partMaterials.push_back(containerMaterial);
+            continue;
+        }
+        const auto [diffuse, specular] = modelTextures[static_cast<size_t>(part.material)];
+        const RenderQueue::TextureBinding partTextures[] = {
+            {0, GL_TEXTURE_2D, diffuse},
+            {1, GL_TEXTURE_2D, specular}
+        };
+        partMaterials.push_back(renderQueue.addMaterial(partTextures));
+    }
+
+    UniformHandle lampModel, lampView, lampProjection, lampPositionOffset, lampPositionScale;
+    auto setupLampShader = [&]() {
+        lampModel = lightCubeShader.uniform("model");
+        lampView = lightCubeShader.uniform("view");
+        lampProjection = lightCubeShader.uniform("projection");
+        lampPositionOffset = lightCubeShader.uniform("positionOffset");
+        lampPositionScale = lightCubeShader.uniform("positionScale");
+    };
+    setupLampShader();
+    if (shaderWatcher) {
+        shaderWatcher->watch(lightCubeShader);
+    }
+    // only count what the frame loop itself issues
+    glStats.reset();
+    glState.resetStats();
+    glState.setValidation(options.validateGLState);
+    if (!options.trace.empty()) {
+        Profiler::enable(true);
+    }
+    const float loopStart = currentTime();
+    unsigned int frame = 0;
+
+    while (options.frames == 0 || frame < options.frames) {
+#ifdef HAVE_GLFW
+        if (window && glfwWindowShouldClose(window))
+            break;
+#endif
+        float currentFrame = currentTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        Profiler::beginFrame();
+        PROFILE_GL_SCOPE("frame");
+        textures.update();
+        // swap in edited shaders between frames, never in the middle of one
+        if (shaderWatcher) {
+            for (Shader *shader: shaderWatcher->apply()) {
+                if (shader == &lightCubeShader) {
+                    setupLampShader();
+                }
+            }
+        }
 
-        processInput(window);
+#ifdef HAVE_GLFW
+        if (window)
+            processInput(window);
+#endif
+        // the flashlight lives in the shader variant; each variant compiles once and is reused after that
+        if (flashlight != lightingFlashlight) {
+            lightingFlashlight = flashlight;
+            lightingShader = &lightingVariants.get(lightingDefines(vertexDefines, flashlight));
+            if (!deferred) {
+                surfaceShader = lightingShader;
+            }
+        }
+        if (surfaceShader != boundSurface || surfaceShader->generation() != boundSurfaceGeneration) {
+            setupSurfaceShader();
+        }
+        if (lightingShader != boundLighting || lightingShader->generation() != boundGeneration) {
+            setupLightingShader();
+        }
+        if (gbuffer) {
+            gbuffer->resize(options.width, options.height);
+        }
 
         // rendering commands here
         //glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        lightingShader.use();
-        lightingShader.setVec3("viewPos", camera.Position);
-        lightingShader.setFloat("material.shininess", 32.0f);
-
-        /*
-               Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index
-               the proper PointLight struct in the array to set each uniform variable. This can be done more code-friendly
-               by defining light types as classes and set their values in there, or by using a more efficient uniform approach
-               by using 'Uniform buffer objects', but that is something we'll discuss in the 'Advanced GLSL' tutorial.
-            */
-        // directional light
-        lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        //lightingShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-        //lightingShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        //lightingShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-
-
-        // point light 1
-        // Directional light
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "dirLight.direction"), -0.2f, -1.0f, -0.3f);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "dirLight.ambient"), 0.0f, 0.0f, 0.0f);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "dirLight.diffuse"), 0.05f, 0.05f, 0.05);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "dirLight.specular"), 0.2f, 0.2f, 0.2f);
-        // Point light 1
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[0].position"), pointLightPositions[0].x,
-                    pointLightPositions[0].y, pointLightPositions[0].z);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[0].ambient"), pointLightColors[0].x * 0.1,
-                    pointLightColors[0].y * 0.1, pointLightColors[0].z * 0.1);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[0].diffuse"), pointLightColors[0].x,
-                    pointLightColors[0].y, pointLightColors[0].z);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[0].specular"), pointLightColors[0].x,
-                    pointLightColors[0].y, pointLightColors[0].z);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[0].constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[0].linear"), 0.14);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[0].quadratic"), 0.07);
-        // Point light 2
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[1].position"), pointLightPositions[1].x,
-                    pointLightPositions[1].y, pointLightPositions[1].z);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[1].ambient"), pointLightColors[1].x * 0.1,
-                    pointLightColors[1].y * 0.1, pointLightColors[1].z * 0.1);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[1].diffuse"), pointLightColors[1].x,
-                    pointLightColors[1].y, pointLightColors[1].z);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[1].specular"), pointLightColors[1].x,
-                    pointLightColors[1].y, pointLightColors[1].z);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[1].constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[1].linear"), 0.14);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[1].quadratic"), 0.07);
-        // Point light 3
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[2].position"), pointLightPositions[2].x,
-                    pointLightPositions[2].y, pointLightPositions[2].z);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[2].ambient"), pointLightColors[2].x * 0.1,
-                    pointLightColors[2].y * 0.1, pointLightColors[2].z * 0.1);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[2].diffuse"), pointLightColors[2].x,
-                    pointLightColors[2].y, pointLightColors[2].z);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[2].specular"), pointLightColors[2].x,
-                    pointLightColors[2].y, pointLightColors[2].z);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[2].constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[2].linear"), 0.22);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[2].quadratic"), 0.20);
-        // Point light 4
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[3].position"), pointLightPositions[3].x,
-                    pointLightPositions[3].y, pointLightPositions[3].z);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[3].ambient"), pointLightColors[3].x * 0.1,
-                    pointLightColors[3].y * 0.1, pointLightColors[3].z * 0.1);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[3].diffuse"), pointLightColors[3].x,
-                    pointLightColors[3].y, pointLightColors[3].z);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "pointLights[3].specular"), pointLightColors[3].x,
-                    pointLightColors[3].y, pointLightColors[3].z);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[3].constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[3].linear"), 0.14);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "pointLights[3].quadratic"), 0.07);
-        // SpotLight
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "spotLight.position"), camera.Position.x, camera.Position.y,
-                    camera.Position.z);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "spotLight.direction"), camera.Front.x, camera.Front.y,
-                    camera.Front.z);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "spotLight.ambient"), 0.0f, 0.0f, 0.0f);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "spotLight.diffuse"), 1.0f, 1.0f, 1.0f);
-        glUniform3f(glGetUniformLocation(lightingShader.ID, "spotLight.specular"), 1.0f, 1.0f, 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "spotLight.constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "spotLight.linear"), 0.09);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "spotLight.quadratic"), 0.032);
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "spotLight.cutOff"), glm::cos(glm::radians(10.0f)));
-        glUniform1f(glGetUniformLocation(lightingShader.ID, "spotLight.outerCutOff"), glm::cos(glm::radians(15.0f)));
-
         // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f,
-                                                100.0f);
+        float aspect = (float) options.width / (float) options.height;
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, NEAR_PLANE, FAR_PLANE);
         glm::mat4 view = camera.GetViewMatrix();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
-
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        lightingShader.setMat4("model", model);
-
-        // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-        // bind specular map
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
-
-        // render containers
-        glBindVertexArray(cubeVAO);
-        for (unsigned int i = 0; i < 10; i++) {
-            // calculate the model matrix for each object and pass it to shader before drawing
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            lightingShader.setMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-        }
-
-        // also draw the lamp object(s)
-        lightCubeShader.use();
-        lightCubeShader.setMat4("projection", projection);
-        lightCubeShader.setMat4("view", view);
-
-        // we now draw as many light bulbs as we have point lights.
-        glBindVertexArray(lightCubeVAO);
-        for (unsigned int i = 0; i < 4; i++) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, pointLightPositions[i]);
-            model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-            lightCubeShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-        }
-
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-    }
-
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &lightCubeVAO);
-    glDeleteBuffers(1, &VBO);
+
+        // The CPU side of the frame runs as jobs and the GL thread helps until all of it is done; from then on it only
+        // consumes the results. Culling the containers waits for them to move, the rest is independent.
+        const Frustum frustum = Camera::ExtractFrustum(projection * view);
+        bool uploadCubes = false;
+        bool uploadLamps = false;
+        auto animateCubes = [&]() {
+            // every container spins about its axis; only what actually moved is recomputed downstream
+            const float time = window ? currentFrame : frame / 60.0f;
+            jobs.parallelFor(cubeAngles.size(), 4096, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    cubeTransforms.setRotation(static_cast<TransformStore::Handle>(i),
+                                               glm::angleAxis(glm::radians(cubeAngles[i] + 30.0f * time), CUBE_AXIS));
+                }
+            });
+            if (cubeTransforms.update(&jobs) > 0) {
+                moveCubes(cubeTransforms.changed());
+            }
+        };
+        auto prepareCubes = [&]() {
+            if (options.culling == Culling::BVH) {
+                cubeBVH.cull(frustum, visibleCubes);
+                // ascending like the flat culler, so both modes draw in the same order
+                std::sort(visibleCubes.begin(), visibleCubes.end());
+            } else if (options.culling == Culling::Flat) {
+                cubeCuller.cull(frustum, visibleCubes, &jobs);
+            }
+            // the instance buffers only change when something entered or left the view
+            if (options.instanced && (cubeInstancesStale || visibleCubes != uploadedCubes)) {
+                cubeInstanceModels.resize(visibleCubes.size());
+                cubeInstanceNormalMatrices.resize(visibleCubes.size());
+                jobs.parallelFor(visibleCubes.size(), 4096, [&](size_t begin, size_t end) {
+                    for (size_t k = begin; k < end; k++) {
+                        cubeInstanceModels[k] = cubeModels[visibleCubes[k]];
+                        cubeInstanceNormalMatrices[k] = cubeNormalMatrices[visibleCubes[k]];
+                    }
+                });
+                uploadCubes = true;
+            }
+        };
+        auto prepareLamps = [&]() {
+            if (options.culling != Culling::None) {
+                lampCuller.cull(frustum, visibleLamps, &jobs);
+            }
+            if (options.instanced && visibleLamps != uploadedLamps) {
+                lampInstanceModels.clear();
+                for (uint32_t i: visibleLamps) {
+                    lampInstanceModels.push_back(lampModels[i]);
+                }
+                uploadLamps = true;
+            }
+        };
+        auto binLights = [&]() {
+            clusters->bin(view, glm::radians(camera.Zoom), aspect, NEAR_PLANE, FAR_PLANE);
+        };
+        {
+            PROFILE_SCOPE("prepare frame");
+            JobSystem::Counter moved, prepared;
+            if (options.animate) {
+                jobs.run(animateCubes, moved);
+            }
+            jobs.run(prepareCubes, prepared, moved);
+            jobs.run(prepareLamps, prepared);
+            if (clusters) {
+                jobs.run(binLights, prepared);
+            }
+            jobs.wait(prepared);
+        }
+
+        if (pickRequested) {
+            pickRequested = false;
+            BVH::Hit hit{};
+            if (cubeBVH.raycast(camera.Position, camera.Front, FAR_PLANE, hit)) {
+                std::cout << "Picked container " << hit.object << " at " << hit.distance << std::endl;
+            } else {
+                std::cout << "Picked nothing" << std::endl;
+            }
+        }
+        uploadRing.beginFrame();
+        if (options.animate && options.instanced) {
+            // they change every frame anyway
+            cubeInstances.stream(uploadRing, cubeInstanceModels, cubeInstanceNormalMatrices);
+            uploadedCubes = visibleCubes;
+            cubeInstancesStale = false;
+        } else if (uploadCubes) {
+            cubeInstances.upload(cubeInstanceModels, cubeInstanceNormalMatrices);
+            uploadedCubes = visibleCubes;
+            cubeInstancesStale = false;
+        }
+        if (uploadLamps) {
+            lampInstances.upload(lampInstanceModels);
+            uploadedLamps = visibleLamps;
+        }
+
+        {
+            PROFILE_GL_SCOPE("light data");
+            // the directional and point lights are static; only the flashlight follows the camera
+            SpotLight spotLight{};
+            spotLight.position = camera.Position;
+            spotLight.direction = camera.Front;
+            spotLight.ambient = glm::vec3(0.0f);
+            spotLight.diffuse = glm::vec3(1.0f);
+            spotLight.specular = glm::vec3(1.0f);
+            spotLight.constant = 1.0f;
+            spotLight.linear = 0.09f;
+            spotLight.quadratic = 0.032f;
+            spotLight.cutOff = glm::cos(glm::radians(10.0f));
+            spotLight.outerCutOff = glm::cos(glm::radians(15.0f));
+            lights.setSpotLight(spotLight);
+            lights.upload(uploadRing);
+
+            if (clusters) {
+                clusters->upload();
+                clusters->bind();
+            }
+        }
+
+        {
+            PROFILE_SCOPE("record draws");
+            auto recordLighting = [&]() {
+                renderQueue.setVec3(lighting.viewPos, camera.Position);
+                if (clusters) {
+                    renderQueue.setVec2(lighting.clusterTileScale,
+                                        LightClusters::tileScale(options.width, options.height));
+                    renderQueue.setVec2(lighting.clusterDepthScale, clusters->depthScale());
+                }
+                if (gbuffer) {
+                    // the light pass finds its clusters in view space and rebuilds world positions from depth
+                    renderQueue.setMat4(lighting.view, view);
+                    renderQueue.setMat4(lighting.inverseViewProjection, glm::inverse(projection * view));
+                }
+            };
+            // forward and clustered light the containers in the same program
+            renderQueue.beginUniforms();
+            renderQueue.setFloat(surface.shininess, 32.0f);
+            renderQueue.setMat4(surface.projection, projection);
+            renderQueue.setMat4(surface.view, view);
+            if (surface.positionScale.valid()) {
+                renderQueue.setVec3(surface.positionOffset, cubeMesh.positionOffset);
+                renderQueue.setVec3(surface.positionScale, cubeMesh.positionScale);
+            }
+            if (!deferred) {
+                recordLighting();
+            }
+            const RenderQueue::UniformRange surfaceUniforms = renderQueue.endUniforms();
+
+            RenderQueue::Draw containers;
+            containers.shader = surfaceShader;
+            containers.vertexArray = cubeVAO;
+            containers.indexType = GL_UNSIGNED_INT;
+            containers.shared = surfaceUniforms;
+            // one draw per part, each with its material
+            auto submitContainer = [&](float depth) {
+                for (size_t p = 0; p < cubeParts.size(); p++) {
+                    containers.material = partMaterials[p];
+                    containers.first = static_cast<int>(cubeParts[p].firstIndex);
+                    containers.count = static_cast<int>(cubeParts[p].indexCount);
+                    renderQueue.submit(ContainerPass, depth, containers);
+                }
+            };
+            if (options.instanced) {
+                if (cubeInstances.count() > 0) {
+                    renderQueue.beginUniforms();
+                    renderQueue.setMat4(surface.model, glm::mat4(1.0f));
+                    renderQueue.setMat3(surface.normalMatrix, glm::mat3(1.0f));
+                    containers.own = renderQueue.endUniforms();
+                    containers.instances = static_cast<int>(cubeInstances.count());
+                    submitContainer(0.0f);
+                }
+            } else {
+                for (uint32_t i: visibleCubes) {
+                    renderQueue.beginUniforms();
+                    renderQueue.setMat4(surface.model, cubeModels[i]);
+                    renderQueue.setMat3(surface.normalMatrix, cubeNormalMatrices[i]);
+                    containers.own = renderQueue.endUniforms();
+                    // front to back, so the depth test rejects hidden fragments before they are shaded
+                    const float depth = -(view * cubeModels[i][3]).z;
+                    submitContainer((depth - NEAR_PLANE) / (FAR_PLANE - NEAR_PLANE));
+                }
+            }
+
+            if (gbuffer) {
+                renderQueue.beginUniforms();
+                recordLighting();
+                RenderQueue::Draw lightPass;
+                lightPass.shader = lightingShader;
+                lightPass.vertexArray = gbuffer->fullscreenVertexArray();
+                lightPass.count = 3;
+                lightPass.shared = renderQueue.endUniforms();
+                renderQueue.submit(LightPass, 0.0f, lightPass);
+            }
+
+            renderQueue.beginUniforms();
+            renderQueue.setMat4(lampProjection, projection);
+            renderQueue.setMat4(lampView, view);
+            if (lampPositionScale.valid()) {
+                renderQueue.setVec3(lampPositionOffset, cubeMesh.positionOffset);
+                renderQueue.setVec3(lampPositionScale, cubeMesh.positionScale);
+            }
+            RenderQueue::Draw lamps;
+            lamps.shader = &lightCubeShader;
+            lamps.vertexArray = lightCubeVAO;
+            lamps.count = cubeIndexCount;
+            lamps.indexType = GL_UNSIGNED_INT;
+            lamps.shared = renderQueue.endUniforms();
+            if (options.instanced) {
+                if (lampInstances.count() > 0) {
+                    lamps.instances = static_cast<int>(lampInstances.count());
+                    renderQueue.submit(LampPass, 0.0f, lamps);
+                }
+            } else {
+                for (uint32_t i: visibleLamps) {
+                    renderQueue.beginUniforms();
+                    renderQueue.setMat4(lampModel, lampModels[i]);
+                    lamps.own = renderQueue.endUniforms();
+                    const float depth = -(view * lampModels[i][3]).z;
+                    renderQueue.submit(LampPass, (depth - NEAR_PLANE) / (FAR_PLANE - NEAR_PLANE), lamps);
+                }
+            }
+        }
+        uploadRing.flush();
+        renderQueue.execute(renderBackend);
+        uploadRing.endFrame();
+        if (options.validateGLState) {
+            glState.validate();
+        }
+
+        glStats.endFrame();
+        glState.endFrame();
+        Profiler::endFrame();
+        frame++;
+#ifdef HAVE_GLFW
+        if (window) {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            continue;
+        }
+#endif
+        // nothing presents offscreen frames, so flush to keep the driver queue short
+        glFlush();
+    }
+    glFinish();
+    float elapsed = currentTime() - loopStart;
+    std::cout << "Rendered " << frame << " frames in " << elapsed << " s (" << frame / elapsed << " fps)"
+              << std::endl;
+    glStats.print(std::cout);
+    glState.stats().print(std::cout);
+    uploadRing.stats().print(std::cout);
+    textures.uploadStats().print(std::cout);
+    if (options.animate) {
+        cubeTransforms.stats().print(std::cout);
+    }
+    if (options.culling == Culling::BVH) {
+        cubeBVH.printStats(std::cout);
+    }
+    cubeCuller.stats().print(std::cout, "containers");
+    lampCuller.stats().print(std::cout, "lamps");
+    if (clusters) {
+        clusters->stats().print(std::cout);
+    }
+    renderBackend.stats().print(std::cout);
+    jobs.stats().print(std::cout);
+    if (!options.trace.empty() && Profiler::writeChromeTrace(options.trace)) {
+        std::cout << "Wrote " << options.trace << std::endl;
+    }
+
+    glState.deleteVertexArrays(1, &cubeVAO);
+    glState.deleteVertexArrays(1, &lightCubeVAO);
+    glState.deleteBuffers(1, &VBO);
+    glState.deleteBuffers(1, &cubeBuffers.EBO);
 }
 
-void initOpenGl() {
+#ifdef HAVE_GLFW
+// false when no window or context could be created; the reason has been printed
+bool initOpenGl() {
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW\n";
-        return;
+        return false;
     }
 
     // Set OpenGL version and profile
@@ -248,19 +1006,20 @@ void initOpenGl() {
 #endif
 
     GLFWwindow *window =
-            glfwCreateWindow(800, 600, "OpenGL Window", nullptr, nullptr);
+            glfwCreateWindow(options.width, options.height, "OpenGL Window", nullptr, nullptr);
     if (!window) {
         std::cerr << "Failed to create GLFW window\n";
         glfwTerminate();
-        return;
+        return false;
     }
 
     glfwMakeContextCurrent(window);
 
     if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
         std::cerr << "Failed to initialize GLAD\n";
-        return;
+        return false;
     }
+    glState.invalidate();
 
     // This needs to be called after gladLoadGLLoader
     int nrAttributes;
@@ -269,15 +1028,40 @@ void initOpenGl() {
 
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     std::cout << "OpenGL version: " << glGetString(GL_VERSION) << "\n";
-    glEnable(GL_DEPTH_TEST);
+    glState.enable(GL_DEPTH_TEST);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     render_loop(window);
     glfwDestroyWindow(window);
     glfwTerminate();
+    return true;
 }
+#endif
 
+#ifdef HAVE_EGL
+// false when there was no context to render with or the frame could not be written; the reason has been printed
+bool initHeadless() {
+    HeadlessContext context(options.width, options.height);
+    if (!context.valid()) {
+        return false;
+    }
+
+    std::cout << "OpenGL version: " << glGetString(GL_VERSION) << "\n";
+    std::cout << "OpenGL renderer: " << glGetString(GL_RENDERER) << "\n";
+    glState.enable(GL_DEPTH_TEST);
+    render_loop(nullptr);
+
+    if (!options.output.empty()) {
+        if (!context.writePPM(options.output))
+            return false;
+        std::cout << "Wrote " << options.output << std::endl;
+    }
+    return true;
+}
+#endif
+
+#ifdef HAVE_GLFW
 void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, GLFW_TRUE);
@@ -310,6 +1094,21 @@ void processInput(GLFWwindow *window) {
             mixValue = 0.0f;
         }
     }
+
+    // toggle on the press, not while the key is held
+    static bool flashlightKey = false;
+    bool pressed = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (pressed && !flashlightKey) {
+        flashlight = !flashlight;
+    }
+    flashlightKey = pressed;
+
+    static bool pickButton = false;
+    bool clicked = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (clicked && !pickButton) {
+        pickRequested = true;
+    }
+    pickButton = clicked;
 }
 
 void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
@@ -323,47 +1122,170 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     camera.ProcessMouseScroll(yoffset);
 }
+#endif
 
-unsigned int loadTexture(char const *path, bool invert = false) {
-    uint textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    } else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+void printUsage() {
+    std::cerr << "Usage: shaders [--cubes N] [--no-instancing] [--headless] [--frames N] [--size WxH]"
+              << " [--output frame.ppm] [--trace trace.json] [--shader-cache DIR | --no-shader-cache]"
+              << " [--watch-shaders] [--point-lights N] [--no-flashlight]"
+              << " [--pipeline forward|clustered|deferred] [--culling none|flat|bvh]"
+              << " [--vertex-format float|compact|quantized] [--mesh file.mesh|.obj|.gltf|.glb]"
+              << " [--convert-mesh cube|model file.mesh]"
+              << " [--animate] [--workers N] [--validate-gl-state]"
+              << " [--benchmark bvh|transforms|jobs|mesh|normals|import]\n";
+}
 
-    return textureID;
+// the whole text has to be a decimal number that fits
+bool parseNumber(std::string_view text, unsigned int &value) {
+    const char *end = text.data() + text.size();
+    const auto [last, error] = std::from_chars(text.data(), end, value);
+    return error == std::errc() && last == end && !text.empty();
+}
+
+Options parseOptions(int argc, char **argv) {
+    Options parsed;
+    auto number = [&](const std::string &option, std::string_view text, unsigned int &value) {
+        if (!parseNumber(text, value)) {
+            std::cerr << "Invalid value for " << option << ": " << text << "\n";
+            parsed.invalid = true;
+        }
+    };
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cubes" && i + 1 < argc) {
+            number(arg, argv[++i], parsed.cubes);
+        } else if (arg == "--no-instancing") {
+            parsed.instanced = false;
+        } else if (arg == "--headless") {
+            parsed.headless = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            number(arg, argv[++i], parsed.frames);
+        } else if (arg == "--size" && i + 1 < argc) {
+            std::string_view size = argv[++i];
+            size_t x = size.find('x');
+            if (x == std::string_view::npos || !parseNumber(size.substr(0, x), parsed.width) ||
+                !parseNumber(size.substr(x + 1), parsed.height)) {
+                std::cerr << "Invalid value for --size: " << size << ", expected WxH\n";
+                parsed.invalid = true;
+            }
+        } else if (arg == "--output" && i + 1 < argc) {
+            parsed.output = argv[++i];
+        } else if (arg == "--shader-cache" && i + 1 < argc) {
+            parsed.shaderCache = argv[++i];
+        } else if (arg == "--no-shader-cache") {
+            parsed.shaderCache.clear();
+        } else if (arg == "--point-lights" && i + 1 < argc) {
+            number(arg, argv[++i], parsed.pointLights);
+            parsed.pointLights = std::min(parsed.pointLights, LightClusters::MAX_LIGHTS);
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            std::string pipeline = argv[++i];
+            if (pipeline == "forward") {
+                parsed.pipeline = Pipeline::Forward;
+            } else if (pipeline == "clustered") {
+                parsed.pipeline = Pipeline::Clustered;
+            } else if (pipeline == "deferred") {
+                parsed.pipeline = Pipeline::Deferred;
+            } else {
+                std::cerr << "Unknown pipeline: " << pipeline << ", expected forward, clustered or deferred\n";
+            }
+        } else if (arg == "--culling" && i + 1 < argc) {
+            std::string culling = argv[++i];
+            if (culling == "none") {
+                parsed.culling = Culling::None;
+            } else if (culling == "flat") {
+                parsed.culling = Culling::Flat;
+            } else if (culling == "bvh") {
+                parsed.culling = Culling::BVH;
+            } else {
+                std::cerr << "Unknown culling: " << culling << ", expected none, flat or bvh\n";
+            }
+        } else if (arg == "--vertex-format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "float") {
+                parsed.vertexEncoding = VertexEncoding::full();
+            } else if (format == "compact") {
+                parsed.vertexEncoding = VertexEncoding::compact();
+            } else if (format == "quantized") {
+                parsed.vertexEncoding = VertexEncoding::quantized();
+            } else {
+                std::cerr << "Unknown vertex format: " << format << ", expected float, compact or quantized\n";
+            }
+        } else if (arg == "--mesh" && i + 1 < argc) {
+            parsed.mesh = argv[++i];
+        } else if (arg == "--convert-mesh" && i + 2 < argc) {
+            parsed.convertSource = argv[++i];
+            parsed.convertOutput = argv[++i];
+        } else if (arg == "--animate") {
+            parsed.animate = true;
+        } else if (arg == "--workers" && i + 1 < argc) {
+            number(arg, argv[++i], parsed.workers);
+        } else if (arg == "--validate-gl-state") {
+            parsed.validateGLState = true;
+        } else if (arg == "--benchmark" && i + 1 < argc) {
+            parsed.benchmark = argv[++i];
+        } else if (arg == "--no-flashlight") {
+            parsed.flashlight = false;
+        } else if (arg == "--watch-shaders") {
+            parsed.watchShaders = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            parsed.trace = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            printUsage();
+        }
+    }
+    if (parsed.pipeline == Pipeline::Forward && parsed.pointLights > MAX_POINT_LIGHTS) {
+        std::cerr << "Forward shading takes at most " << MAX_POINT_LIGHTS
+                  << " point lights, use --pipeline clustered or deferred\n";
+        parsed.pointLights = MAX_POINT_LIGHTS;
+    }
+    // a headless run has nothing to close, so it always needs an end
+    if (parsed.headless && parsed.frames == 0) {
+        parsed.frames = 100;
+    }
+    return parsed;
 }
 
+#ifdef HAVE_GLFW
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     std::cout << "Framebuffer size: " << width << " x " << height << std::endl;
-    glViewport(0, 0, width, height);
-} // TIP To <b>Run</b> code, press <shortcut actionId="Run"/> or click the <icon
+    glState.viewport(0, 0, width, height);
+    // the projection and the cluster tiles follow the framebuffer
+    if (width > 0 && height > 0) {
+        options.width = static_cast<unsigned int>(width);
+        options.height = static_cast<unsigned int>(height);
+    }
+}
+#endif
+// TIP To <b>Run</b> code, press <shortcut actionId="Run"/> or click the <icon
 // src="AllIcons.Actions.Execute"/> icon in the gutter.
-int main() {
-    initOpenGl();
+int main(int argc, char **argv) {
+    options = parseOptions(argc, argv);
+    if (options.invalid) {
+        printUsage();
+        return 2;
+    }
+    if (!options.benchmark.empty()) {
+        return Benchmark::run(options.benchmark, std::cout) ? 0 : 1;
+    }
+    if (!options.convertSource.empty()) {
+        return convertMesh(options.convertSource, options.convertOutput) ? 0 : 1;
+    }
+    if (options.headless) {
+#ifdef HAVE_EGL
+        return initHeadless() ? 0 : 1;
+#else
+        std::cerr << "Built without EGL, --headless is not available\n";
+        return 1;
+#endif
+    }
+#ifdef HAVE_GLFW
+    if (!initOpenGl())
+        return 1;
+#else
+    std::cerr << "Built without GLFW, only --headless is available\n";
+    return 1;
+#endif
 
     return 0;
     // TIP See CLion help at <a